@@ -8,9 +8,14 @@
 #include <iostream>
 #include <stdio.h>
 #include <queue>
+#include <cstring>
+#include "mappedfile.h"
 
 void JointTree::clearJoints() {
-	//use omp to enter jointtree and delete tree from root
+	joints.clear();
+	root = -1;
+	index.Clear();
+	index_valid = true;
 }
 
 void JointTree::DeselectAll() {
@@ -21,47 +26,87 @@ void JointTree::DeselectAll() {
 
 int JointTree::Select(glm::vec3 pos) {
 	DeselectAll();
-	int closest = -1;
-	float shortest = -1;
-	for (int j = 0; j < joints.size(); j++) {
-		//make sure there are no selected joints already if we're picking one
-		glm::vec3 cnd = joints[j].getPos();
-		float distance = sqrt(pow((cnd.x-pos.x), 2) + pow((cnd.y-pos.y), 2) + pow((cnd.z-pos.z), 2));
-		if (closest == -1 || (distance < shortest)) {
-			closest = j;
-			shortest = distance;
-		}
-	}
+	IndexJoints();
+	int closest = index.Nearest(pos);
+	if (closest == -1) return -1;
 	joints[closest].select();
 	assert(joints[closest].isSelected());
 	return closest;
 }
 
 int JointTree::getClosest(int i) {
-	int closest = -1;
-	float shortest = -1;
-	glm::vec3 jt = joints[i].getPos();
-	for (int j = 0; j < i; j++) {
-		glm::vec3 cnd = joints[j].getPos();
-		float distance = sqrt(pow((cnd.x-jt.x), 2) + pow((cnd.y-jt.y), 2) + pow((cnd.z-jt.z), 2));
-		if (closest == -1 || (distance < shortest)) {
-			closest = j;
-			shortest = distance;
-		}
-	}
-	for (int j = i+1; j < joints.size(); j++) {
-		glm::vec3 cnd = joints[j].getPos();
-		float distance = sqrt(pow((cnd.x-jt.x), 2) + pow((cnd.y-jt.y), 2) + pow((cnd.z-jt.z), 2));
-		if (closest == -1 || (distance < shortest)) {
-			closest = j;
-			shortest = distance;
-		}
+	IndexJoints();
+	return index.Nearest(joints[i].getPos(), i);
+}
+
+void JointTree::getKClosest(const glm::vec3 &pos, int k, std::vector<int> &result) {
+	IndexJoints();
+	index.KNearest(pos, k, result);
+}
+
+void JointTree::IndexJoints() {
+	if (index_valid) return;
+	std::vector<glm::vec3> positions(joints.size());
+	for (unsigned int i = 0; i < joints.size(); i++) {
+		positions[i] = joints[i].getPos();
 	}
-	return closest;
-	//return NULL;
+	index.Build(positions);
+	index_valid = true;
+}
+
+// ==================================================================
+// RIG FILES
+// ==================================================================
+// Text (.rig): the joint count, one "x y z index" line per joint, a
+// blank line, then one "parent child child ..." line per joint in
+// breadth first order from the root.
+//
+// Binary (.rigb), loaded with a single mapping of the file:
+//   header
+//   float positions[3*num_joints]
+//   int   parents[num_joints]        (-1 for the root)
+// A joint's children are listed in index order.
+
+// bump this whenever the binary layout changes
+#define RIG_FILE_VERSION 1
+#define RIG_FILE_BYTE_ORDER 0x01020304
+
+struct RigFileHeader {
+	char magic[8];
+	unsigned int version;
+	unsigned int byte_order;
+	int num_joints;
+	int root;
+};
+
+static const char RIG_FILE_MAGIC[8] = { 'R','I','G','B','I','N','\0','\0' };
+
+static bool HasExtension(const std::string &filename, const std::string &extension) {
+	return filename.size() >= extension.size() &&
+		filename.compare(filename.size()-extension.size(), extension.size(), extension) == 0;
 }
 
 bool JointTree::Save(std::string fname) {
+	if (HasExtension(fname, ".rigb")) return SaveBinary(fname);
+	return SaveText(fname);
+}
+
+bool JointTree::Parallel_load(std::string filename) {
+	MappedFile file;
+	if (!file.Open(filename)) {
+		std::cerr << "ERROR: could not open rigging file" << std::endl;
+		return false;
+	}
+	// either format, the binary one starts with the magic string
+	if (file.getSize() >= sizeof(RIG_FILE_MAGIC) &&
+	    memcmp(file.getData(), RIG_FILE_MAGIC, sizeof(RIG_FILE_MAGIC)) == 0) {
+		return LoadBinary(file.getData(), file.getSize());
+	}
+	file.Close();
+	return LoadText(filename);
+}
+
+bool JointTree::SaveText(std::string fname) {
 	std::ofstream of(fname);
 	if (!of.good()) {
 		std::cerr << "issue opening ouput file";
@@ -74,7 +119,7 @@ bool JointTree::Save(std::string fname) {
 	}
 	of << "\n";
 	std::queue<int> bfs;
-	bfs.push(root);
+	if (root >= 0 && root < size()) bfs.push(root);
 	while (!bfs.empty()) {
 		int current = bfs.front();
 		bfs.pop();
@@ -90,32 +135,158 @@ bool JointTree::Save(std::string fname) {
 	return true;
 }
 
-bool JointTree::Parallel_load(std::string filename) {
+bool JointTree::SaveBinary(std::string fname) {
+	RigFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RIG_FILE_MAGIC, sizeof(header.magic));
+	header.version = RIG_FILE_VERSION;
+	header.byte_order = RIG_FILE_BYTE_ORDER;
+	header.num_joints = joints.size();
+	header.root = root;
+
+	// assemble the whole file & write it at once
+	std::vector<char> out(sizeof(header) + joints.size()*(3*sizeof(float) + sizeof(int)));
+	memcpy(&out[0], &header, sizeof(header));
+	float *positions = (float*)&out[sizeof(header)];
+	int *parents = (int*)(positions + 3*joints.size());
+	for (unsigned int i = 0; i < joints.size(); i++) {
+		glm::vec3 tpos = joints[i].getPos();
+		positions[3*i+0] = tpos.x;
+		positions[3*i+1] = tpos.y;
+		positions[3*i+2] = tpos.z;
+		parents[i] = joints[i].getParent();
+	}
+
+	FILE *file = fopen(fname.c_str(), "wb");
+	if (file == NULL) {
+		std::cerr << "issue opening ouput file";
+		return false;
+	}
+	bool ok = fwrite(&out[0], 1, out.size(), file) == out.size();
+	ok = (fclose(file) == 0) && ok;
+	return ok;
+}
+
+// a rig is one tree: only the root has no parent & every other joint
+// reaches it without passing through a joint twice
+static bool ValidHierarchy(const std::vector<int> &parents, int root) {
+	int num_joints = parents.size();
+	if (num_joints == 0) return root == -1;
+	if (root < 0 || root >= num_joints || parents[root] != -1) return false;
+	// 0 = not visited, 1 = on the current path, 2 = reaches the root
+	std::vector<char> state(num_joints, 0);
+	state[root] = 2;
+	for (int i = 0; i < num_joints; i++) {
+		int j = i;
+		while (state[j] == 0) {
+			state[j] = 1;
+			j = parents[j];
+			// a second root or a cycle
+			if (j == -1 || state[j] == 1) return false;
+		}
+		for (j = i; state[j] == 1; j = parents[j]) state[j] = 2;
+	}
+	return true;
+}
+
+bool JointTree::LoadText(std::string filename) {
 	std::ifstream rigfile(filename);
 	if (!rigfile.good()) {
 		std::cerr << "ERROR: could not open rigging file" << std::endl;
 		return false;
 	}
 	int num_joints;
-	rigfile >> num_joints;
-	joints = std::vector<Joint>(num_joints);
+	if (!(rigfile >> num_joints) || num_joints < 0) {
+		std::cerr << "ERROR: bad rigging file " << filename << std::endl;
+		return false;
+	}
+	// parse into locals, the tree is only replaced by a valid rig
+	std::vector<Joint> loaded(num_joints);
+	std::vector<bool> listed(num_joints, false);
 	for (int i = 0; i < num_joints; i++) {
 		float x,y,z;
 		int index;
 		rigfile >> x >> y >> z >> index;
-		Joint temp(index, glm::vec3(x,y,z));	
-		joints[index] = temp;
-
+		if (!rigfile || index < 0 || index >= num_joints || listed[index]) {
+			std::cerr << "ERROR: bad joint in rigging file " << filename << std::endl;
+			return false;
+		}
+		loaded[index] = Joint(index, glm::vec3(x,y,z));
+		listed[index] = true;
 	}
+	int loaded_root = (num_joints > 0) ? 0 : -1;
+	std::vector<int> parents(num_joints, -1);
 	std::string token;
+	bool first_line = true;
 	while (getline(rigfile, token)) {
 		std::stringstream ss(token);
 		int root;
 		int child;
-		ss >> root;
+		if (!(ss >> root)) continue;
+		if (root < 0 || root >= num_joints) {
+			std::cerr << "ERROR: bad joint in rigging file " << filename << std::endl;
+			return false;
+		}
+		// the breadth first listing starts at the root
+		if (first_line) loaded_root = root;
+		first_line = false;
 		while (ss >> child) {
-			parent(child, root);
+			// a joint listed twice as a child would have two parents
+			if (child < 0 || child >= num_joints || parents[child] != -1) {
+				std::cerr << "ERROR: bad joint in rigging file " << filename << std::endl;
+				return false;
+			}
+			parents[child] = root;
+			loaded[child].setParent(root);
+			loaded[root].addChild(child);
+		}
+	}
+	if (!ValidHierarchy(parents, loaded_root)) {
+		std::cerr << "ERROR: bad hierarchy in rigging file " << filename << std::endl;
+		return false;
+	}
+	joints.swap(loaded);
+	root = loaded_root;
+	index_valid = false;
+	return true;
+}
+
+bool JointTree::LoadBinary(const char *data, size_t bytes) {
+	RigFileHeader header;
+	if (bytes < sizeof(header)) return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.version != RIG_FILE_VERSION || header.byte_order != RIG_FILE_BYTE_ORDER) {
+		std::cerr << "ERROR: unsupported binary rigging file version" << std::endl;
+		return false;
+	}
+	int num_joints = header.num_joints;
+	if (num_joints < 0 ||
+	    (bytes - sizeof(header)) / (3*sizeof(float) + sizeof(int)) < (size_t)num_joints ||
+	    header.root < -1 || header.root >= num_joints) {
+		std::cerr << "ERROR: bad binary rigging file" << std::endl;
+		return false;
+	}
+	const float *positions = (const float*)(data + sizeof(header));
+	const int *parents = (const int*)(positions + 3*num_joints);
+	for (int i = 0; i < num_joints; i++) {
+		if (parents[i] < -1 || parents[i] >= num_joints) {
+			std::cerr << "ERROR: bad joint in binary rigging file" << std::endl;
+			return false;
 		}
 	}
-	
+	if (!ValidHierarchy(std::vector<int>(parents, parents + num_joints), header.root)) {
+		std::cerr << "ERROR: bad hierarchy in binary rigging file" << std::endl;
+		return false;
+	}
+
+	joints = std::vector<Joint>(num_joints);
+	root = header.root;
+	index_valid = false;
+	for (int i = 0; i < num_joints; i++) {
+		joints[i] = Joint(i, glm::vec3(positions[3*i+0], positions[3*i+1], positions[3*i+2]));
+	}
+	for (int i = 0; i < num_joints; i++) {
+		if (parents[i] != -1) parent(i, parents[i]);
+	}
+	return true;
 }
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <omp.h>
+#include "animation.h"
+
+// the smallest three components of a unit quaternion are within this
+#define ANIMATION_QUAT_RANGE 0.70710678f
+#define ANIMATION_QUAT_STEPS 32767
+
+// normalized lerp, the short way round
+static glm::quat Nlerp(const glm::quat &a, const glm::quat &b, float s) {
+	float sign = (a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z < 0) ? -1.0f : 1.0f;
+	return glm::normalize(glm::quat(a.w + s*(sign*b.w - a.w), a.x + s*(sign*b.x - a.x),
+					a.y + s*(sign*b.y - a.y), a.z + s*(sign*b.z - a.z)));
+}
+
+static float Angle(const glm::quat &a, const glm::quat &b) {
+	float c = std::fabs(a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z);
+	return 2*std::acos(std::min(1.0f,c));
+}
+
+// ==================================================================
+// BUILDING
+// ==================================================================
+
+void AnimationClip::Build(int _num_joints, int _num_frames, float _frame_rate, const glm::quat *rotations,
+			  const glm::vec3 *translations, float rotation_tolerance, float translation_tolerance) {
+	assert (_num_frames > 0 && _num_frames <= 65536);
+	assert (_frame_rate > 0);
+	num_joints = _num_joints;
+	num_frames = _num_frames;
+	frame_rate = _frame_rate;
+	rotation_tracks.resize(num_joints);
+	rotation_frames.clear();
+	rotation_keys.clear();
+	translation_tracks.resize(num_joints);
+	translation_frames.clear();
+	translation_keys.clear();
+
+	std::vector<int> kept;
+	for (int j = 0; j < num_joints; j++) {
+		// rotations: one key if the joint never turns, else the fit
+		const glm::quat *rotation = rotations + j;
+		kept.assign(1,0);
+		int f = 1;
+		while (f < num_frames && Angle(rotation[0],rotation[f*num_joints]) <= rotation_tolerance) f++;
+		if (f < num_frames) FitRotations(rotation,num_joints,0,num_frames-1,rotation_tolerance,kept);
+		rotation_tracks[j].first_key = rotation_keys.size();
+		rotation_tracks[j].num_keys = kept.size();
+		for (unsigned int k = 0; k < kept.size(); k++) {
+			rotation_frames.push_back(kept[k]);
+			rotation_keys.push_back(Quantize(rotation[kept[k]*num_joints]));
+		}
+
+		// translations: the same, kept at full precision
+		const glm::vec3 *translation = translations + j;
+		kept.assign(1,0);
+		f = 1;
+		while (f < num_frames && glm::distance(translation[0],translation[f*num_joints]) <= translation_tolerance) f++;
+		if (f < num_frames) FitTranslations(translation,num_joints,0,num_frames-1,translation_tolerance,kept);
+		translation_tracks[j].first_key = translation_keys.size();
+		translation_tracks[j].num_keys = kept.size();
+		for (unsigned int k = 0; k < kept.size(); k++) {
+			translation_frames.push_back(kept[k]);
+			translation_keys.push_back(translation[kept[k]*num_joints]);
+		}
+	}
+}
+
+// keep the frame furthest from the interpolation of first & last, and
+// fit either side of it, until every frame is within tolerance.  the
+// caller has kept first.
+void AnimationClip::FitRotations(const glm::quat *frames, int stride, int first, int last, float tolerance,
+				 std::vector<int> &kept) {
+	float worst_error = 0;
+	int worst = -1;
+	for (int f = first+1; f < last; f++) {
+		float s = (f-first) / float(last-first);
+		float error = Angle(frames[f*stride],Nlerp(frames[first*stride],frames[last*stride],s));
+		if (error > worst_error) {
+			worst_error = error;
+			worst = f;
+		}
+	}
+	if (worst_error > tolerance) {
+		FitRotations(frames,stride,first,worst,tolerance,kept);
+		FitRotations(frames,stride,worst,last,tolerance,kept);
+	} else {
+		kept.push_back(last);
+	}
+}
+
+void AnimationClip::FitTranslations(const glm::vec3 *frames, int stride, int first, int last, float tolerance,
+				    std::vector<int> &kept) {
+	float worst_error = 0;
+	int worst = -1;
+	for (int f = first+1; f < last; f++) {
+		float s = (f-first) / float(last-first);
+		float error = glm::distance(frames[f*stride],glm::mix(frames[first*stride],frames[last*stride],s));
+		if (error > worst_error) {
+			worst_error = error;
+			worst = f;
+		}
+	}
+	if (worst_error > tolerance) {
+		FitTranslations(frames,stride,first,worst,tolerance,kept);
+		FitTranslations(frames,stride,worst,last,tolerance,kept);
+	} else {
+		kept.push_back(last);
+	}
+}
+
+// ==================================================================
+// QUANTIZATION
+// ==================================================================
+
+// the index of the dropped component goes in the top bits of the first two
+AnimationClip::QuantizedQuat AnimationClip::Quantize(const glm::quat &q) {
+	float c[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++) {
+		if (std::fabs(c[i]) > std::fabs(c[largest])) largest = i;
+	}
+	// q & -q are the same rotation: make the dropped one positive
+	float sign = (c[largest] < 0) ? -1.0f : 1.0f;
+	QuantizedQuat result;
+	int k = 0;
+	for (int i = 0; i < 4; i++) {
+		if (i == largest) continue;
+		float u = (sign*c[i]/ANIMATION_QUAT_RANGE + 1) * 0.5f;
+		u = std::min(1.0f,std::max(0.0f,u));
+		result.v[k++] = (unsigned short)(u*ANIMATION_QUAT_STEPS + 0.5f);
+	}
+	result.v[0] |= (largest >> 1) << 15;
+	result.v[1] |= (largest & 1) << 15;
+	return result;
+}
+
+glm::quat AnimationClip::Dequantize(const QuantizedQuat &q) {
+	int largest = ((q.v[0] >> 15) << 1) | (q.v[1] >> 15);
+	float c[4];
+	float sum = 0;
+	int k = 0;
+	for (int i = 0; i < 4; i++) {
+		if (i == largest) continue;
+		float u = (q.v[k++] & 0x7fff) / float(ANIMATION_QUAT_STEPS);
+		c[i] = (2*u - 1) * ANIMATION_QUAT_RANGE;
+		sum += c[i]*c[i];
+	}
+	c[largest] = std::sqrt(std::max(0.0f,1-sum));
+	return glm::quat(c[3],c[0],c[1],c[2]);
+}
+
+// ==================================================================
+// SAMPLING
+// ==================================================================
+
+int AnimationClip::getBytes() const {
+	return rotation_keys.size()*(sizeof(QuantizedQuat)+sizeof(unsigned short)) +
+		translation_keys.size()*(sizeof(glm::vec3)+sizeof(unsigned short)) +
+		(rotation_tracks.size()+translation_tracks.size())*sizeof(Track);
+}
+
+int AnimationClip::FindKey(const std::vector<unsigned short> &frames, const Track &track, float frame) {
+	std::vector<unsigned short>::const_iterator begin = frames.begin() + track.first_key;
+	std::vector<unsigned short>::const_iterator end = begin + track.num_keys;
+	// every track has a key at frame 0
+	return std::upper_bound(begin+1,end,frame) - frames.begin() - 1;
+}
+
+// past the last key, a track goes back to its first key at the end of the clip
+void AnimationClip::Sample(float time, glm::quat *rotations, glm::vec3 *translations) const {
+	float frame = std::fmod(time*frame_rate,float(num_frames));
+	if (frame < 0) frame += num_frames;
+	for (int j = 0; j < num_joints; j++) {
+		const Track &track = rotation_tracks[j];
+		int k = (track.num_keys == 1) ? track.first_key : FindKey(rotation_frames,track,frame);
+		glm::quat a = Dequantize(rotation_keys[k]);
+		if (track.num_keys == 1) {
+			rotations[j] = a;
+		} else {
+			int next = k+1;
+			float next_frame;
+			if (next == track.first_key + track.num_keys) {
+				next = track.first_key;
+				next_frame = num_frames;
+			} else {
+				next_frame = rotation_frames[next];
+			}
+			float s = (frame - rotation_frames[k]) / (next_frame - rotation_frames[k]);
+			rotations[j] = Nlerp(a,Dequantize(rotation_keys[next]),s);
+		}
+	}
+	for (int j = 0; j < num_joints; j++) {
+		const Track &track = translation_tracks[j];
+		int k = (track.num_keys == 1) ? track.first_key : FindKey(translation_frames,track,frame);
+		if (track.num_keys == 1) {
+			translations[j] = translation_keys[k];
+		} else {
+			int next = k+1;
+			float next_frame;
+			if (next == track.first_key + track.num_keys) {
+				next = track.first_key;
+				next_frame = num_frames;
+			} else {
+				next_frame = translation_frames[next];
+			}
+			float s = (frame - translation_frames[k]) / (next_frame - translation_frames[k]);
+			translations[j] = glm::mix(translation_keys[k],translation_keys[next],s);
+		}
+	}
+}
+
+// ==================================================================
+// BATCHES
+// ==================================================================
+
+int AnimationBatch::addCharacter(const AnimationClip *clip, float time) {
+	clips.push_back(clip);
+	times.push_back(time);
+	stride = std::max(stride,clip->numJoints());
+	return clips.size()-1;
+}
+
+void AnimationBatch::setClip(int character, const AnimationClip *clip) {
+	clips[character] = clip;
+	stride = std::max(stride,clip->numJoints());
+}
+
+double AnimationBatch::Sample() {
+	double start = omp_get_wtime();
+	int n = clips.size();
+	rotations.resize(n*stride);
+	translations.resize(n*stride);
+	// handed out a few characters at a time to whichever thread is free
+#pragma omp parallel for schedule(dynamic,8)
+	for (int i = 0; i < n; i++) {
+		clips[i]->Sample(times[i],&rotations[i*stride],&translations[i*stride]);
+	}
+	return 1000*(omp_get_wtime()-start);
+}
@@ -0,0 +1,111 @@
+#ifndef _ANIMATION_H
+#define _ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+// ==================================================================
+// A looping animation of a Skeleton: one track of keys per joint slot
+// for the local rotation & one for the local translation.  A clip is
+// built from every frame of a recording, then compressed:
+//   - keys the neighbouring keys already interpolate to within a
+//     tolerance are dropped (a recursive fit, like the stroke polylines)
+//   - rotation keys are quantized to 6 bytes (the smallest three
+//     components at 15 bits, the largest rebuilt from unit length)
+//   - key times are frame numbers in 2 bytes
+// A joint that never moves keeps a single key.  Sampling at any time
+// interpolates the two keys around it (normalized lerp).
+
+class AnimationClip {
+public:
+	//Constructor
+	AnimationClip() : num_joints(0), num_frames(0), frame_rate(30) {}
+
+	//Accessors
+	int numJoints() const { return num_joints; }
+	int numFrames() const { return num_frames; }
+	float getDuration() const { return num_frames / frame_rate; }
+	int numKeys() const { return rotation_keys.size() + translation_keys.size(); }
+	// the size of the keys & tracks, & what the frames took before
+	int getBytes() const;
+	int getRawBytes() const { return num_frames*num_joints*(sizeof(glm::quat)+sizeof(glm::vec3)); }
+	// the local pose of every joint at time (seconds, looping)
+	void Sample(float time, glm::quat *rotations, glm::vec3 *translations) const;
+
+	//Modifiers
+	// from num_frames frames of num_joints local transforms (frame
+	// major), with the tolerances in radians & model units
+	void Build(int _num_joints, int _num_frames, float _frame_rate, const glm::quat *rotations,
+		   const glm::vec3 *translations, float rotation_tolerance, float translation_tolerance);
+
+private:
+
+	struct Track {
+		int first_key;
+		int num_keys;
+	};
+	struct QuantizedQuat {
+		unsigned short v[3];
+	};
+
+	//helpers
+	static QuantizedQuat Quantize(const glm::quat &q);
+	static glm::quat Dequantize(const QuantizedQuat &q);
+	// the frame of each key kept, fitting the frames from first to last
+	static void FitRotations(const glm::quat *frames, int stride, int first, int last, float tolerance,
+				 std::vector<int> &kept);
+	static void FitTranslations(const glm::vec3 *frames, int stride, int first, int last, float tolerance,
+				    std::vector<int> &kept);
+	// the key at or before frame in a track
+	static int FindKey(const std::vector<unsigned short> &frames, const Track &track, float frame);
+
+	//representation
+	int num_joints;
+	int num_frames;
+	float frame_rate;
+	std::vector<Track> rotation_tracks;
+	std::vector<unsigned short> rotation_frames;
+	std::vector<QuantizedQuat> rotation_keys;
+	std::vector<Track> translation_tracks;
+	std::vector<unsigned short> translation_frames;
+	std::vector<glm::vec3> translation_keys;
+};
+
+// ==================================================================
+// Many characters, each playing a clip at its own time, sampled into
+// one flat buffer: the pose of character i is num_joints rotations &
+// translations starting at i*stride (stride being the most joints of
+// any clip).  The characters are spread over the threads a few at a
+// time, so clips of different sizes still balance.
+
+class AnimationBatch {
+public:
+	//Constructor
+	AnimationBatch() : stride(0) {}
+
+	//Accessors
+	int numCharacters() const { return clips.size(); }
+	const glm::quat* getRotations(int character) const { return &rotations[character*stride]; }
+	const glm::vec3* getTranslations(int character) const { return &translations[character*stride]; }
+
+	//Modifiers
+	// returns the character number
+	int addCharacter(const AnimationClip *clip, float time = 0);
+	void setTime(int character, float time) { times[character] = time; }
+	void setClip(int character, const AnimationClip *clip);
+	void clear() { clips.clear(); times.clear(); stride = 0; }
+	// sample every character, returns the time in ms
+	double Sample();
+
+private:
+
+	//representation
+	std::vector<const AnimationClip*> clips;
+	std::vector<float> times;
+	int stride;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> translations;
+};
+
+#endif
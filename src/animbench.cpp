@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <omp.h>
+#include <glm/glm.hpp>
+
+#include "argparser.h"
+#include "glCanvas.h"
+#include "mesh.h"
+#include "joint.h"
+#include "autorigger.h"
+#include "skeleton.h"
+#include "animation.h"
+
+// ====================================================================
+// Times sampling animation poses for a crowd of characters sharing
+// the rig of a model (rigged automatically):
+//
+//   anim_bench ../models/new_hand.obj
+//   anim_bench ../models/new_FinalBaseMesh.obj 10000 50
+//
+// A few clips are recorded at 30 frames per second, every joint
+// swinging smoothly, and compressed.  Each character plays one of the
+// clips at its own time.  Reports the size of the clips, the worst
+// error the compression made, and the poses sampled per second on one
+// thread & on all of them.
+// ====================================================================
+
+#define ANIM_BENCH_CLIPS 4
+#define ANIM_BENCH_FRAMES 240
+#define ANIM_BENCH_FRAME_RATE 30.0f
+
+static double Median(std::vector<double> times) {
+  std::sort(times.begin(),times.end());
+  return times[times.size()/2];
+}
+
+// a few frequencies per joint, so the clip has some keys to keep
+static void Record(const Skeleton &skeleton, int clip, std::vector<glm::quat> &rotations,
+                   std::vector<glm::vec3> &translations) {
+  int n = skeleton.size();
+  rotations.resize(ANIM_BENCH_FRAMES*n);
+  translations.resize(ANIM_BENCH_FRAMES*n);
+  for (int f = 0; f < ANIM_BENCH_FRAMES; f++) {
+    float t = 2*M_PI * f / ANIM_BENCH_FRAMES;
+    for (int s = 0; s < n; s++) {
+      float phase = 0.7f*s + 1.3f*clip;
+      glm::vec3 axis = glm::normalize(glm::vec3(std::sin(phase),std::cos(1.7f*phase),0.5f));
+      float angle = 0.4f*std::sin(t*(1+clip) + phase) + 0.1f*std::sin(3*t + 2*phase);
+      rotations[f*n+s] = glm::angleAxis(angle,axis);
+      translations[f*n+s] = skeleton.getLocalTranslation(s);
+    }
+    // the roots bob up & down
+    for (int s = 0; s < n; s++) {
+      if (skeleton.getParent(s) < 0) translations[f*n+s].y += 0.05f*std::sin(2*t);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " <model.obj> [characters] [repetitions]" << std::endl;
+    return 1;
+  }
+  ArgParser args;
+  separatePathAndFile(argv[1],args.path,args.input_file);
+  args.mesh_cache = false;
+  GLCanvas::args = &args;
+  int characters = (argc > 2) ? std::max(1,atoi(argv[2])) : 1000;
+  int repetitions = (argc > 3) ? std::max(1,atoi(argv[3])) : 20;
+
+  Mesh *mesh = new Mesh();
+  mesh->Parallel(&args);
+  JointTree tree;
+  AutoRigger auto_rigger(mesh,&args);
+  if (auto_rigger.Rig(&tree) == 0) {
+    std::cerr << "ERROR: could not rig " << argv[1] << std::endl;
+    return 1;
+  }
+  Skeleton skeleton;
+  skeleton.Build(&tree);
+  int n = skeleton.size();
+
+  // record & compress the clips, checking every frame against the recording
+  std::vector<AnimationClip> clips(ANIM_BENCH_CLIPS);
+  std::vector<glm::quat> rotations, sampled_rotations(n);
+  std::vector<glm::vec3> translations, sampled_translations(n);
+  int bytes = 0, raw_bytes = 0, keys = 0;
+  float worst_angle = 0, worst_distance = 0;
+  for (int c = 0; c < ANIM_BENCH_CLIPS; c++) {
+    Record(skeleton,c,rotations,translations);
+    clips[c].Build(n,ANIM_BENCH_FRAMES,ANIM_BENCH_FRAME_RATE,&rotations[0],&translations[0],0.002f,0.0005f);
+    bytes += clips[c].getBytes();
+    raw_bytes += clips[c].getRawBytes();
+    keys += clips[c].numKeys();
+    for (int f = 0; f < ANIM_BENCH_FRAMES; f++) {
+      clips[c].Sample(f / ANIM_BENCH_FRAME_RATE,&sampled_rotations[0],&sampled_translations[0]);
+      for (int s = 0; s < n; s++) {
+        const glm::quat &a = rotations[f*n+s], &b = sampled_rotations[s];
+        float dot = std::fabs(a.w*b.w + a.x*b.x + a.y*b.y + a.z*b.z);
+        worst_angle = std::max(worst_angle,2*std::acos(std::min(1.0f,dot)));
+        worst_distance = std::max(worst_distance,glm::distance(translations[f*n+s],sampled_translations[s]));
+      }
+    }
+  }
+  std::cout << ANIM_BENCH_CLIPS << " clips of " << n << " joints & " << ANIM_BENCH_FRAMES << " frames: "
+            << keys << " keys of " << 2*n*ANIM_BENCH_FRAMES*ANIM_BENCH_CLIPS << ", " << bytes << " bytes of "
+            << raw_bytes << ", worst error " << worst_angle << " radians & " << worst_distance << std::endl;
+
+  // the crowd, at times that don't line up with the frames
+  AnimationBatch batch;
+  for (int i = 0; i < characters; i++) batch.addCharacter(&clips[i % ANIM_BENCH_CLIPS],0);
+  int threads = omp_get_max_threads();
+  for (int t = 0; t < 2; t++) {
+    if (t == 1 && threads == 1) break;
+    omp_set_num_threads(t == 0 ? 1 : threads);
+    std::vector<double> times;
+    for (int r = 0; r <= repetitions; r++) {
+      for (int i = 0; i < characters; i++) batch.setTime(i,0.37f*i + 0.011f*r);
+      double ms = batch.Sample();
+      if (r > 0) times.push_back(ms);
+    }
+    double median = Median(times);
+    std::cout << (t == 0 ? 1 : threads) << " thread(s): " << characters << " poses in " << median
+              << " ms (median of " << repetitions << "), " << characters / (median/1000) << " poses/s, "
+              << characters * n / (1000*median) << " M joints/s" << std::endl;
+  }
+  delete mesh;
+  return 0;
+}
@@ -63,11 +63,39 @@ public:
           std::string(argv[i]) == std::string("-i")) {
         i++; assert (i < argc); 
         separatePathAndFile(argv[i],path,input_file);
+      } else if (std::string(argv[i]) == std::string("-no_mesh_cache")) {
+        mesh_cache = false;
       } else if (std::string(argv[i]) == std::string("-size")) {
 	i++; assert (i < argc); 
 	width = atoi(argv[i]);
 	i++; assert (i < argc); 
          height = atoi(argv[i]);
+      } else if (std::string(argv[i]) == std::string("-headless")) {
+        headless = true;
+      } else if (std::string(argv[i]) == std::string("-output")) {
+        i++; assert (i < argc);
+        output = argv[i];
+      } else if (std::string(argv[i]) == std::string("-rig_output")) {
+        i++; assert (i < argc);
+        rig_output = argv[i];
+      } else if (std::string(argv[i]) == std::string("-num_subdivisions")) {
+        i++; assert (i < argc);
+        num_subdivisions = atoi(argv[i]);
+        assert (num_subdivisions >= 0);
+      } else if (std::string(argv[i]) == std::string("-auto_rig")) {
+        auto_rig = true;
+      } else if (std::string(argv[i]) == std::string("-auto_rig_resolution")) {
+        i++; assert (i < argc);
+        auto_rig_resolution = atoi(argv[i]);
+        assert (auto_rig_resolution > 0);
+      } else if (std::string(argv[i]) == std::string("-ik_chain_length")) {
+        i++; assert (i < argc);
+        ik_chain_length = atoi(argv[i]);
+        assert (ik_chain_length > 0);
+      } else if (std::string(argv[i]) == std::string("-ik_ccd")) {
+        ik_ccd = true;
+      } else if (std::string(argv[i]) == std::string("-catmull_clark")) {
+        catmull_clark = true;
       } else if (std::string(argv[i]) == std::string("-num_form_factor_samples")) {
 	i++; assert (i < argc); 
 	num_form_factor_samples = atoi(argv[i]);
@@ -140,11 +168,25 @@ public:
     height = 500;
     raytracing_animation = false;
     radiosity_animation = false;
+    mesh_cache = true;
+
+    // HEADLESS PARAMETERS
+    headless = false;
+    output = "";
+    rig_output = "";
+    num_subdivisions = 0;
+
+    // RIGGING PARAMETERS
+    auto_rig = false;
+    auto_rig_resolution = 32;
+    ik_chain_length = 3;
+    ik_ccd = false;
 
     // RADIOSITY PARAMETERS
     render_mode = RENDER_MATERIALS;
     interpolate = false;
     wireframe = false;
+    catmull_clark = false;
     num_form_factor_samples = 1;
     sphere_horiz = 8;
     sphere_vert = 6;
@@ -177,11 +219,33 @@ public:
   int height;
   bool raytracing_animation;
   bool radiosity_animation;
+  // read & write the binary .cache file next to the .obj
+  bool mesh_cache;
+
+  // HEADLESS PARAMETERS
+  // no window: load, rig & subdivide, then write the files below
+  bool headless;
+  // the ray traced view (.ppm) & the rig (.rig or .rigb)
+  std::string output;
+  std::string rig_output;
+  // subdivisions after loading (& rigging)
+  int num_subdivisions;
+
+  // RIGGING PARAMETERS
+  // build a rig from the mesh skeleton after loading
+  bool auto_rig;
+  // skeleton grid cells along the longest side of the bounding box
+  int auto_rig_resolution;
+  // bones moved when a joint is dragged, & CCD instead of FABRIK
+  int ik_chain_length;
+  bool ik_ccd;
 
   // RADIOSITY PARAMETERS
   enum RENDER_MODE render_mode;
   bool interpolate;
   bool wireframe;
+  // smooth when subdividing, instead of splitting at the midpoints
+  bool catmull_clark;
   int num_form_factor_samples;
   int sphere_horiz;
   int sphere_vert;
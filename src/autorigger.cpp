@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <omp.h>
+
+#include "autorigger.h"
+#include "argparser.h"
+#include "mesh.h"
+#include "face.h"
+#include "vertex.h"
+#include "ray.h"
+#include "bvh.h"
+#include "boundingbox.h"
+#include "radixsort.h"
+#include "joint.h"
+
+// joints along a chain are placed about this many grid cells apart
+#define AUTO_RIG_JOINT_SPACING 2.5f
+// side branches shorter than this many grid cells (or the radius of
+// the body where they branch off) are noise in the medial samples
+#define AUTO_RIG_MIN_BRANCH 2.0f
+// bits per grid coordinate in a cell key
+#define AUTO_RIG_CELL_BITS 21
+
+// =======================================================================
+
+int AutoRigger::Rig(JointTree *tree) {
+  double start = omp_get_wtime();
+  assert (mesh->getOriginalQuadsBVH() != NULL);
+  float cell_size = mesh->getBoundingBox()->maxDim() / std::max(1,args->auto_rig_resolution);
+
+  SampleMedialAxis();
+  ClusterSamples(cell_size);
+  ConnectClusters();
+  SpanningTree();
+  PruneBranches(AUTO_RIG_MIN_BRANCH*cell_size);
+  int num_joints = PlaceJoints(tree,AUTO_RIG_JOINT_SPACING*cell_size);
+
+  std::cout << " auto rig: " << num_joints << " joints from " << node_position.size()
+            << " skeleton nodes in " << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
+  return num_joints;
+}
+
+// =======================================================================
+// 1. MEDIAL SAMPLES
+
+void AutoRigger::SampleMedialAxis() {
+  int num_quads = mesh->numOriginalQuads();
+  samples.assign(num_quads,glm::vec3(0,0,0));
+  sample_radius.assign(num_quads,0);
+  sample_weight.assign(num_quads,0);
+  sample_cluster.assign(num_quads,-1);
+
+  // the face normals point outward if the enclosed volume is positive
+  double volume = 0;
+#pragma omp parallel for reduction(+:volume)
+  for (int i = 0; i < num_quads; i++) {
+    Face *f = mesh->getOriginalQuad(i);
+    glm::vec3 a = (*f)[0]->get();
+    glm::vec3 b = (*f)[1]->get();
+    glm::vec3 c = (*f)[2]->get();
+    glm::vec3 d = (*f)[3]->get();
+    volume += glm::dot(a,glm::cross(b,c)) + glm::dot(a,glm::cross(c,d));
+  }
+  float outward = (volume < 0) ? -1.0f : 1.0f;
+
+  // start just inside the surface so the ray doesn't hit its own quad
+  float offset = 0.0001f * mesh->getBoundingBox()->maxDim();
+  const BVH *bvh = mesh->getOriginalQuadsBVH();
+#pragma omp parallel for schedule(dynamic,256)
+  for (int i = 0; i < num_quads; i++) {
+    Face *f = mesh->getOriginalQuad(i);
+    glm::vec3 center = f->computeCentroid();
+    glm::vec3 inward = -outward * f->computeNormal();
+    Ray r(center + offset*inward, inward);
+    float t;
+    int hit = bvh->IntersectClosest(r,t,true);
+    if (hit == -1) continue;
+    // the ray must leave through the far wall, not enter another part
+    if (glm::dot(outward * mesh->getOriginalQuad(hit)->computeNormal(),inward) <= 0) continue;
+    float radius = 0.5f*(t + offset);
+    samples[i] = center + radius*inward;
+    sample_radius[i] = radius;
+    sample_weight[i] = f->getArea();
+  }
+}
+
+// =======================================================================
+// 2. CLUSTERS
+
+void AutoRigger::ClusterSamples(float cell_size) {
+  int num_quads = samples.size();
+  glm::vec3 lo = mesh->getBoundingBox()->getMin();
+  int max_cell = (1 << AUTO_RIG_CELL_BITS) - 1;
+
+  // sort the samples by grid cell, each run of one cell is a node
+  std::vector<int> ids;
+  for (int i = 0; i < num_quads; i++) {
+    if (sample_weight[i] > 0) ids.push_back(i);
+  }
+  int num_samples = ids.size();
+  std::vector<unsigned long long> keys(num_samples);
+#pragma omp parallel for
+  for (int i = 0; i < num_samples; i++) {
+    glm::vec3 p = (samples[ids[i]] - lo) / cell_size;
+    unsigned long long key = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      int c = std::min(max_cell,std::max(0,(int)std::floor(p[axis])));
+      key = (key << AUTO_RIG_CELL_BITS) | (unsigned long long)c;
+    }
+    keys[i] = key;
+  }
+  RadixSort(keys,ids,3*AUTO_RIG_CELL_BITS);
+
+  std::vector<int> runs;
+  for (int i = 0; i < num_samples; i++) {
+    if (i == 0 || keys[i] != keys[i-1]) runs.push_back(i);
+  }
+  runs.push_back(num_samples);
+  int num_nodes = runs.size()-1;
+  node_position.assign(num_nodes,glm::vec3(0,0,0));
+  node_radius.assign(num_nodes,0);
+#pragma omp parallel for
+  for (int n = 0; n < num_nodes; n++) {
+    glm::vec3 position(0,0,0);
+    float radius = 0;
+    float weight = 0;
+    for (int i = runs[n]; i < runs[n+1]; i++) {
+      int s = ids[i];
+      position += sample_weight[s]*samples[s];
+      radius += sample_weight[s]*sample_radius[s];
+      weight += sample_weight[s];
+      sample_cluster[s] = n;
+    }
+    node_position[n] = position / weight;
+    node_radius[n] = radius / weight;
+  }
+}
+
+// =======================================================================
+// 3. SKELETON GRAPH
+
+void AutoRigger::ConnectClusters() {
+  // quads that share a mesh edge connect their nodes.  as in
+  // Mesh::FindOpposites, the quads around each edge are found by
+  // sorting the (undirected) edge keys.
+  int num_quads = samples.size();
+  int vertex_bits = 1;
+  while (vertex_bits < 31 && (1 << vertex_bits) < mesh->numVertices()) vertex_bits++;
+  std::vector<unsigned long long> keys(4*num_quads);
+  std::vector<int> quads(4*num_quads);
+#pragma omp parallel for
+  for (int i = 0; i < num_quads; i++) {
+    Face *f = mesh->getOriginalQuad(i);
+    for (int j = 0; j < 4; j++) {
+      unsigned long long a = (*f)[j]->getIndex();
+      unsigned long long b = (*f)[(j+1)%4]->getIndex();
+      keys[4*i+j] = (std::min(a,b) << vertex_bits) | std::max(a,b);
+      quads[4*i+j] = i;
+    }
+  }
+  RadixSort(keys,quads,2*vertex_bits);
+
+  std::vector<unsigned long long> pairs;
+  for (int i = 0; i+1 < 4*num_quads; i++) {
+    if (keys[i] != keys[i+1]) continue;
+    int a = sample_cluster[quads[i]];
+    int b = sample_cluster[quads[i+1]];
+    if (a == -1 || b == -1 || a == b) continue;
+    pairs.push_back(((unsigned long long)std::min(a,b) << 32) | (unsigned long long)std::max(a,b));
+  }
+  std::sort(pairs.begin(),pairs.end());
+  pairs.erase(std::unique(pairs.begin(),pairs.end()),pairs.end());
+  graph_edges.resize(pairs.size());
+  for (unsigned int i = 0; i < pairs.size(); i++) {
+    graph_edges[i] = std::make_pair((int)(pairs[i] >> 32),(int)(pairs[i] & 0xffffffff));
+  }
+}
+
+static int FindSet(std::vector<int> &sets, int a) {
+  while (sets[a] != a) {
+    sets[a] = sets[sets[a]];
+    a = sets[a];
+  }
+  return a;
+}
+
+void AutoRigger::SpanningTree() {
+  // Kruskal: the shortest connections first, skipping any that close a loop
+  int num_nodes = node_position.size();
+  std::vector<float> lengths(graph_edges.size());
+  std::vector<int> order(graph_edges.size());
+  for (unsigned int i = 0; i < graph_edges.size(); i++) {
+    lengths[i] = glm::distance(node_position[graph_edges[i].first],node_position[graph_edges[i].second]);
+    order[i] = i;
+  }
+  std::sort(order.begin(),order.end(),[&lengths](int a, int b) {
+      return lengths[a] < lengths[b] || (lengths[a] == lengths[b] && a < b); });
+
+  std::vector<int> sets(num_nodes);
+  for (int i = 0; i < num_nodes; i++) sets[i] = i;
+  tree_adjacency.assign(num_nodes,std::vector<int>());
+  for (unsigned int i = 0; i < order.size(); i++) {
+    int a = graph_edges[order[i]].first;
+    int b = graph_edges[order[i]].second;
+    int set_a = FindSet(sets,a);
+    int set_b = FindSet(sets,b);
+    if (set_a == set_b) continue;
+    sets[set_a] = set_b;
+    tree_adjacency[a].push_back(b);
+    tree_adjacency[b].push_back(a);
+  }
+
+  // keep only the largest piece (e.g., drop separate eyeballs)
+  std::vector<float> piece_radius(num_nodes,0);
+  for (int i = 0; i < num_nodes; i++) {
+    piece_radius[FindSet(sets,i)] += node_radius[i];
+  }
+  int largest = std::max_element(piece_radius.begin(),piece_radius.end()) - piece_radius.begin();
+  node_alive.assign(num_nodes,0);
+  for (int i = 0; i < num_nodes; i++) {
+    node_alive[i] = (FindSet(sets,i) == largest);
+  }
+}
+
+void AutoRigger::PruneBranches(float min_length) {
+  int num_nodes = node_position.size();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int leaf = 0; leaf < num_nodes; leaf++) {
+      if (!node_alive[leaf] || tree_adjacency[leaf].size() != 1) continue;
+      // follow the chain to the branch point
+      std::vector<int> chain(1,leaf);
+      float length = 0;
+      int prev = -1;
+      int current = leaf;
+      while (tree_adjacency[current].size() <= 2) {
+        int next = (tree_adjacency[current][0] != prev) ? tree_adjacency[current][0] :
+          (tree_adjacency[current].size() == 2 ? tree_adjacency[current][1] : -1);
+        // a bare chain is the whole skeleton, keep it
+        if (next == -1) break;
+        length += glm::distance(node_position[current],node_position[next]);
+        prev = current;
+        current = next;
+        if (tree_adjacency[current].size() <= 2) chain.push_back(current);
+      }
+      if (tree_adjacency[current].size() <= 2) continue;
+      if (length >= std::max(min_length,node_radius[current])) continue;
+      // cut the branch off at the branch point
+      std::vector<int> &adjacent = tree_adjacency[current];
+      adjacent.erase(std::find(adjacent.begin(),adjacent.end(),chain.back()));
+      for (unsigned int i = 0; i < chain.size(); i++) {
+        node_alive[chain[i]] = 0;
+        tree_adjacency[chain[i]].clear();
+      }
+      changed = true;
+    }
+  }
+}
+
+// =======================================================================
+// 4. JOINTS
+
+// the skeleton node farthest (along the tree) from start, with the
+// distance to & the previous node on the way to every node
+int AutoRigger::FarthestNode(int start, std::vector<float> &distance, std::vector<int> &previous) const {
+  distance.assign(node_position.size(),-1);
+  previous.assign(node_position.size(),-1);
+  std::vector<int> todo(1,start);
+  distance[start] = 0;
+  int farthest = start;
+  while (!todo.empty()) {
+    int node = todo.back();
+    todo.pop_back();
+    if (distance[node] > distance[farthest]) farthest = node;
+    for (unsigned int i = 0; i < tree_adjacency[node].size(); i++) {
+      int next = tree_adjacency[node][i];
+      if (distance[next] >= 0) continue;
+      distance[next] = distance[node] + glm::distance(node_position[node],node_position[next]);
+      previous[next] = node;
+      todo.push_back(next);
+    }
+  }
+  return farthest;
+}
+
+int AutoRigger::PlaceJoints(JointTree *tree, float spacing) {
+  tree->clearJoints();
+  int any = std::find(node_alive.begin(),node_alive.end(),1) - node_alive.begin();
+  if (any == (int)node_alive.size()) return 0;
+
+  // the root is the middle of the longest path through the skeleton
+  // (e.g., hand to foot, so the chest of a biped)
+  std::vector<float> distance;
+  std::vector<int> previous;
+  int end = FarthestNode(any,distance,previous);
+  int other_end = FarthestNode(end,distance,previous);
+  int root = other_end;
+  while (previous[root] != -1 && distance[previous[root]] >= 0.5f*distance[other_end]) {
+    root = previous[root];
+  }
+
+  // walk out from the root, a joint at every branch point & tip, and
+  // along the chains every time the distance since the last joint
+  // reaches the spacing
+  struct Step { int node; int from; int joint; float length; };
+  std::vector<Step> todo;
+  Joint root_joint(0,node_position[root]);
+  Step first = { root, -1, tree->addJoint(root_joint), 0 };
+  todo.push_back(first);
+  while (!todo.empty()) {
+    Step step = todo.back();
+    todo.pop_back();
+    const std::vector<int> &adjacent = tree_adjacency[step.node];
+    for (unsigned int i = 0; i < adjacent.size(); i++) {
+      int next = adjacent[i];
+      if (next == step.from) continue;
+      Step child = { next, step.node, step.joint,
+                     step.length + glm::distance(node_position[step.node],node_position[next]) };
+      if (tree_adjacency[next].size() != 2 || child.length >= spacing) {
+        Joint j(tree->size(),node_position[next]);
+        child.joint = tree->addJoint(j);
+        tree->parent(child.joint,step.joint);
+        child.length = 0;
+      }
+      todo.push_back(child);
+    }
+  }
+  return tree->size();
+}
@@ -0,0 +1,67 @@
+#ifndef _AUTO_RIGGER_H_
+#define _AUTO_RIGGER_H_
+
+#include <vector>
+#include <glm/glm.hpp>
+
+class Mesh;
+class ArgParser;
+class JointTree;
+
+// ==================================================================
+// Builds a rig without any clicks from an approximate curve skeleton
+// of the mesh:
+//   1. a ray is cast inward from the middle of every quad, the
+//      midpoint of the inside segment is a sample of the medial axis
+//      (the same midpoint TraceRay uses for a placed joint)
+//   2. the samples are clustered on a grid, one node per occupied cell
+//   3. nodes whose quads share a mesh edge are connected, and the
+//      minimum spanning tree of that graph is the skeleton
+//   4. short side branches are pruned, and the skeleton is walked
+//      from its middle to place joints at the branch points, the
+//      tips, and evenly along the chains in between
+// The ray casts, clustering & graph construction run in parallel.
+
+class AutoRigger {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  AutoRigger(Mesh *_mesh, ArgParser *_args) : mesh(_mesh), args(_args) {}
+
+  // replaces the joints of the tree, returns the number of joints
+  int Rig(JointTree *tree);
+
+ private:
+
+  // HELPER FUNCTIONS
+  void SampleMedialAxis();
+  void ClusterSamples(float cell_size);
+  void ConnectClusters();
+  void SpanningTree();
+  void PruneBranches(float min_length);
+  int FarthestNode(int start, std::vector<float> &distance, std::vector<int> &previous) const;
+  int PlaceJoints(JointTree *tree, float spacing);
+
+  // REPRESENTATION
+  Mesh *mesh;
+  ArgParser *args;
+
+  // per original quad: its medial sample (if the inward ray hit)
+  std::vector<glm::vec3> samples;
+  std::vector<float> sample_radius;
+  std::vector<float> sample_weight;
+  std::vector<int> sample_cluster;
+
+  // the skeleton nodes: the weighted average of their samples
+  std::vector<glm::vec3> node_position;
+  std::vector<float> node_radius;
+  // nodes in the skeleton (not pruned, & in its largest piece)
+  std::vector<char> node_alive;
+  // candidate connections (node pairs) & the spanning tree adjacency
+  std::vector<std::pair<int,int> > graph_edges;
+  std::vector<std::vector<int> > tree_adjacency;
+};
+
+#endif
@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+
+#include "bvh.h"
+#include "face.h"
+#include "geometrycache.h"
+#include "ray.h"
+#include "hit.h"
+#include "utils.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_USE_SSE 1
+#endif
+
+#define MAX_FACES_PER_LEAF 8
+#define MAX_BVH_DEPTH 64
+#define NUM_SAH_BINS 16
+// relative cost of visiting a node vs. intersecting one face
+#define SAH_TRAVERSAL_COST 1.0f
+// subtrees smaller than this are built serially by one task
+#define PARALLEL_BUILD_THRESHOLD 4096
+// the packed quad test is looser than Face::triangle_intersect &
+// Face::plane_intersect so it never rejects a quad they would accept
+#define PACKED_DET_EPSILON 1e-8f
+#define PACKED_BARY_EPSILON 1e-4f
+#define PACKED_DENOM_EPSILON 1e-6f
+// for nearly edge-on triangles the barycentric coordinates are badly
+// conditioned, so the tolerance also grows with this rounding bound
+// times the magnitudes involved divided by the determinant
+#define PACKED_ROUNDING_EPSILON 1e-6f
+
+// ==================================================================
+// CONSTRUCTION
+// ==================================================================
+
+void BVH::Build(const std::vector<Face*> &_faces, const GeometryCache &_geometry) {
+  faces = _faces;
+  geometry = &_geometry;
+  nodes.clear();
+  face_order.clear();
+  int num_faces = faces.size();
+  if (num_faces == 0) return;
+
+  face_min.resize(num_faces);
+  face_max.resize(num_faces);
+  face_centroid.resize(num_faces);
+  face_order.resize(num_faces);
+  ComputeFaceSlots();
+  ComputeFaceBounds();
+#pragma omp parallel for if (num_faces > PARALLEL_BUILD_THRESHOLD)
+  for (int i = 0; i < num_faces; i++) {
+    face_centroid[i] = geometry->getCentroid(face_slots[i]);
+    face_order[i] = i;
+  }
+
+  // a binary tree with leaves of at least one face has < 2n nodes,
+  // the nodes are handed out to the build tasks from this pool
+  nodes.resize(2*num_faces);
+  num_nodes = 1;
+#pragma omp parallel if (num_faces > PARALLEL_BUILD_THRESHOLD)
+  {
+#pragma omp single nowait
+    BuildRecursive(0,0,num_faces,0);
+  }
+  nodes.resize(num_nodes);
+
+  // the centroids are only needed while building (the bounds are kept
+  // for refitting)
+  face_centroid.clear();
+  ComputePackedQuads();
+}
+
+
+void BVH::ComputeFaceSlots() {
+  int num_faces = faces.size();
+  face_slots.resize(num_faces);
+  for (int i = 0; i < num_faces; i++) {
+    face_slots[i] = faces[i]->getGeometryIndex();
+    assert (face_slots[i] >= 0);
+  }
+}
+
+
+void BVH::ComputeFaceBounds() {
+  int num_faces = faces.size();
+  const float *x = geometry->getX();
+  const float *y = geometry->getY();
+  const float *z = geometry->getZ();
+#pragma omp parallel for if (num_faces > PARALLEL_BUILD_THRESHOLD)
+  for (int i = 0; i < num_faces; i++) {
+    const int *v = geometry->getQuadVertices(face_slots[i]);
+    glm::vec3 mn(x[v[0]],y[v[0]],z[v[0]]);
+    glm::vec3 mx = mn;
+    for (int j = 1; j < 4; j++) {
+      glm::vec3 p(x[v[j]],y[v[j]],z[v[j]]);
+      mn = glm::min(mn,p);
+      mx = glm::max(mx,p);
+    }
+    // the barycentric test in Face::triangle_intersect is slightly
+    // tolerant, so pad the box to never miss a face it would accept
+    glm::vec3 extent = mx-mn;
+    float pad = 0.001f * std::max(extent.x,std::max(extent.y,extent.z)) + EPSILON;
+    face_min[i] = mn - glm::vec3(pad,pad,pad);
+    face_max[i] = mx + glm::vec3(pad,pad,pad);
+  }
+}
+
+
+bool BVH::ComputePackedQuads() {
+  int num_faces = faces.size();
+  // pad so a group of 4 can always be loaded past the last quad
+  bool changed = false;
+  if ((int)packed_quads.size() != NUM_QUAD_FIELDS*(num_faces+3)) {
+    packed_stride = num_faces+3;
+    packed_quads.assign(NUM_QUAD_FIELDS*packed_stride,0.0f);
+    changed = true;
+  }
+  float *q = &packed_quads[0];
+  const float *x = geometry->getX();
+  const float *y = geometry->getY();
+  const float *z = geometry->getZ();
+#pragma omp parallel for reduction(||:changed) if (num_faces > PARALLEL_BUILD_THRESHOLD)
+  for (int i = 0; i < num_faces; i++) {
+    const int *v = geometry->getQuadVertices(face_slots[face_order[i]]);
+    glm::vec3 a(x[v[0]],y[v[0]],z[v[0]]);
+    glm::vec3 pb(x[v[1]],y[v[1]],z[v[1]]);
+    glm::vec3 pc(x[v[2]],y[v[2]],z[v[2]]);
+    glm::vec3 pd(x[v[3]],y[v[3]],z[v[3]]);
+    glm::vec3 b = pb - a;
+    glm::vec3 c = pc - a;
+    glm::vec3 d = pd - a;
+    // (as GeometryCache::computeQuad, but from the current positions in
+    // case they moved since the quad was added)
+    glm::vec3 normal = 0.5f * (computeNormal(a,pb,pc) + computeNormal(a,pc,pd));
+    float fields[NUM_QUAD_FIELDS] = { a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z, d.x, d.y, d.z,
+                                      normal.x, normal.y, normal.z, glm::dot(normal,a) };
+    for (int k = 0; k < NUM_QUAD_FIELDS; k++) {
+      if (q[k*packed_stride+i] != fields[k]) {
+        q[k*packed_stride+i] = fields[k];
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+
+void BVH::ComputeNodeBounds(BVHNode &n, int start, int end) const {
+  n.min = face_min[face_order[start]];
+  n.max = face_max[face_order[start]];
+  n.min_face = n.max_face = face_order[start];
+  for (int i = start+1; i < end; i++) {
+    int f = face_order[i];
+    n.min = glm::min(n.min,face_min[f]);
+    n.max = glm::max(n.max,face_max[f]);
+    n.min_face = std::min(n.min_face,f);
+    n.max_face = std::max(n.max_face,f);
+  }
+}
+
+
+inline float HalfSurfaceArea(const glm::vec3 &mn, const glm::vec3 &mx) {
+  glm::vec3 d = mx-mn;
+  return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+
+void BVH::BuildRecursive(int node, int start, int end, int level) {
+  BVHNode &n = nodes[node];
+  ComputeNodeBounds(n,start,end);
+  int count = end-start;
+  n.start = start;
+  n.count = count;
+  if (count <= 2 || level >= MAX_BVH_DEPTH) return;
+
+  // bin the face centroids along each axis of the centroid bounds
+  glm::vec3 cmin = face_centroid[face_order[start]];
+  glm::vec3 cmax = cmin;
+  for (int i = start+1; i < end; i++) {
+    cmin = glm::min(cmin,face_centroid[face_order[i]]);
+    cmax = glm::max(cmax,face_centroid[face_order[i]]);
+  }
+
+  int best_axis = -1;
+  int best_split = -1;
+  float best_cost = FLT_MAX;
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = cmax[axis]-cmin[axis];
+    if (extent <= 0) continue;
+    float scale = NUM_SAH_BINS / extent;
+    int bin_count[NUM_SAH_BINS] = { 0 };
+    glm::vec3 bin_min[NUM_SAH_BINS];
+    glm::vec3 bin_max[NUM_SAH_BINS];
+    for (int b = 0; b < NUM_SAH_BINS; b++) {
+      bin_min[b] = glm::vec3(FLT_MAX,FLT_MAX,FLT_MAX);
+      bin_max[b] = glm::vec3(-FLT_MAX,-FLT_MAX,-FLT_MAX);
+    }
+    for (int i = start; i < end; i++) {
+      int f = face_order[i];
+      int b = std::min(NUM_SAH_BINS-1,int((face_centroid[f][axis]-cmin[axis])*scale));
+      bin_count[b]++;
+      bin_min[b] = glm::min(bin_min[b],face_min[f]);
+      bin_max[b] = glm::max(bin_max[b],face_max[f]);
+    }
+    // sweep from the right to get the cost of every right hand side...
+    float right_area[NUM_SAH_BINS];
+    int right_count[NUM_SAH_BINS];
+    glm::vec3 mn(FLT_MAX,FLT_MAX,FLT_MAX);
+    glm::vec3 mx(-FLT_MAX,-FLT_MAX,-FLT_MAX);
+    int num = 0;
+    for (int b = NUM_SAH_BINS-1; b > 0; b--) {
+      mn = glm::min(mn,bin_min[b]);
+      mx = glm::max(mx,bin_max[b]);
+      num += bin_count[b];
+      right_count[b] = num;
+      right_area[b] = num > 0 ? HalfSurfaceArea(mn,mx) : 0;
+    }
+    // ...then from the left, splitting between bins b-1 and b
+    mn = glm::vec3(FLT_MAX,FLT_MAX,FLT_MAX);
+    mx = glm::vec3(-FLT_MAX,-FLT_MAX,-FLT_MAX);
+    num = 0;
+    for (int b = 1; b < NUM_SAH_BINS; b++) {
+      mn = glm::min(mn,bin_min[b-1]);
+      mx = glm::max(mx,bin_max[b-1]);
+      num += bin_count[b-1];
+      if (num == 0 || right_count[b] == 0) continue;
+      float cost = num*HalfSurfaceArea(mn,mx) + right_count[b]*right_area[b];
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = b;
+      }
+    }
+  }
+
+  // compare against the cost of leaving this node as a leaf
+  float leaf_cost = count;
+  float split_cost = SAH_TRAVERSAL_COST + best_cost / HalfSurfaceArea(n.min,n.max);
+  if (best_axis == -1 || (split_cost >= leaf_cost && count <= MAX_FACES_PER_LEAF)) return;
+
+  int mid;
+  {
+    const std::vector<glm::vec3> &centroids = face_centroid;
+    float lo = cmin[best_axis];
+    float scale = NUM_SAH_BINS / (cmax[best_axis]-lo);
+    int axis = best_axis;
+    int split = best_split;
+    mid = std::partition(face_order.begin()+start, face_order.begin()+end,
+                         [&centroids,axis,lo,scale,split](int f) {
+                           return std::min(NUM_SAH_BINS-1,int((centroids[f][axis]-lo)*scale)) < split; })
+      - face_order.begin();
+  }
+  assert (mid > start && mid < end);
+
+  // the children are stored next to each other, after their parent
+  int left;
+#pragma omp atomic capture
+  { left = num_nodes; num_nodes += 2; }
+  n.start = left;
+  n.count = 0;
+
+  if (count > PARALLEL_BUILD_THRESHOLD) {
+#pragma omp task
+    BuildRecursive(left,start,mid,level+1);
+    BuildRecursive(left+1,mid,end,level+1);
+#pragma omp taskwait
+  } else {
+    BuildRecursive(left,start,mid,level+1);
+    BuildRecursive(left+1,mid,end,level+1);
+  }
+}
+
+// ==================================================================
+// REFIT
+// ==================================================================
+
+void BVH::Refit() {
+  if (nodes.empty()) return;
+  // the faces & the tree stay the same, only the boxes are recomputed
+  // (& not even those if no vertex of the faces moved)
+  if (!ComputePackedQuads()) return;
+  ComputeFaceBounds();
+  // children are always stored after their parent, so a reverse
+  // sweep visits every node after both of its children
+  for (int i = nodes.size()-1; i >= 0; i--) {
+    BVHNode &n = nodes[i];
+    if (n.count > 0) {
+      ComputeNodeBounds(n,n.start,n.start+n.count);
+    } else {
+      const BVHNode &a = nodes[n.start];
+      const BVHNode &b = nodes[n.start+1];
+      n.min = glm::min(a.min,b.min);
+      n.max = glm::max(a.max,b.max);
+    }
+  }
+}
+
+// ==================================================================
+// SERIALIZATION
+// ==================================================================
+
+void BVH::Write(std::vector<char> &out) const {
+  int header[3] = { (int)faces.size(), (int)nodes.size(), (int)sizeof(BVHNode) };
+  out.insert(out.end(),(const char*)header,(const char*)(header+3));
+  if (nodes.empty()) return;
+  out.insert(out.end(),(const char*)&nodes[0],(const char*)(&nodes[0]+nodes.size()));
+  out.insert(out.end(),(const char*)&face_order[0],(const char*)(&face_order[0]+face_order.size()));
+}
+
+bool BVH::Read(const std::vector<Face*> &_faces, const GeometryCache &_geometry, const char *&p, const char *end) {
+  int header[3];
+  if (end-p < (long)sizeof(header)) return false;
+  memcpy(header,p,sizeof(header));
+  int num_faces = header[0];
+  int num_stored_nodes = header[1];
+  if (num_faces != (int)_faces.size() || header[2] != (int)sizeof(BVHNode)) return false;
+  if ((num_faces == 0) != (num_stored_nodes == 0) || num_stored_nodes < 0 || num_stored_nodes >= 2*num_faces+1) return false;
+  size_t bytes = sizeof(header) + num_stored_nodes*sizeof(BVHNode) + num_faces*sizeof(int);
+  if ((size_t)(end-p) < bytes) return false;
+  p += sizeof(header);
+  faces = _faces;
+  geometry = &_geometry;
+  nodes.resize(num_stored_nodes);
+  face_order.resize(num_faces);
+  if (num_faces == 0) return true;
+  memcpy(&nodes[0],p,num_stored_nodes*sizeof(BVHNode));
+  p += num_stored_nodes*sizeof(BVHNode);
+  memcpy(&face_order[0],p,num_faces*sizeof(int));
+  p += num_faces*sizeof(int);
+  num_nodes = num_stored_nodes;
+  // don't trust the file: every index must be in range, children must
+  // follow their parent & the depth must fit the traversal stack
+  std::vector<int> depth(num_nodes,0);
+  for (int i = 0; i < num_nodes; i++) {
+    const BVHNode &n = nodes[i];
+    bool ok = n.min_face >= 0 && n.max_face < num_faces && n.min_face <= n.max_face;
+    if (n.count > 0) {
+      ok = ok && n.start >= 0 && n.start+n.count <= num_faces;
+    } else {
+      ok = ok && n.start > i && n.start+1 < num_nodes && depth[i] < MAX_BVH_DEPTH;
+      if (ok) depth[n.start] = depth[n.start+1] = depth[i]+1;
+    }
+    if (!ok) { nodes.clear(); return false; }
+  }
+  for (int i = 0; i < num_faces; i++) {
+    if (face_order[i] < 0 || face_order[i] >= num_faces) { nodes.clear(); return false; }
+  }
+  ComputeFaceSlots();
+  // the per face bounds (for refitting) are cheap to recompute
+  face_min.resize(num_faces);
+  face_max.resize(num_faces);
+  ComputeFaceBounds();
+  ComputePackedQuads();
+  return true;
+}
+
+// ==================================================================
+// RAYTRACING
+// ==================================================================
+
+bool BVH::IntersectNode(const BVHNode &n, const glm::vec3 &origin, const glm::vec3 &inv_dir) const {
+  // slab test against the whole line (not just t > 0), since the hit
+  // is accepted by the plane t of the quad, not the triangle t
+  float tmin = -FLT_MAX;
+  float tmax = FLT_MAX;
+  for (int axis = 0; axis < 3; axis++) {
+    if (std::isinf(inv_dir[axis])) {
+      // ray is parallel to this slab
+      if (origin[axis] < n.min[axis] || origin[axis] > n.max[axis]) return false;
+      continue;
+    }
+    float t1 = (n.min[axis]-origin[axis]) * inv_dir[axis];
+    float t2 = (n.max[axis]-origin[axis]) * inv_dir[axis];
+    tmin = std::max(tmin,std::min(t1,t2));
+    tmax = std::min(tmax,std::max(t1,t2));
+    if (tmin > tmax) return false;
+  }
+  return true;
+}
+
+
+// scalar version of the packed quad test, for a single quad
+inline bool CandidateQuad(const float *q, int stride, int i,
+                          const glm::vec3 &o, const glm::vec3 &dir, bool intersect_backfacing) {
+  glm::vec3 a(q[0*stride+i],q[1*stride+i],q[2*stride+i]);
+  glm::vec3 b(q[3*stride+i],q[4*stride+i],q[5*stride+i]);
+  glm::vec3 c(q[6*stride+i],q[7*stride+i],q[8*stride+i]);
+  glm::vec3 d(q[9*stride+i],q[10*stride+i],q[11*stride+i]);
+  glm::vec3 normal(q[12*stride+i],q[13*stride+i],q[14*stride+i]);
+  // plane of the quad
+  float denom = glm::dot(dir,normal);
+  if (!intersect_backfacing && denom >= PACKED_DENOM_EPSILON) return false;
+  if (!((q[15*stride+i] - glm::dot(o,normal)) / denom > 0.5f*EPSILON)) return false;
+  // the two triangles (a,b,c) & (a,c,d)
+  glm::vec3 tvec = o-a;
+  float scale = PACKED_ROUNDING_EPSILON *
+    (fabs(o.x)+fabs(o.y)+fabs(o.z) + fabs(tvec.x)+fabs(tvec.y)+fabs(tvec.z)) *
+    (fabs(dir.x)+fabs(dir.y)+fabs(dir.z));
+  for (int tri = 0; tri < 2; tri++) {
+    const glm::vec3 &e1 = (tri == 0) ? b : c;
+    const glm::vec3 &e2 = (tri == 0) ? c : d;
+    glm::vec3 pvec = glm::cross(dir,e2);
+    float det = glm::dot(e1,pvec);
+    if (fabs(det) <= PACKED_DET_EPSILON) continue;
+    float u = glm::dot(tvec,pvec) / det;
+    float v = glm::dot(dir,glm::cross(tvec,e1)) / det;
+    float tol = PACKED_BARY_EPSILON + scale *
+      (fabs(e1.x)+fabs(e1.y)+fabs(e1.z) + fabs(e2.x)+fabs(e2.y)+fabs(e2.z)) / fabs(det);
+    if (u >= -tol && v >= -tol && u+v <= 1+2*tol) return true;
+  }
+  return false;
+}
+
+
+// test count (<= 4) packed quads starting at position start of
+// face_order, returns a bit mask of the quads that may be hit
+int BVH::CandidateQuads(int start, int count, const Ray &r, bool intersect_backfacing) const {
+  assert (count > 0 && count <= 4);
+  const float *q = &packed_quads[0];
+  const glm::vec3 &o = r.getOrigin();
+  const glm::vec3 &dir = r.getDirection();
+#ifdef BVH_USE_SSE
+#define LOAD_FIELD(field) _mm_loadu_ps(q + (field)*packed_stride + start)
+#define DOT3(ax,ay,az,bx,by,bz) _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax,bx),_mm_mul_ps(ay,by)),_mm_mul_ps(az,bz))
+#define CROSS_COMPONENT(ay,az,by,bz) _mm_sub_ps(_mm_mul_ps(ay,bz),_mm_mul_ps(az,by))
+#define ABS_SUM3(ax,ay,az) _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_bit,ax),_mm_andnot_ps(sign_bit,ay)),_mm_andnot_ps(sign_bit,az))
+  __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+  __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+  __m128 one = _mm_set1_ps(1);
+  __m128 bary_eps = _mm_set1_ps(PACKED_BARY_EPSILON);
+  __m128 det_eps = _mm_set1_ps(PACKED_DET_EPSILON);
+  __m128 sign_bit = _mm_set1_ps(-0.0f);
+
+  // plane of the quad
+  __m128 nx = LOAD_FIELD(QUAD_NX), ny = LOAD_FIELD(QUAD_NY), nz = LOAD_FIELD(QUAD_NZ);
+  __m128 denom = DOT3(dx,dy,dz,nx,ny,nz);
+  __m128 numer = _mm_sub_ps(LOAD_FIELD(QUAD_PD),DOT3(ox,oy,oz,nx,ny,nz));
+  __m128 mask = _mm_cmpgt_ps(_mm_div_ps(numer,denom),_mm_set1_ps(0.5f*EPSILON));
+  if (!intersect_backfacing)
+    mask = _mm_and_ps(mask,_mm_cmplt_ps(denom,_mm_set1_ps(PACKED_DENOM_EPSILON)));
+  if (_mm_movemask_ps(mask) == 0) return 0;
+
+  __m128 tx = _mm_sub_ps(ox,LOAD_FIELD(QUAD_AX));
+  __m128 ty = _mm_sub_ps(oy,LOAD_FIELD(QUAD_AY));
+  __m128 tz = _mm_sub_ps(oz,LOAD_FIELD(QUAD_AZ));
+  __m128 bx = LOAD_FIELD(QUAD_BX), by = LOAD_FIELD(QUAD_BY), bz = LOAD_FIELD(QUAD_BZ);
+  __m128 cx = LOAD_FIELD(QUAD_CX), cy = LOAD_FIELD(QUAD_CY), cz = LOAD_FIELD(QUAD_CZ);
+  __m128 ex = LOAD_FIELD(QUAD_DX), ey = LOAD_FIELD(QUAD_DY), ez = LOAD_FIELD(QUAD_DZ);
+  float dir_sum = fabs(dir.x)+fabs(dir.y)+fabs(dir.z);
+  __m128 scale = _mm_mul_ps(_mm_set1_ps(PACKED_ROUNDING_EPSILON*dir_sum),
+                            _mm_add_ps(_mm_set1_ps(fabs(o.x)+fabs(o.y)+fabs(o.z)),ABS_SUM3(tx,ty,tz)));
+  __m128 bsum = ABS_SUM3(bx,by,bz), csum = ABS_SUM3(cx,cy,cz), esum = ABS_SUM3(ex,ey,ez);
+
+  // Moller-Trumbore for triangle (a,b,c): e1 = b-a, e2 = c-a
+  __m128 px = CROSS_COMPONENT(dy,dz,cy,cz);
+  __m128 py = CROSS_COMPONENT(dz,dx,cz,cx);
+  __m128 pz = CROSS_COMPONENT(dx,dy,cx,cy);
+  __m128 det = DOT3(bx,by,bz,px,py,pz);
+  __m128 u = _mm_div_ps(DOT3(tx,ty,tz,px,py,pz),det);
+  __m128 qx = CROSS_COMPONENT(ty,tz,by,bz);
+  __m128 qy = CROSS_COMPONENT(tz,tx,bz,bx);
+  __m128 qz = CROSS_COMPONENT(tx,ty,bx,by);
+  __m128 v = _mm_div_ps(DOT3(dx,dy,dz,qx,qy,qz),det);
+  __m128 abs_det = _mm_andnot_ps(sign_bit,det);
+  __m128 tol = _mm_add_ps(bary_eps,_mm_div_ps(_mm_mul_ps(scale,_mm_add_ps(bsum,csum)),abs_det));
+  __m128 hit1 = _mm_cmpgt_ps(abs_det,det_eps);
+  hit1 = _mm_and_ps(hit1,_mm_cmpge_ps(u,_mm_xor_ps(tol,sign_bit)));
+  hit1 = _mm_and_ps(hit1,_mm_cmpge_ps(v,_mm_xor_ps(tol,sign_bit)));
+  hit1 = _mm_and_ps(hit1,_mm_cmple_ps(_mm_add_ps(u,v),_mm_add_ps(one,_mm_add_ps(tol,tol))));
+
+  // and for triangle (a,c,d): e1 = c-a, e2 = d-a
+  px = CROSS_COMPONENT(dy,dz,ey,ez);
+  py = CROSS_COMPONENT(dz,dx,ez,ex);
+  pz = CROSS_COMPONENT(dx,dy,ex,ey);
+  det = DOT3(cx,cy,cz,px,py,pz);
+  u = _mm_div_ps(DOT3(tx,ty,tz,px,py,pz),det);
+  qx = CROSS_COMPONENT(ty,tz,cy,cz);
+  qy = CROSS_COMPONENT(tz,tx,cz,cx);
+  qz = CROSS_COMPONENT(tx,ty,cx,cy);
+  v = _mm_div_ps(DOT3(dx,dy,dz,qx,qy,qz),det);
+  abs_det = _mm_andnot_ps(sign_bit,det);
+  tol = _mm_add_ps(bary_eps,_mm_div_ps(_mm_mul_ps(scale,_mm_add_ps(csum,esum)),abs_det));
+  __m128 hit2 = _mm_cmpgt_ps(abs_det,det_eps);
+  hit2 = _mm_and_ps(hit2,_mm_cmpge_ps(u,_mm_xor_ps(tol,sign_bit)));
+  hit2 = _mm_and_ps(hit2,_mm_cmpge_ps(v,_mm_xor_ps(tol,sign_bit)));
+  hit2 = _mm_and_ps(hit2,_mm_cmple_ps(_mm_add_ps(u,v),_mm_add_ps(one,_mm_add_ps(tol,tol))));
+
+  mask = _mm_and_ps(mask,_mm_or_ps(hit1,hit2));
+  return _mm_movemask_ps(mask) & ((1<<count)-1);
+#undef LOAD_FIELD
+#undef DOT3
+#undef CROSS_COMPONENT
+#undef ABS_SUM3
+#else
+  int mask = 0;
+  for (int i = 0; i < count; i++) {
+    if (CandidateQuad(q,packed_stride,start+i,o,dir,intersect_backfacing)) mask |= (1<<i);
+  }
+  return mask;
+#endif
+}
+
+
+bool BVH::Intersect(const Ray &r, Hit &h, bool intersect_backfacing) const {
+  if (nodes.empty()) return false;
+
+  const glm::vec3 &origin = r.getOrigin();
+  const glm::vec3 &dir = r.getDirection();
+  glm::vec3 inv_dir(1.0f/dir.x, 1.0f/dir.y, 1.0f/dir.z);
+
+  // the lowest & highest numbered faces hit so far
+  int first = -1;
+  int last = -1;
+
+  // explicitly store the stack of nodes that must be checked (rather
+  // than write a recursive function)
+  int todo[2*MAX_BVH_DEPTH+2];
+  int todo_size = 0;
+  todo[todo_size++] = 0;
+  while (todo_size > 0) {
+    const BVHNode &n = nodes[todo[--todo_size]];
+    // skip subtrees that can't change the first or last face hit
+    if (first != -1 && n.min_face >= first && n.max_face <= last) continue;
+    if (!IntersectNode(n,origin,inv_dir)) continue;
+    if (n.count > 0) {
+      for (int i = n.start; i < n.start+n.count; i += 4) {
+        int mask = CandidateQuads(i,std::min(4,n.start+n.count-i),r,intersect_backfacing);
+        for (int j = 0; mask != 0; j++, mask >>= 1) {
+          if (!(mask & 1)) continue;
+          int f = face_order[i+j];
+          if (first != -1 && f >= first && f <= last) continue;
+          // confirm with the exact test
+          Hit tmp;
+          if (!faces[f]->intersect(r,tmp,intersect_backfacing)) continue;
+          if (first == -1) {
+            first = last = f;
+          } else {
+            first = std::min(first,f);
+            last = std::max(last,f);
+          }
+        }
+      }
+    } else {
+      // visit the first child first
+      todo[todo_size++] = n.start+1;
+      todo[todo_size++] = n.start;
+    }
+  }
+
+  if (first == -1) return false;
+  // replay the linear scan: only the first and last hits survive in the Hit
+  bool answer = faces[first]->intersect(r,h,intersect_backfacing);
+  assert (answer);
+  if (last != first) {
+    answer = faces[last]->intersect(r,h,intersect_backfacing);
+    assert (answer);
+  }
+  return true;
+}
+
+int BVH::IntersectClosest(const Ray &r, float &t, bool intersect_backfacing) const {
+  if (nodes.empty()) return -1;
+
+  const glm::vec3 &origin = r.getOrigin();
+  const glm::vec3 &dir = r.getDirection();
+  glm::vec3 inv_dir(1.0f/dir.x, 1.0f/dir.y, 1.0f/dir.z);
+
+  // NOTE: the hit distance is the t of the quad's (average) plane,
+  // which for a non-planar quad can lie outside its box, so subtrees
+  // are not skipped by distance, only by missing the line
+  int closest = -1;
+  int todo[2*MAX_BVH_DEPTH+2];
+  int todo_size = 0;
+  todo[todo_size++] = 0;
+  while (todo_size > 0) {
+    const BVHNode &n = nodes[todo[--todo_size]];
+    if (!IntersectNode(n,origin,inv_dir)) continue;
+    if (n.count > 0) {
+      for (int i = n.start; i < n.start+n.count; i += 4) {
+        int mask = CandidateQuads(i,std::min(4,n.start+n.count-i),r,intersect_backfacing);
+        for (int j = 0; mask != 0; j++, mask >>= 1) {
+          if (!(mask & 1)) continue;
+          int f = face_order[i+j];
+          Hit tmp;
+          if (!faces[f]->intersect(r,tmp,intersect_backfacing)) continue;
+          float tf = tmp.getT(0);
+          // equally close faces go to the lowest number
+          if (closest == -1 || tf < t || (tf == t && f < closest)) {
+            closest = f;
+            t = tf;
+          }
+        }
+      }
+    } else {
+      todo[todo_size++] = n.start+1;
+      todo[todo_size++] = n.start;
+    }
+  }
+  return closest;
+}
+
+// ==================================================================
@@ -0,0 +1,121 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Face;
+class GeometryCache;
+class Ray;
+class Hit;
+
+// ==================================================================
+// A bounding volume hierarchy over a fixed list of quad faces.  This
+// data structure replaces the linear scan over every face in
+// RayTracer::CastRay.  The tree is built top down with the binned
+// surface area heuristic (SAH), large subtrees are built in parallel
+// as OpenMP tasks.  When the vertices move but the faces stay the
+// same, Refit recomputes the boxes bottom up without a rebuild.
+//
+// NOTE: the Hit class keeps the first hit in t0 and overwrites t1
+// with every later hit, in the order the faces are tested.  To give
+// exactly the same answer as the linear scan, the traversal finds the
+// lowest and highest numbered faces hit by the ray and applies only
+// those two (in order) to the hit record.
+//
+// The leaves are tested 4 quads at a time with an SSE Moller-Trumbore
+// kernel over a precomputed structure-of-arrays copy of the quads.
+// The kernel is slightly conservative; the few candidates it accepts
+// are confirmed with Face::intersect so the answer is unchanged.
+
+class BVH {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  BVH() : geometry(NULL), packed_stride(0) {}
+
+  // =========
+  // ACCESSORS
+  int numFaces() const { return faces.size(); }
+  int numNodes() const { return nodes.size(); }
+
+  // =========
+  // MODIFIERS
+  // (re)build the hierarchy, the face order defines the hit semantics.
+  // the bounds & packed quads are read from the mesh's geometry mirror
+  void Build(const std::vector<Face*> &_faces, const GeometryCache &_geometry);
+  // recompute the boxes after the vertices of the faces have moved in
+  // the geometry mirror (nothing is done if none did)
+  void Refit();
+
+  // =============
+  // SERIALIZATION
+  // append the tree to a binary mesh cache
+  void Write(std::vector<char> &out) const;
+  // restore a tree written by Write over the same faces (in the same
+  // order), p is advanced past it.  returns false if it doesn't match
+  bool Read(const std::vector<Face*> &_faces, const GeometryCache &_geometry, const char *&p, const char *end);
+
+  // ==========
+  // RAYTRACING
+  bool Intersect(const Ray &r, Hit &h, bool intersect_backfacing) const;
+  // the nearest face hit by the ray (the one with the smallest t, not
+  // the Hit semantics above), -1 if none.  t is set to its distance.
+  int IntersectClosest(const Ray &r, float &t, bool intersect_backfacing) const;
+
+ private:
+
+  // a node is a leaf if count > 0, otherwise its children are
+  // stored at nodes[start] and nodes[start+1]
+  struct BVHNode {
+    glm::vec3 min;
+    glm::vec3 max;
+    int start;
+    int count;
+    // the range of face numbers stored in this subtree
+    int min_face;
+    int max_face;
+  };
+
+  // the fields of the packed quads (one array of each per BVH)
+  enum QUAD_FIELD { QUAD_AX, QUAD_AY, QUAD_AZ,
+                    QUAD_BX, QUAD_BY, QUAD_BZ,   // b-a
+                    QUAD_CX, QUAD_CY, QUAD_CZ,   // c-a
+                    QUAD_DX, QUAD_DY, QUAD_DZ,   // d-a
+                    QUAD_NX, QUAD_NY, QUAD_NZ,   // face normal
+                    QUAD_PD,                     // plane distance
+                    NUM_QUAD_FIELDS };
+
+  // HELPER FUNCTIONS
+  void BuildRecursive(int node, int start, int end, int level);
+  void ComputeFaceSlots();
+  void ComputeFaceBounds();
+  // returns true if any of the packed quads changed
+  bool ComputePackedQuads();
+  int CandidateQuads(int start, int count, const Ray &r, bool intersect_backfacing) const;
+  void ComputeNodeBounds(BVHNode &n, int start, int end) const;
+  bool IntersectNode(const BVHNode &n, const glm::vec3 &origin, const glm::vec3 &inv_dir) const;
+
+  // REPRESENTATION
+  std::vector<Face*> faces;
+  const GeometryCache *geometry;
+  // the geometry mirror slot of each face
+  std::vector<int> face_slots;
+  std::vector<BVHNode> nodes;
+  // face numbers, reordered so every leaf owns a contiguous range
+  std::vector<int> face_order;
+  // number of nodes handed out so far by the build tasks
+  int num_nodes;
+  // the quads packed in face_order, field k of quad i is at
+  // packed_quads[k*packed_stride + i]
+  std::vector<float> packed_quads;
+  int packed_stride;
+  // per face bounds (kept for refitting) & centroids (only used while building)
+  std::vector<glm::vec3> face_min;
+  std::vector<glm::vec3> face_max;
+  std::vector<glm::vec3> face_centroid;
+};
+
+#endif
@@ -5,6 +5,7 @@
 // =========================================================================
 
 float Face::getArea() const {
+  if (geometry != NULL) return geometry->getArea(geometry_index);
   glm::vec3 a = (*this)[0]->get();
   glm::vec3 b = (*this)[1]->get();
   glm::vec3 c = (*this)[2]->get();
@@ -140,6 +141,7 @@ inline glm::vec3 ComputeNormal(const glm::vec3 &p1, const glm::vec3 &p2, const g
 }
 
 glm::vec3 Face::computeNormal() const {
+  if (geometry != NULL) return geometry->getNormal(geometry_index);
   // note: this face might be non-planar, so average the two triangle normals
   glm::vec3 a = (*this)[0]->get();
   glm::vec3 b = (*this)[1]->get();
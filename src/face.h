@@ -5,6 +5,7 @@
 #include "ray.h"
 #include "vertex.h"
 #include "hit.h"
+#include "geometrycache.h"
 
 class Material;
 
@@ -19,6 +20,8 @@ public:
   // CONSTRUCTOR & DESTRUCTOR
   Face(Material *m) {
     edge = NULL;
+    geometry = NULL;
+    geometry_index = -1;
     material = m; }
 
   // =========
@@ -37,6 +40,7 @@ public:
     return edge; 
   }
   glm::vec3 computeCentroid() const {
+    if (geometry != NULL) return geometry->getCentroid(geometry_index);
     return 0.25f * ((*this)[0]->get() +
                     (*this)[1]->get() +
                     (*this)[2]->get() +
@@ -46,6 +50,8 @@ public:
   float getArea() const;
   glm::vec3 RandomPoint() const;
   glm::vec3 computeNormal() const;
+  // the slot of this face in the mesh's flat geometry mirror (or -1)
+  int getGeometryIndex() const { return geometry_index; }
 
   // =========
   // MODIFIERS
@@ -54,6 +60,11 @@ public:
     assert (e != NULL);
     edge = e;
   }
+  // once set, the normal, area & centroid are read from the cache
+  void setGeometryCache(const GeometryCache *g, int i) {
+    geometry = g;
+    geometry_index = i;
+  }
 
   // ==========
   // RAYTRACING
@@ -76,6 +87,9 @@ protected:
   // ==============
   // REPRESENTATION
   Edge *edge;
+  // the precomputed normal, area & centroid (owned by the Mesh)
+  const GeometryCache *geometry;
+  int geometry_index;
   // NOTE: If you want to modify a face, remove it from the mesh,
   // delete it, create a new copy with the changes, and re-add it.
   // This will ensure the edges get updated appropriately.
@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include "geometrycache.h"
+#include "utils.h"
+
+// ==================================================================
+// VERTICES
+// ==================================================================
+
+void GeometryCache::resizeVertices(int n) {
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+}
+
+void GeometryCache::setVertex(int v, const glm::vec3 &pos) {
+  assert (v >= 0);
+  if (v >= numVertices()) {
+    // grow geometrically, the vertices are usually added one at a time
+    int n = std::max(v+1,2*numVertices());
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+    resizeVertices(v+1);
+  }
+  x[v] = pos.x;
+  y[v] = pos.y;
+  z[v] = pos.z;
+}
+
+// ==================================================================
+// QUADS
+// ==================================================================
+
+int GeometryCache::addQuad(int a, int b, int c, int d) {
+  assert (a >= 0 && a < numVertices());
+  assert (b >= 0 && b < numVertices());
+  assert (c >= 0 && c < numVertices());
+  assert (d >= 0 && d < numVertices());
+  int q;
+  if (!free_quads.empty()) {
+    q = free_quads.back();
+    free_quads.pop_back();
+  } else {
+    q = numQuadSlots();
+    quad_verts.resize(4*(q+1));
+    normals.resize(q+1);
+    centroids.resize(q+1);
+    areas.resize(q+1);
+  }
+  quad_verts[4*q+0] = a;
+  quad_verts[4*q+1] = b;
+  quad_verts[4*q+2] = c;
+  quad_verts[4*q+3] = d;
+  computeQuad(q);
+  return q;
+}
+
+void GeometryCache::addQuads(const int *quads, int n, int *slots) {
+  // the free slots in order (so a level replaced in bulk keeps its
+  // layout), then new slots at the end
+  int reused = std::min(n,(int)free_quads.size());
+  std::sort(free_quads.end()-reused,free_quads.end());
+  std::copy(free_quads.end()-reused,free_quads.end(),slots);
+  free_quads.resize(free_quads.size()-reused);
+  int first = numQuadSlots();
+  quad_verts.resize(4*(first+n-reused));
+  normals.resize(first+n-reused);
+  centroids.resize(first+n-reused);
+  areas.resize(first+n-reused);
+  for (int i = reused; i < n; i++) slots[i] = first+i-reused;
+#pragma omp parallel for if (n > 4096)
+  for (int i = 0; i < n; i++) {
+    int q = slots[i];
+    for (int j = 0; j < 4; j++) {
+      assert (quads[4*i+j] >= 0 && quads[4*i+j] < numVertices());
+      quad_verts[4*q+j] = quads[4*i+j];
+    }
+    computeQuad(q);
+  }
+}
+
+void GeometryCache::removeQuad(int q) {
+  assert (isActiveQuad(q));
+  for (int i = 0; i < 4; i++) quad_verts[4*q+i] = -1;
+  free_quads.push_back(q);
+}
+
+void GeometryCache::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  quad_verts.clear();
+  normals.clear();
+  centroids.clear();
+  areas.clear();
+  free_quads.clear();
+}
+
+void GeometryCache::computeQuad(int q) {
+  glm::vec3 a = getPosition(quad_verts[4*q+0]);
+  glm::vec3 b = getPosition(quad_verts[4*q+1]);
+  glm::vec3 c = getPosition(quad_verts[4*q+2]);
+  glm::vec3 d = getPosition(quad_verts[4*q+3]);
+  // note: the quad might be non-planar, so average the two triangle normals
+  normals[q] = 0.5f * (computeNormal(a,b,c) + computeNormal(a,c,d));
+  centroids[q] = 0.25f * (a + b + c + d);
+  areas[q] =
+    AreaOfTriangle(DistanceBetweenTwoPoints(a,b),
+                   DistanceBetweenTwoPoints(a,c),
+                   DistanceBetweenTwoPoints(b,c)) +
+    AreaOfTriangle(DistanceBetweenTwoPoints(c,d),
+                   DistanceBetweenTwoPoints(a,d),
+                   DistanceBetweenTwoPoints(a,c));
+}
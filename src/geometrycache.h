@@ -0,0 +1,80 @@
+#ifndef _GEOMETRY_CACHE_H_
+#define _GEOMETRY_CACHE_H_
+
+#include <cassert>
+#include <vector>
+#include <glm/glm.hpp>
+
+// ==================================================================
+// A compact, read only mirror of the mesh geometry for the hot paths
+// (ray tracing, radiosity & VBO setup).  Walking the half-edges of a
+// face and dereferencing each Vertex is slow on large meshes, so the
+// Mesh keeps the vertex positions in flat x[], y[], z[] arrays, the 4
+// vertex indices of every quad, and the normal, area & centroid of
+// every quad, computed once when the face is added.
+//
+// Quads are stored in slots.  When a face is removed its slot goes on
+// a free list and is reused by the next faces added (one at a time or
+// in bulk), so when subdivision replaces a level the new quads fill
+// the slots of the old ones before the mirror grows.
+
+class GeometryCache {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  GeometryCache() {}
+
+  // =========
+  // ACCESSORS
+  int numVertices() const { return x.size(); }
+  // includes the free slots, check isActiveQuad
+  int numQuadSlots() const { return areas.size(); }
+  const float* getX() const { return x.empty() ? NULL : &x[0]; }
+  const float* getY() const { return y.empty() ? NULL : &y[0]; }
+  const float* getZ() const { return z.empty() ? NULL : &z[0]; }
+  glm::vec3 getPosition(int v) const {
+    assert (v >= 0 && v < numVertices());
+    return glm::vec3(x[v],y[v],z[v]); }
+  bool isActiveQuad(int q) const {
+    assert (q >= 0 && q < numQuadSlots());
+    return quad_verts[4*q] >= 0; }
+  // the 4 vertex indices of the quad
+  const int* getQuadVertices(int q) const {
+    assert (isActiveQuad(q));
+    return &quad_verts[4*q]; }
+  const glm::vec3& getNormal(int q) const { assert (isActiveQuad(q)); return normals[q]; }
+  const glm::vec3& getCentroid(int q) const { assert (isActiveQuad(q)); return centroids[q]; }
+  float getArea(int q) const { assert (isActiveQuad(q)); return areas[q]; }
+
+  // =========
+  // MODIFIERS
+  void resizeVertices(int n);
+  void setVertex(int v, const glm::vec3 &pos);
+  // returns the slot of the new quad
+  int addQuad(int a, int b, int c, int d);
+  // n quads (4 vertex indices each), the free slots are filled first.
+  // slots[i] is set to the slot of quad i
+  void addQuads(const int *quads, int n, int *slots);
+  void removeQuad(int q);
+  void clear();
+
+ private:
+
+  // HELPER FUNCTIONS
+  void computeQuad(int q);
+
+  // REPRESENTATION
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  // 4 vertex indices per quad slot (-1 for a free slot)
+  std::vector<int> quad_verts;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec3> centroids;
+  std::vector<float> areas;
+  std::vector<int> free_quads;
+};
+
+#endif
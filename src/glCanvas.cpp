@@ -18,6 +18,12 @@
 #include "raytree.h"
 #include "rigger.h"
 #include "joint.h"
+#include "autorigger.h"
+#include "skeleton.h"
+#include "ik.h"
+#include "preview.h"
+#include "profiler.h"
+#include "meshloader.h"
 
 #include "utils.h"
 
@@ -51,10 +57,13 @@ bool GLCanvas::controlKeyPressed = false;
 bool GLCanvas::altKeyPressed = false;
 bool GLCanvas::superKeyPressed = false;
 
-int GLCanvas::raytracing_x;
-int GLCanvas::raytracing_y;
-int GLCanvas::raytracing_divs_x;
-int GLCanvas::raytracing_divs_y;
+Preview* GLCanvas::preview = NULL;
+MeshLoader* GLCanvas::loader = NULL;
+
+Skeleton* GLCanvas::drag_skeleton = NULL;
+IKSolver* GLCanvas::drag_ik = NULL;
+int GLCanvas::drag_chain = -1;
+int GLCanvas::drag_joint = -1;
 
 GLuint GLCanvas::render_VAO;
 
@@ -65,6 +74,7 @@ GLuint GLCanvas::MatrixID;
 GLuint GLCanvas::programID;
 GLuint GLCanvas::wireframeID;
 GLuint GLCanvas::colormodeID;
+GLuint GLCanvas::instancedID;
 
 GLuint GLCanvas::textureID;
 GLint GLCanvas::mytexture;
@@ -155,15 +165,24 @@ void GLCanvas::initialize(ArgParser *_args) {
 }
 
 
+// the mesh is loaded (& auto rigged) on a background thread, the
+// window is interactive meanwhile & shows the faces as they are
+// uploaded.  FinishLoad creates the tools once the mesh is complete.
 void GLCanvas::Load(){
-  mesh = new Mesh();
-  //mesh->Load(args);
-  mesh->Parallel(args);
-  //exit(1);
+  loader = new MeshLoader(args);
+  loader->Start();
+  // a placeholder until the camera in the file has been parsed
+  camera = new PerspectiveCamera();
+}
+
+
+void GLCanvas::FinishLoad(){
+  mesh = loader->getMesh();
   raytracer = new RayTracer(mesh,args);
+  preview = new Preview(raytracer);
   radiosity = new Radiosity(mesh,args);
   photon_mapping = new PhotonMapping(mesh,args);
-  rigger = new Rigger(raytracer, new JointTree, args);
+  rigger = new Rigger(raytracer, loader->getJointTree(), args);
 
   raytracer->setRadiosity(radiosity);
   raytracer->setPhotonMapping(photon_mapping);
@@ -172,14 +191,43 @@ void GLCanvas::Load(){
   photon_mapping->setRayTracer(raytracer);
   photon_mapping->setRadiosity(radiosity);
 
-  // ===========================
-  // initial placement of camera 
+  // ======================================
+  // keep the view the user may have moved
   assert (mesh->camera != NULL);
-  camera = mesh->camera;
+  if (loader->cameraTaken()) {
+    delete mesh->camera;
+    mesh->camera = camera;
+  } else {
+    delete camera;
+    camera = mesh->camera;
+  }
+
+  radiosity->initializeVBOs();
+  preview->initializeVBOs();
+  photon_mapping->initializeVBOs();
+  rigger->initializeVBOs();
+  loader->cleanupVBOs();
+  delete loader;
+  loader = NULL;
+  setupVBOs();
 }
 
 
 void GLCanvas::animate(){
+  PROFILE_SCOPE(PROFILE_ANIMATE);
+
+  if (loader != NULL) {
+    Camera *file_camera = loader->TakeCamera();
+    if (file_camera != NULL) {
+      delete camera;
+      camera = file_camera;
+    }
+    loader->setupVBOs();
+    if (loader->isFinished()) FinishLoad();
+    Profiler::setupVBOs();
+    usleep (1000);
+    return;
+  }
 
   if (args->radiosity_animation) {
     double undistributed = radiosity->Iterate();
@@ -191,15 +239,13 @@ void GLCanvas::animate(){
   }
 
   if (args->raytracing_animation) {
-    // draw 100 pixels and then refresh the screen and handle any user input
-    for (int i = 0; i < 100; i++) {
-      if (!DrawPixel()) {
-        args->raytracing_animation = false;
-        break;
-      }
+    // trace for ~30ms on every core and then refresh the screen and handle any user input
+    if (!preview->Render(30)) {
+      args->raytracing_animation = false;
     }
-    raytracer->setupVBOs();
+    preview->setupVBOs();
   }
+  Profiler::setupVBOs();
 
   usleep (1000);
 
@@ -217,15 +263,15 @@ void GLCanvas::initializeVBOs(){
   GLCanvas::ModelMatrixID = glGetUniformLocation(GLCanvas::programID, "M");
   GLCanvas::wireframeID = glGetUniformLocation(GLCanvas::programID, "wireframe");
   GLCanvas::colormodeID = glGetUniformLocation(GLCanvas::programID, "colormode");
+  GLCanvas::instancedID = glGetUniformLocation(GLCanvas::programID, "instanced");
   // FIXME: texture still buggy
   GLCanvas::mytexture = glGetUniformLocation(GLCanvas::programID, "mytexture");
   
   bbox.initializeVBOs();
   RayTree::initializeVBOs();
-  radiosity->initializeVBOs();
-  raytracer->initializeVBOs();
-  photon_mapping->initializeVBOs();
-  rigger->initializeVBOs();
+  // (the other modules are initialized by FinishLoad)
+  loader->initializeVBOs();
+  Profiler::initializeVBOs();
 
   HandleGLError("leaving initilizeVBOs()");
 }
@@ -233,13 +279,14 @@ void GLCanvas::initializeVBOs(){
 
 void GLCanvas::setupVBOs(){
   HandleGLError("enter GLCanvas::setupVBOs()");
+  if (loader != NULL) return;
   bbox.Set(*mesh->getBoundingBox());
   bbox.setupVBOs();
   radiosity->setupVBOs();
   photon_mapping->setupVBOs();
   rigger->setupJoints();
   rigger->setupBones();
-  rigger->setupsketch();
+  rigger->setupsketch(camera,1.0f/std::max(args->width,args->height));
   HandleGLError("leaving GLCanvas::setupVBOs()");
 }
 
@@ -261,7 +308,14 @@ void GLCanvas::drawVBOs(const glm::mat4 &ProjectionMatrix,const glm::mat4 &ViewM
   glUniformMatrix4fv(GLCanvas::ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
   glUniform1i(GLCanvas::wireframeID, args->wireframe);
   glUniform1i(GLCanvas::colormodeID, 0);
+  glUniform1i(GLCanvas::instancedID, 0);
   glUniform1i(GLCanvas::mytexture, /*GL_TEXTURE*/0);
+  if (loader != NULL) {
+    loader->drawVBOs();
+    Profiler::drawVBOs();
+    HandleGLError("leaving GlCanvas::drawVBOs()");
+    return;
+  }
   radiosity->drawVBOs();
   photon_mapping->drawVBOs();
   RayTree::drawVBOs();
@@ -273,20 +327,27 @@ void GLCanvas::drawVBOs(const glm::mat4 &ProjectionMatrix,const glm::mat4 &ViewM
   if (args->intersect_backfacing) {
     glDisable(GL_CULL_FACE);
   }
-  raytracer->drawVBOs();
+  preview->drawVBOs();
   if (args->intersect_backfacing) {
     glEnable(GL_CULL_FACE);
   }
+  Profiler::drawVBOs();
   HandleGLError("leaving GlCanvas::drawVBOs()");
 }
 
 
 void GLCanvas::cleanupVBOs(){
-  radiosity->cleanupVBOs();
-  photon_mapping->cleanupVBOs();  
-  raytracer->cleanupVBOs();  
+  // (a load still running isn't waited for, the program is exiting)
+  if (loader != NULL) {
+    loader->cleanupVBOs();
+  } else {
+    radiosity->cleanupVBOs();
+    photon_mapping->cleanupVBOs();  
+    preview->cleanupVBOs();
+    rigger->cleanupVBOs();
+  }
   RayTree::cleanupVBOs();
-  rigger->cleanupVBOs();
+  Profiler::cleanupVBOs();
   bbox.cleanupVBOs();
 }
 
@@ -300,9 +361,22 @@ void GLCanvas::mousebuttonCB(GLFWwindow *window, int which_button, int action, i
   if (which_button == GLFW_MOUSE_BUTTON_1) {
     if (action == GLFW_PRESS) {
       leftMousePressed = true;
+      // the start of a pose drag
+      if (drawing && !shiftKeyPressed && loader == NULL) StartDrag();
     } else {
       assert (action == GLFW_RELEASE);
       leftMousePressed = false;
+      EndDrag();
+      // the end of a pencil stroke: turn it into a chain of joints
+      if (drawing && loader == NULL) {
+        int max_d = std::max(args->width,args->height);
+        if (rigger->finishStroke(camera,mesh,1.0f/max_d) > 0) {
+          setupVBOs();
+        } else {
+          // nothing was added, just take the stroke off the screen
+          rigger->setupsketch(camera,1.0f/max_d);
+        }
+      }
     }
   } else if (which_button == GLFW_MOUSE_BUTTON_2) {
     if (action == GLFW_PRESS) {
@@ -327,13 +401,6 @@ void GLCanvas::mousebuttonCB(GLFWwindow *window, int which_button, int action, i
 
 void GLCanvas::mousemotionCB(GLFWwindow *window, double x, double y) {
 
-  // stop raytracing if the camera has moved
-  if ( (leftMousePressed || middleMousePressed || rightMousePressed) 
-       && args->raytracing_animation) {
-    printf ("raytracing animation stopped, press 'R' to start\n");    
-    args->raytracing_animation = false;
-  }
-
   // camera controls that work well for a 3 button mouse
   if (!drawing && !shiftKeyPressed && !controlKeyPressed && !altKeyPressed) {
     if (leftMousePressed) {
@@ -356,70 +423,32 @@ void GLCanvas::mousemotionCB(GLFWwindow *window, double x, double y) {
     if (altKeyPressed) {
       camera->dollyCamera(y-mouseY);    
     }
+    // the camera has moved: start the ray tracing over from the new view
+    if (args->raytracing_animation && loader == NULL) {
+      preview->Start(camera,args->width,args->height);
+    }
   }
-  else {
+  else if (loader == NULL) {
 	 // assert(drawing == true);
 
 	  if (shiftKeyPressed) {
 		if (leftMousePressed) {
-			// visualize the ray tree for the pixel at the current mouse position
+			// only record the stroke while it is drawn, it is cast into
+			// the mesh once it is finished (in mousebuttonCB)
 			glfwGetWindowSize(window, &args->width, &args->height);
-			 RayTree::Activate();
-			raytracing_divs_x = -1;
-			raytracing_divs_y = -1;
-			//TracePencilMode(mouseX, args->height - mouseY);
-
-				// compute and set the pixel color
-				int max_d = std::max(args->width, args->height);
-				glm::vec3 color;
-				bool in_line_with_geo;
-				// Here's what we do with a single sample per pixel:
-				// construct & trace a ray through the center of the pixle
-				float i = mouseX, j = (args->height - mouseY);
-				double x = (i - args->width / 2.0) / double(max_d) + 0.5;
-				double y = (j - args->height / 2.0) / double(max_d) + 0.5;
-
-					double up_leftx = (i-1 - args->width / 2.0) / double(max_d) + 0.5;
-					double up_lefty = (j+1 - args->height / 2.0) / double(max_d) + 0.5;
-
-					double up_rightx = (i+1 - args->width / 2.0) / double(max_d) + 0.5;
-					double up_righty = (j+1 - args->height / 2.0) / double(max_d) + 0.5;
-
-					double down_leftx = (i-1 - args->width / 2.0) / double(max_d) + 0.5;
-					double down_lefty = (j-1 - args->height / 2.0) / double(max_d) + 0.5;
-
-					double down_rightx = (i+1 - args->width / 2.0) / double(max_d) + 0.5;
-					double down_righty = (j-1 - args->height / 2.0) / double(max_d) + 0.5;
-					//debugging prints
-					//printf("%f, %f | %f, %f | %f ,%f | %f, %f\n", up_leftx, up_lefty, up_rightx, up_righty, down_leftx, down_lefty, down_rightx, down_righty);
-				Ray r = camera->generateRay(x, y);
-					Ray r_ul = camera->generateRay(up_leftx, up_lefty); //ray upper left (ul)
-					Ray r_ur = camera->generateRay(up_rightx, up_righty);
-					Ray r_dl = camera->generateRay(down_leftx, down_lefty);
-					Ray r_dr = camera->generateRay(down_rightx, down_righty);
-				
-				Hit hit;
-				float draw_distance = 5;
-				//FIXME: boolean check broken. Needs to also ignore background geometry like the floor and walls
-				in_line_with_geo = raytracer->CastRay(r, hit, true);
-				//std::cout << in_line_with_geo << std::endl;
-				if (in_line_with_geo) {
-					// add that ray for visualization
-					RayTree::AddMainSegment(r, 0, hit.getT(hit.num_hits() - 1));
-					//rigger->sketch(r.pointAtParameter(draw_distance), r_ul.pointAtParameter(draw_distance),
-							//r_ur.pointAtParameter(draw_distance), r_dl.pointAtParameter(draw_distance), r_dr.pointAtParameter(draw_distance));
-					//std::cout << GetPos(x, y).x << "|" << GetPos(x, y).y << "|" << GetPos(x, y).z << std::endl;
-					rigger->sketch(GetPos(x, y), GetPos(up_leftx, up_lefty), GetPos(up_rightx, up_righty), GetPos(down_leftx, down_lefty), GetPos(down_rightx, down_righty));
-				}
-
-			RayTree::Deactivate();
-			glm::vec3 cp = camera->camera_position;
-			glm::vec3 poi = camera->point_of_interest;
-			float distance = glm::length((cp - poi) / 2.0f);
-			RayTree::setupVBOs(distance / 500.0);
-			rigger->setupsketch();
-			std::cout << "sketching\n";
+			preview->Cancel();
+			int max_d = std::max(args->width, args->height);
+			double i = x, j = args->height - y;
+			rigger->addStrokeSample((i - args->width / 2.0) / double(max_d) + 0.5,
+			                        (j - args->height / 2.0) / double(max_d) + 0.5);
+			rigger->setupsketch(camera, 1.0f / max_d);
 		}
+	  } else if (leftMousePressed) {
+		// pose: drag the selected joint & its chain follows
+		DragJoint(x, args->height - y);
+		// only the rig changed
+		rigger->setupJoints();
+		rigger->setupBones();
 	  }
     
   }
@@ -443,6 +472,9 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
     glfwSetWindowShouldClose(GLCanvas::window, GL_TRUE);
   }
 
+  // the other keys need the mesh (& the tools)
+  if (loader != NULL) return;
+
   // other normal ascii keys...
   if ( (action == GLFW_PRESS || action == GLFW_REPEAT) && key < 256) {
     
@@ -483,18 +515,11 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
           args->gather_indirect = true; 
           printf ("photon mapping animation started, press 'G' to stop\n");
         }
-        if (args->width <= args->height) {
-          raytracing_divs_x = 10;
-          raytracing_divs_y = 10 * args->height / float (args->width);
-        } else {
-          raytracing_divs_x = 10 * args->width / float (args->height);
-          raytracing_divs_y = 10;
-        }
-        raytracing_x = 0;
-        raytracing_y = 0;
-        raytracer->resetVBOs();
-      } else
+        preview->Start(camera,args->width,args->height);
+      } else {
+        preview->Cancel();
         printf ("raytracing animation stopped, press 'R' to start\n");    
+      }
       break;
     }
     case 't':  case 'T': {
@@ -544,8 +569,7 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
     case 'c': case 'C':
       // clear the raytracing visualization
       args->raytracing_animation = false;
-      raytracer->resetVBOs();
-      raytracer->setupVBOs();
+      preview->resetVBOs();
       // clear the radiosity solution
       args->radiosity_animation = false;
       radiosity->Reset();
@@ -580,6 +604,20 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
       args->intersect_backfacing = !args->intersect_backfacing;
       break;
       
+    case 'o':  case 'O':
+      // the frame time overlay (& the averages in the title)
+      Profiler::Toggle();
+      break;
+    case 'e':  case 'E':
+      // the recent frames, for chrome://tracing
+      if (!Profiler::isEnabled())
+        std::cout << "profiling is compiled out (build with RIGGER_PROFILE)" << std::endl;
+      else if (Profiler::ExportTrace("trace.json"))
+        std::cout << "saved trace.json" << std::endl;
+      else
+        std::cout << "ERROR: could not write trace.json" << std::endl;
+      break;
+
     case 'x':  case 'X':
       std::cout << "CURRENT CAMERA" << std::endl;
       std::cout << *camera << std::endl;
@@ -611,6 +649,11 @@ void GLCanvas::keyboardCB(GLFWwindow* window, int key, int scancode, int action,
     case ',':
       rigger->getJointTree()->DeselectAll();
       break;
+    case 'u': case 'U': {
+      // replace the joints with a rig built from the mesh skeleton
+      AutoRigger auto_rigger(mesh,args);
+      auto_rigger.Rig(rigger->getJointTree());
+      break; }
     default:
       std::cout << "UNKNOWN KEYBOARD INPUT  '" << (char)key << "'" << std::endl;
     }
@@ -635,6 +678,61 @@ void GLCanvas::Select(double i, double j) {
 }
 
 
+// move the selected joint under pixel (i,j), at the same depth, by
+// inverse kinematics on the chain above it
+void GLCanvas::DragJoint(double i, double j) {
+  JointTree *tree = rigger->getJointTree();
+  // (re)start if the selection or the rig changed since the drag began
+  if (drag_skeleton == NULL || drag_skeleton->size() != tree->size() ||
+      drag_joint == -1 || !tree->getJoint(drag_joint).isSelected()) {
+    StartDrag();
+  }
+  if (drag_chain == -1) return;
+
+  int max_d = std::max(args->width,args->height);
+  double x = (i-args->width/2.0)/double(max_d)+0.5;
+  double y = (j-args->height/2.0)/double(max_d)+0.5;
+  Ray r = camera->generateRay(x,y);
+  glm::vec3 normal = camera->getDirection();
+  float facing = glm::dot(r.getDirection(),normal);
+  if (fabs(facing) < 0.0001) return;
+  float t = glm::dot(tree->getJoint(drag_joint).getPos()-r.getOrigin(),normal) / facing;
+
+  drag_ik->setTarget(drag_chain,r.pointAtParameter(t));
+  drag_ik->Solve(args->ik_ccd ? IK_CCD : IK_FABRIK);
+  // only the subtree below the top of the chain moves
+  int top = drag_ik->getChainRoot(drag_chain);
+  for (int s = top; s < drag_skeleton->getSubtreeEnd(top); s++) {
+    tree->setPos(drag_skeleton->getJoint(s),drag_skeleton->getWorldPosition(s));
+  }
+}
+
+// flatten the rig & set up the chain above the selected joint
+void GLCanvas::StartDrag() {
+  EndDrag();
+  JointTree *tree = rigger->getJointTree();
+  for (int k = 0; k < tree->size(); k++) {
+    if (tree->getJoint(k).isSelected()) {
+      drag_joint = k;
+      break;
+    }
+  }
+  if (drag_joint == -1) return;
+  drag_skeleton = new Skeleton();
+  drag_skeleton->Build(tree);
+  drag_ik = new IKSolver(drag_skeleton);
+  drag_chain = drag_ik->addChain(drag_joint,args->ik_chain_length);
+}
+
+void GLCanvas::EndDrag() {
+  delete drag_ik;
+  delete drag_skeleton;
+  drag_ik = NULL;
+  drag_skeleton = NULL;
+  drag_chain = -1;
+  drag_joint = -1;
+}
+
 // trace a ray through pixel (i,j) of the image an return the color
 glm::vec3 GLCanvas::TraceRay(double i, double j) {
 
@@ -667,10 +765,9 @@ glm::vec3 GLCanvas::TraceRay(double i, double j) {
  if (loc == 0) {}
  else {
     int parloc = rigger->getJointTree()->getClosest(rigger->getJointTree()->size()-1);
-    Joint par = rigger->getJointTree()->getJoint(parloc);
     bool anySelected = false;
     for (int i = 0; i < rigger->getJointTree()->size(); i++) {
-      Joint j = rigger->getJointTree()->getJoint(i);
+      const Joint &j = rigger->getJointTree()->getJoint(i);
       if (j.isSelected()) {
         anySelected = true;
         rigger->getJointTree()->parent(loc, i);
@@ -727,81 +824,6 @@ glm::vec3 GLCanvas::GetPos(double i, double j) {
 }
 
 
-// Scan through the image from the lower left corner across each row
-// and then up to the top right.  Initially the image is sampled very
-// coarsely.  Increment the static variables that track the progress
-// through the scans
-int GLCanvas::DrawPixel() {
-  if (raytracing_x >= raytracing_divs_x) {
-    // end of row
-    raytracing_x = 0; 
-    raytracing_y += 1;
-  }
-  if (raytracing_y >= raytracing_divs_y) {
-    // last row
-    if (raytracing_divs_x >= args->width ||
-        raytracing_divs_y >= args->height) {
-      // stop rendering, matches resolution of current camera
-      return 0; 
-    }
-    // else decrease pixel size & start over again in the bottom left corner
-    raytracing_divs_x *= 3;
-    raytracing_divs_y *= 3;
-    if (raytracing_divs_x > args->width * 0.51 ||
-        raytracing_divs_x > args->height * 0.51) {
-      raytracing_divs_x = args->width;
-      raytracing_divs_y = args->height;
-    }
-    raytracing_x = 0;
-    raytracing_y = 0;
-    if (raytracer->render_to_a) {
-      raytracer->pixels_b.clear();
-      raytracer->pixels_indices_b.clear();
-     raytracer->render_to_a = false;
-    } else {
-      raytracer->pixels_a.clear();
-      raytracer->pixels_indices_a.clear();
-      raytracer->render_to_a = true;
-    }
-  }
-
-  double x_spacing = args->width / double (raytracing_divs_x);
-  double y_spacing = args->height / double (raytracing_divs_y);
-
-  // compute the color and position of intersection
-  glm::vec3 pos1 =  GetPos((raytracing_x  )*x_spacing, (raytracing_y  )*y_spacing);
-  glm::vec3 pos2 =  GetPos((raytracing_x+1)*x_spacing, (raytracing_y  )*y_spacing);
-  glm::vec3 pos3 =  GetPos((raytracing_x+1)*x_spacing, (raytracing_y+1)*y_spacing);
-  glm::vec3 pos4 =  GetPos((raytracing_x  )*x_spacing, (raytracing_y+1)*y_spacing);
-  
-  glm::vec3 color = TraceRay((raytracing_x+0.5)*x_spacing, (raytracing_y+0.5)*y_spacing);
-
-  double r = linear_to_srgb(color.r);
-  double g = linear_to_srgb(color.g);
-  double b = linear_to_srgb(color.b);
-  if (raytracer->render_to_a) {
-    int start = raytracer->pixels_a.size();
-    raytracer->pixels_a.push_back(VBOPosNormalColor(pos1,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_a.push_back(VBOPosNormalColor(pos2,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_a.push_back(VBOPosNormalColor(pos3,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_a.push_back(VBOPosNormalColor(pos4,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_indices_a.push_back(VBOIndexedTri(start+0,start+1,start+2));
-    raytracer->pixels_indices_a.push_back(VBOIndexedTri(start+0,start+2,start+3));
-  } else {
-    int start = raytracer->pixels_b.size();
-    raytracer->pixels_b.push_back(VBOPosNormalColor(pos1,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_b.push_back(VBOPosNormalColor(pos2,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_b.push_back(VBOPosNormalColor(pos3,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_b.push_back(VBOPosNormalColor(pos4,glm::vec3(0,0,0),glm::vec4(r,g,b,1.0)));
-    raytracer->pixels_indices_b.push_back(VBOIndexedTri(start+0,start+1,start+2));
-    raytracer->pixels_indices_b.push_back(VBOIndexedTri(start+0,start+2,start+3));
-  }  
-
-  raytracing_x += 1;
-  return 1;
-}
-
-
 // ========================================================
 // Load the vertex & fragment shaders
 // ========================================================
@@ -17,10 +17,14 @@
 class ArgParser;
 class Mesh;
 class RayTracer;
+class Preview;
 class Radiosity;
 class PhotonMapping;
 class Rigger;
 class Camera;
+class MeshLoader;
+class Skeleton;
+class IKSolver;
 
 // ====================================================================
 // NOTE:  All the methods and variables of this class are static
@@ -50,6 +54,7 @@ public:
   static GLuint programID;
   static GLuint colormodeID;
   static GLuint wireframeID;
+  static GLuint instancedID;
 
   static GLuint textureID;
   static GLint mytexture;
@@ -68,26 +73,35 @@ public:
   static bool superKeyPressed;
   static bool drawing;
 
-  // SPECIFIC TO HW3
-  static int raytracing_x;
-  static int raytracing_y;
-  static int raytracing_divs_x;
-  static int raytracing_divs_y;
+  // the progressive ray traced image of the view
+  static Preview *preview;
 
+  // while the mesh loads in the background (NULL once it's loaded)
+  static MeshLoader *loader;
+
+  // the rig flattened for posing when a drag starts, reused by every
+  // motion event of the drag (NULL when not dragging)
+  static Skeleton *drag_skeleton;
+  static IKSolver *drag_ik;
+  static int drag_chain;
+  static int drag_joint;
 
   static GLuint render_VAO;
 
   static void initialize(ArgParser *_args);
   static void Load();
+  static void FinishLoad();
   static void initializeVBOs();
   static void setupVBOs();
   static void drawVBOs(const glm::mat4 &ProjectionMatrix,const glm::mat4 &ViewMatrix,const glm::mat4 &ModelMatrix);
   static void cleanupVBOs();
   static void Select(double i, double j);
+  static void StartDrag();
+  static void DragJoint(double i, double j);
+  static void EndDrag();
 
   static void animate();
 
-  static int DrawPixel();
   static glm::vec3 TraceRay(double i, double j);
   static glm::vec3 TracePencilMode(double i, double j);
   static glm::vec3 GetPos(double i, double j);
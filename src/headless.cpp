@@ -0,0 +1,139 @@
+#include "glCanvas.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <omp.h>
+
+#include "headless.h"
+#include "argparser.h"
+#include "mesh.h"
+#include "camera.h"
+#include "raytracer.h"
+#include "photon_mapping.h"
+#include "preview.h"
+#include "image.h"
+#include "joint.h"
+#include "autorigger.h"
+#include "utils.h"
+
+// ====================================================================
+// ====================================================================
+
+// the linear framebuffer (rows from the bottom, as Image stores them)
+static void CopyToImage(const Preview &preview, Image &image) {
+  int width = preview.getWidth();
+  int height = preview.getHeight();
+  const std::vector<float> &framebuffer = preview.getFramebuffer();
+  image.Allocate(width,height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const float *rgb = &framebuffer[3*(y*width+x)];
+      int c[3];
+      for (int k = 0; k < 3; k++) {
+        float v = std::min(1.0f,std::max(0.0f,linear_to_srgb(rgb[k])));
+        c[k] = int(255*v+0.5);
+      }
+      image.SetPixel(x,y,Color(c[0],c[1],c[2]));
+    }
+  }
+}
+
+int RunHeadless(ArgParser *args) {
+  if (args->input_file == "") {
+    std::cerr << "ERROR: -headless needs an -input file" << std::endl;
+    return 1;
+  }
+  if (args->rig_output != "" && !args->auto_rig) {
+    std::cerr << "ERROR: -rig_output needs -auto_rig" << std::endl;
+    return 1;
+  }
+  // Image::Save only writes .ppm, so find out before the work is done
+  int len = args->output.length();
+  if (args->output != "" && !(len > 4 && args->output.substr(len-4) == ".ppm")) {
+    std::cerr << "ERROR: -output must be a .ppm file: " << args->output << std::endl;
+    return 1;
+  }
+  if (args->output == "" && args->rig_output == "") {
+    std::cerr << "WARNING: -headless without -output or -rig_output writes nothing" << std::endl;
+  }
+  // GLCanvas::GetPos (the image plane) reads these, nothing else is set up
+  GLCanvas::args = args;
+  double total_start = omp_get_wtime();
+
+  // load
+  double start = omp_get_wtime();
+  Mesh *mesh = new Mesh();
+  mesh->Parallel(args);
+  assert (mesh->camera != NULL);
+  printf ("headless load: %.3f s\n",omp_get_wtime()-start);
+
+  // rig (before subdividing, as the viewer does)
+  JointTree tree;
+  if (args->auto_rig) {
+    start = omp_get_wtime();
+    AutoRigger auto_rigger(mesh,args);
+    if (auto_rigger.Rig(&tree) == 0) {
+      std::cerr << "ERROR: could not rig " << args->input_file << std::endl;
+      delete mesh;
+      return 1;
+    }
+    printf ("headless rig: %d joints in %.3f s\n",tree.size(),omp_get_wtime()-start);
+  }
+
+  // subdivide
+  if (args->num_subdivisions > 0) {
+    start = omp_get_wtime();
+    for (int i = 0; i < args->num_subdivisions; i++) mesh->Subdivision();
+    printf ("headless subdivide: %d times in %.3f s\n",args->num_subdivisions,omp_get_wtime()-start);
+  }
+
+  // ray trace the view from the mesh camera, all passes at once
+  if (args->output != "") {
+    start = omp_get_wtime();
+    RayTracer *raytracer = new RayTracer(mesh,args);
+    PhotonMapping *photon_mapping = new PhotonMapping(mesh,args);
+    raytracer->setRadiosity(NULL);
+    raytracer->setPhotonMapping(photon_mapping);
+    photon_mapping->setRayTracer(raytracer);
+    photon_mapping->setRadiosity(NULL);
+    if (args->gather_indirect) photon_mapping->TracePhotons();
+    // the size the window would have had
+    GLCanvas::camera = mesh->camera;
+    mesh->camera->width = args->width;
+    mesh->camera->height = args->height;
+    Preview preview(raytracer);
+    preview.Start(mesh->camera,args->width,args->height);
+    while (preview.Render(1000)) {}
+    Image image;
+    CopyToImage(preview,image);
+    if (!image.Save(args->output)) {
+      std::cerr << "ERROR: could not write " << args->output << std::endl;
+      delete photon_mapping;
+      delete raytracer;
+      delete mesh;
+      return 1;
+    }
+    printf ("headless render: %s in %.3f s\n",args->output.c_str(),omp_get_wtime()-start);
+    GLCanvas::camera = NULL;
+    delete photon_mapping;
+    delete raytracer;
+  }
+
+  // the rig, in the format of its extension
+  if (args->rig_output != "") {
+    if (!tree.Save(args->rig_output)) {
+      std::cerr << "ERROR: could not write " << args->rig_output << std::endl;
+      delete mesh;
+      return 1;
+    }
+    printf ("headless rig saved: %s\n",args->rig_output.c_str());
+  }
+
+  delete mesh;
+  printf ("headless total: %.3f s\n",omp_get_wtime()-total_start);
+  return 0;
+}
+
+// ====================================================================
+// ====================================================================
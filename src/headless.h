@@ -0,0 +1,23 @@
+#ifndef _HEADLESS_H_
+#define _HEADLESS_H_
+
+class ArgParser;
+
+// ====================================================================
+// ====================================================================
+// Batch processing without a window (or OpenGL): load the mesh, rig
+// and/or subdivide it, ray trace the view from its camera into a .ppm
+// and write the rig, as the command line asks.  For example:
+//
+//   rigger -i ../models/new_hand.obj -headless -auto_rig -output hand.ppm -rig_output hand.rig
+//
+// Each stage is timed, so many processes (e.g. one per asset, with
+// OMP_NUM_THREADS set to share out the cores) can be compared.
+// Returns the exit code.
+
+int RunHeadless(ArgParser *args);
+
+// ====================================================================
+// ====================================================================
+
+#endif
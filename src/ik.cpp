@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <omp.h>
+#include "ik.h"
+#include "skeleton.h"
+
+// bones shorter than this are left alone (no direction to aim)
+#define IK_EPSILON 1e-6f
+
+// the shortest rotation taking unit vector a to unit vector b
+static glm::quat RotationBetween(const glm::vec3 &a, const glm::vec3 &b) {
+	float c = glm::dot(a,b);
+	if (c < -1+IK_EPSILON) {
+		// opposite: half a turn about any perpendicular axis
+		glm::vec3 axis = glm::cross(glm::vec3(1,0,0),a);
+		if (glm::length(axis) < IK_EPSILON) axis = glm::cross(glm::vec3(0,1,0),a);
+		return glm::angleAxis(3.14159265359f,glm::normalize(axis));
+	}
+	return glm::normalize(glm::quat(1+c,glm::cross(a,b)));
+}
+
+// ==================================================================
+// MODIFIERS
+// ==================================================================
+
+int IKSolver::addChain(int effector, int length) {
+	Chain chain;
+	int slot = skeleton->getSlot(effector);
+	chain.slots.push_back(slot);
+	while ((int)chain.slots.size() <= length && skeleton->getParent(slot) >= 0) {
+		slot = skeleton->getParent(slot);
+		chain.slots.push_back(slot);
+	}
+	if (chain.slots.size() < 2) return -1;
+	std::reverse(chain.slots.begin(),chain.slots.end());
+	chain.target = skeleton->getWorldPosition(chain.slots.back());
+	chain.wave = 0;
+	chain.iterations = 0;
+	chain.error = 0;
+	chain.time = 0;
+	chains.push_back(chain);
+	return chains.size()-1;
+}
+
+void IKSolver::setLimit(int joint, float max_angle) {
+	if ((int)limits.size() != skeleton->size()) limits.assign(skeleton->size(),-1);
+	limits[skeleton->getSlot(joint)] = max_angle;
+}
+
+// ==================================================================
+// SOLVING
+// ==================================================================
+
+double IKSolver::Solve(enum IK_METHOD method) {
+	double start = omp_get_wtime();
+	AssignWaves();
+	int num_waves = 0;
+	for (unsigned int c = 0; c < chains.size(); c++) num_waves = std::max(num_waves,chains[c].wave+1);
+	skeleton->Solve();
+	for (int w = 0; w < num_waves; w++) {
+		std::vector<int> wave;
+		for (unsigned int c = 0; c < chains.size(); c++) {
+			if (chains[c].wave == w) wave.push_back(c);
+		}
+		int num_chains = wave.size();
+#pragma omp parallel for schedule(dynamic,1) if (num_chains > 1)
+		for (int i = 0; i < num_chains; i++) {
+			SolveChain(chains[wave[i]],method);
+		}
+		// the chains in the next wave hang below these
+		skeleton->Solve();
+	}
+	return 1000*(omp_get_wtime()-start);
+}
+
+// a chain moves everything below its root, so a chain rooted in there
+// waits for the next wave.  an ancestor always has the smaller slot.
+void IKSolver::AssignWaves() {
+	std::vector<int> order(chains.size());
+	for (unsigned int c = 0; c < chains.size(); c++) order[c] = c;
+	std::sort(order.begin(),order.end(),[this](int a, int b) {
+			return chains[a].slots[0] < chains[b].slots[0] ||
+				(chains[a].slots[0] == chains[b].slots[0] && a < b); });
+	for (unsigned int i = 0; i < order.size(); i++) {
+		Chain &chain = chains[order[i]];
+		int root = chain.slots[0];
+		chain.wave = 0;
+		for (unsigned int j = 0; j < i; j++) {
+			const Chain &before = chains[order[j]];
+			int before_root = before.slots[0];
+			if (root >= before_root && root < skeleton->getSubtreeEnd(before_root)) {
+				chain.wave = std::max(chain.wave,before.wave+1);
+			}
+		}
+	}
+}
+
+void IKSolver::SolveChain(Chain &chain, enum IK_METHOD method) {
+	double start = omp_get_wtime();
+	int parent = skeleton->getParent(chain.slots[0]);
+	glm::quat base = (parent < 0) ? glm::quat(1,0,0,0) : glm::quat_cast(glm::mat3(skeleton->getWorld(parent)));
+	std::vector<glm::vec3> positions(chain.slots.size());
+	std::vector<glm::quat> rotations(chain.slots.size()-1);
+	positions[0] = skeleton->getWorldPosition(chain.slots[0]);
+	ChainPose(chain,0,base,positions,rotations);
+	if (method == IK_FABRIK) Fabrik(chain,base,positions,rotations);
+	else Ccd(chain,base,positions,rotations);
+	chain.error = glm::distance(positions.back(),chain.target);
+	chain.time = 1000*(omp_get_wtime()-start);
+}
+
+void IKSolver::ChainPose(const Chain &chain, int from, const glm::quat &base, std::vector<glm::vec3> &positions,
+			 std::vector<glm::quat> &rotations) const {
+	int n = rotations.size();
+	for (int i = from; i < n; i++) {
+		glm::quat parent_rotation = (i == 0) ? base : rotations[i-1];
+		rotations[i] = parent_rotation * skeleton->getLocalRotation(chain.slots[i]);
+		positions[i+1] = positions[i] + rotations[i] * skeleton->getLocalTranslation(chain.slots[i+1]);
+	}
+}
+
+void IKSolver::Fabrik(Chain &chain, const glm::quat &base, std::vector<glm::vec3> &positions,
+		      std::vector<glm::quat> &rotations) {
+	int n = rotations.size();
+	std::vector<float> lengths(n);
+	for (int i = 0; i < n; i++) lengths[i] = glm::length(skeleton->getLocalTranslation(chain.slots[i+1]));
+	std::vector<glm::vec3> dragged(positions);
+	chain.iterations = 0;
+	while (chain.iterations < max_iterations && glm::distance(positions[n],chain.target) > tolerance) {
+		chain.iterations++;
+		// backward: the effector onto the target, each joint dragged after it
+		dragged[n] = chain.target;
+		for (int i = n-1; i >= 0; i--) {
+			glm::vec3 dir = positions[i] - dragged[i+1];
+			float length = glm::length(dir);
+			dragged[i] = (length > IK_EPSILON) ? dragged[i+1] + dir*(lengths[i]/length) : positions[i];
+		}
+		// forward: from the fixed root, aim each bone at its dragged child
+		for (int i = 0; i < n; i++) {
+			glm::quat parent_rotation = (i == 0) ? base : rotations[i-1];
+			glm::vec3 dir = dragged[i+1] - positions[i];
+			if (lengths[i] > IK_EPSILON && glm::length(dir) > IK_EPSILON) {
+				skeleton->setLocalRotation(chain.slots[i],Aim(chain.slots[i],chain.slots[i+1],parent_rotation,
+									      glm::normalize(dir)));
+			}
+			rotations[i] = parent_rotation * skeleton->getLocalRotation(chain.slots[i]);
+			positions[i+1] = positions[i] + rotations[i] * skeleton->getLocalTranslation(chain.slots[i+1]);
+		}
+	}
+}
+
+void IKSolver::Ccd(Chain &chain, const glm::quat &base, std::vector<glm::vec3> &positions,
+		   std::vector<glm::quat> &rotations) {
+	int n = rotations.size();
+	chain.iterations = 0;
+	while (chain.iterations < max_iterations && glm::distance(positions[n],chain.target) > tolerance) {
+		chain.iterations++;
+		for (int i = n-1; i >= 0; i--) {
+			glm::vec3 to_effector = positions[n] - positions[i];
+			glm::vec3 to_target = chain.target - positions[i];
+			if (glm::length(to_effector) < IK_EPSILON || glm::length(to_target) < IK_EPSILON) continue;
+			// turn the joint in world space, then back into its parent's frame
+			glm::quat parent_rotation = (i == 0) ? base : rotations[i-1];
+			glm::quat turn = RotationBetween(glm::normalize(to_effector),glm::normalize(to_target));
+			glm::quat local = glm::normalize(glm::inverse(parent_rotation) * turn * rotations[i]);
+			skeleton->setLocalRotation(chain.slots[i],Limit(chain.slots[i],chain.slots[i+1],local));
+			ChainPose(chain,i,base,positions,rotations);
+		}
+	}
+}
+
+glm::quat IKSolver::Aim(int slot, int child_slot, const glm::quat &parent_rotation, const glm::vec3 &dir) const {
+	// the bone now & where it should point, in the parent's frame
+	glm::quat local = skeleton->getLocalRotation(slot);
+	glm::vec3 bone = glm::normalize(local * skeleton->getLocalTranslation(child_slot));
+	glm::vec3 want = glm::inverse(parent_rotation) * dir;
+	return Limit(slot,child_slot,glm::normalize(RotationBetween(bone,want) * local));
+}
+
+glm::quat IKSolver::Limit(int slot, int child_slot, const glm::quat &local) const {
+	if (limits.empty() || limits[slot] < 0) return local;
+	if (glm::length(skeleton->getLocalTranslation(child_slot)) < IK_EPSILON) return local;
+	// the rest direction of the bone (there is no rest rotation)
+	glm::vec3 rest = glm::normalize(skeleton->getLocalTranslation(child_slot));
+	glm::vec3 bone = glm::normalize(local * skeleton->getLocalTranslation(child_slot));
+	float max_angle = limits[slot];
+	float angle = std::acos(std::min(1.0f,std::max(-1.0f,glm::dot(rest,bone))));
+	if (angle <= max_angle) return local;
+	// rotate the rest direction toward the bone, only as far as allowed
+	glm::vec3 side = bone - rest*glm::dot(rest,bone);
+	if (glm::length(side) < IK_EPSILON) {
+		side = glm::cross(rest,glm::vec3(1,0,0));
+		if (glm::length(side) < IK_EPSILON) side = glm::cross(rest,glm::vec3(0,1,0));
+	}
+	glm::vec3 allowed = rest*std::cos(max_angle) + glm::normalize(side)*std::sin(max_angle);
+	return glm::normalize(RotationBetween(bone,allowed) * local);
+}
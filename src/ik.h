@@ -0,0 +1,91 @@
+#ifndef _IK_H
+#define _IK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+class Skeleton;
+
+enum IK_METHOD { IK_FABRIK, IK_CCD };
+
+// ==================================================================
+// Inverse kinematics on the chains of a Skeleton: each chain runs from
+// an end effector up through its ancestors, and the local rotations of
+// the chain joints (not the effector) are solved so the effector
+// reaches its target.  Two methods:
+//   FABRIK - alternately drags the joint positions from the target back
+//            to the chain root & from the root out again, then turns
+//            the positions back into rotations
+//   CCD    - from the joint next to the effector to the chain root,
+//            turns each joint to point the effector at the target
+// A joint can be limited to a cone around its rest direction.  Each
+// solve runs a fixed number of iterations, stopping early once the
+// effector is within tolerance.  Independent chains are solved in
+// parallel; a chain below another chain's joints waits for it.
+
+class IKSolver {
+public:
+	//Constructor
+	IKSolver(Skeleton *_skeleton) : skeleton(_skeleton), max_iterations(16), tolerance(0.001f) {}
+
+	//Accessors
+	int numChains() const { return chains.size(); }
+	// the results of the last Solve for a chain
+	int getIterations(int chain) const { return chains[chain].iterations; }
+	float getError(int chain) const { return chains[chain].error; }
+	double getTime(int chain) const { return chains[chain].time; }
+	// the slot at the top of a chain (its subtree is all the chain moves)
+	int getChainRoot(int chain) const { return chains[chain].slots[0]; }
+
+	//Modifiers
+	// the chain from effector up length bones (fewer at a root), by
+	// joint id.  returns the chain number.
+	int addChain(int effector, int length);
+	void clearChains() { chains.clear(); }
+	void setTarget(int chain, const glm::vec3 &target) { chains[chain].target = target; }
+	// limit the bend of a joint to max_angle (radians) from its rest direction
+	void setLimit(int joint, float max_angle);
+	void setIterations(int iterations) { max_iterations = iterations; }
+	void setTolerance(float _tolerance) { tolerance = _tolerance; }
+	// solve every chain & pose the skeleton, returns the time in ms
+	double Solve(enum IK_METHOD method);
+
+private:
+
+	struct Chain {
+		// skeleton slots from the chain root to the effector
+		std::vector<int> slots;
+		glm::vec3 target;
+		// chains solved in the same wave don't affect each other
+		int wave;
+		int iterations;
+		float error;
+		double time;
+	};
+
+	//helpers
+	void AssignWaves();
+	void SolveChain(Chain &chain, enum IK_METHOD method);
+	// positions & world rotations of the chain from its local rotations
+	void ChainPose(const Chain &chain, int from, const glm::quat &base, std::vector<glm::vec3> &positions,
+		       std::vector<glm::quat> &rotations) const;
+	void Fabrik(Chain &chain, const glm::quat &base, std::vector<glm::vec3> &positions,
+		    std::vector<glm::quat> &rotations);
+	void Ccd(Chain &chain, const glm::quat &base, std::vector<glm::vec3> &positions,
+		 std::vector<glm::quat> &rotations);
+	// the local rotation of slot turning its bone to world direction dir
+	// (within its limit), given the world rotation of its parent
+	glm::quat Aim(int slot, int child_slot, const glm::quat &parent_rotation, const glm::vec3 &dir) const;
+	glm::quat Limit(int slot, int child_slot, const glm::quat &local) const;
+
+	//representation
+	Skeleton *skeleton;
+	std::vector<Chain> chains;
+	// by slot, negative for no limit
+	std::vector<float> limits;
+	int max_iterations;
+	float tolerance;
+};
+
+#endif
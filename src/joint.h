@@ -6,6 +6,7 @@
 #include <vector>
 #include <sstream>
 #include "argparser.h"
+#include "jointindex.h"
 #include <omp.h>
 
 class Joint {
@@ -15,18 +16,19 @@ public:
 	Joint(int _id, glm::vec3 position) :  id(_id), pos(position){
 		parent = -1;
 		child = std::vector<int>();
+		selected = false;
 	}
 
 	//Destructor
 	~Joint() {}
 	
 	//Accessors
-	glm::vec3 getPos() { return pos; }
-	int getID() { return id; }
-	int getParent() { return parent; }
-	int getChild(int num) { return child[num]; }
-	int numChildren() { return child.size(); }
-	bool isSelected() { return selected; }
+	const glm::vec3& getPos() const { return pos; }
+	int getID() const { return id; }
+	int getParent() const { return parent; }
+	int getChild(int num) const { return child[num]; }
+	int numChildren() const { return child.size(); }
+	bool isSelected() const { return selected; }
 	
 	//Modifiers
 	void setParent(int j) { parent = j; }
@@ -51,7 +53,8 @@ class JointTree {
 public:
 	JointTree() {
 		joints = std::vector<Joint>();
-		int root = -1;
+		root = -1;
+		index_valid = true;
 	}
 	JointTree(int _size, int _root) {
 		assert (_size > _root);
@@ -59,12 +62,14 @@ public:
 		assert (_size > 0);
 		joints = std::vector<Joint>(_size);
 		root = _root;
+		index_valid = false;
 	}
-	Joint getJoint(int id){ return joints[id]; }
+	const Joint& getJoint(int id) const { return joints[id]; }
 	
 	int addJoint(Joint &j) {
 		joints.push_back(j);
 		j.setID(joints.size()-1);
+		if (index_valid) index.Insert(joints.size()-1, j.getPos());
 		if (joints.size() == 1) {
 			root = 0;
 		}
@@ -77,7 +82,16 @@ public:
 		return joints.size();
 	}
 	void select(int i) {joints[i].select();}
+	// move a joint (e.g. to its posed position), the index is updated
+	// in place
+	void setPos(int i, glm::vec3 pos) {
+		if (index_valid && pos != joints[i].getPos()) index.Move(i, pos);
+		joints[i].setPosition(pos);
+	}
+	// the closest other joint to joint i (-1 if there is none)
 	int getClosest(int i);
+	// the k closest joints to pos, closest first
+	void getKClosest(const glm::vec3 &pos, int k, std::vector<int> &result);
 
 	//parent joint i to joint j
 	void parent(int child, int parent) {
@@ -92,11 +106,24 @@ public:
 
 	//helpers
 	void clearJoints();
+	// reads either rig format (text .rig or binary .rigb)
 	bool Parallel_load(std::string filename);
+	// the format follows the extension, binary for .rigb
 	bool Save(std::string fname);
+	bool SaveText(std::string fname);
+	bool SaveBinary(std::string fname);
 
 private:
+	// (re)build the spatial index if a bulk load made it stale
+	void IndexJoints();
+	bool LoadText(std::string filename);
+	bool LoadBinary(const char *data, size_t bytes);
+
 	std::vector<Joint> joints;
 	int root;
+	// kd-tree over the joint positions, updated as joints are added &
+	// moved (a bulk load leaves it stale until the next query)
+	JointIndex index;
+	bool index_valid;
 };
 #endif 
\ No newline at end of file
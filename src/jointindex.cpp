@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "jointindex.h"
+
+// a subtree is rebuilt when one side holds more than this fraction of it
+#define JOINT_INDEX_BALANCE 0.75f
+
+// ==================================================================
+// MODIFIERS
+// ==================================================================
+
+void JointIndex::Insert(int id, const glm::vec3 &pos) {
+	assert (id >= 0);
+	if (id >= (int)positions.size()) positions.resize(id+1);
+	positions[id] = pos;
+	Node n = { id, -1, -1, 1, 0 };
+	nodes.push_back(n);
+	Link(nodes.size()-1);
+}
+
+void JointIndex::Move(int id, const glm::vec3 &pos) {
+	assert (id >= 0 && id < (int)positions.size());
+	// take it out at its old position & put its node back in at the new one
+	int leaf = Remove(id);
+	assert (leaf != -1);
+	positions[id] = pos;
+	Node n = { id, -1, -1, 1, 0 };
+	nodes[leaf] = n;
+	Link(leaf);
+}
+
+// link a new leaf node into the tree
+void JointIndex::Link(int leaf) {
+	const glm::vec3 &pos = positions[nodes[leaf].id];
+	if (root == -1) {
+		root = leaf;
+		return;
+	}
+
+	// walk down to an empty child, counting the new joint in each subtree
+	std::vector<int> path;
+	int node = root;
+	while (1) {
+		path.push_back(node);
+		Node &current = nodes[node];
+		current.size++;
+		int &child = (pos[current.axis] < positions[current.id][current.axis]) ? current.left : current.right;
+		if (child == -1) {
+			child = leaf;
+			nodes[leaf].axis = (current.axis+1)%3;
+			break;
+		}
+		node = child;
+	}
+
+	// too deep?  rebuild the lowest lopsided subtree on the path
+	int max_depth = (int)(std::log((float)nodes.size()) / std::log(1.0f/JOINT_INDEX_BALANCE)) + 1;
+	if ((int)path.size() <= max_depth) return;
+	int child = leaf;
+	for (int i = path.size()-1; i >= 0; i--) {
+		int scapegoat = path[i];
+		if (nodes[child].size > JOINT_INDEX_BALANCE*nodes[scapegoat].size) {
+			std::vector<int> node_list;
+			CollectSubtree(scapegoat,node_list);
+			int rebuilt = BuildSubtree(&node_list[0],node_list.size());
+			if (i == 0) {
+				root = rebuilt;
+			} else if (nodes[path[i-1]].left == scapegoat) {
+				nodes[path[i-1]].left = rebuilt;
+			} else {
+				assert (nodes[path[i-1]].right == scapegoat);
+				nodes[path[i-1]].right = rebuilt;
+			}
+			return;
+		}
+		child = scapegoat;
+	}
+}
+
+// unlink the node of id, returns the node freed (-1 if id isn't in the tree)
+int JointIndex::Remove(int id) {
+	std::vector<int> path;
+	if (!FindPath(root,id,path)) return -1;
+	while (1) {
+		Node &n = nodes[path.back()];
+		if (n.left == -1 && n.right == -1) break;
+		// replace the joint with the closest one along the split from
+		// below (the lowest on the right or the highest on the left, so
+		// the split stays valid), then remove that one from its node
+		int child = (n.right != -1) ? n.right : n.left;
+		int replacement = Extreme(child,n.axis,n.right != -1);
+		n.id = nodes[replacement].id;
+		FindPath(child,n.id,path);
+	}
+	// the last node on the path is now a leaf
+	int leaf = path.back();
+	path.pop_back();
+	for (unsigned int i = 0; i < path.size(); i++) nodes[path[i]].size--;
+	if (path.empty()) {
+		root = -1;
+	} else if (nodes[path.back()].left == leaf) {
+		nodes[path.back()].left = -1;
+	} else {
+		assert (nodes[path.back()].right == leaf);
+		nodes[path.back()].right = -1;
+	}
+	return leaf;
+}
+
+void JointIndex::Build(const std::vector<glm::vec3> &_positions) {
+	Clear();
+	positions = _positions;
+	std::vector<int> node_list(positions.size());
+	for (unsigned int i = 0; i < positions.size(); i++) {
+		Node n = { (int)i, -1, -1, 1, 0 };
+		nodes.push_back(n);
+		node_list[i] = i;
+	}
+	if (!node_list.empty()) root = BuildSubtree(&node_list[0],node_list.size());
+}
+
+void JointIndex::Clear() {
+	nodes.clear();
+	positions.clear();
+	root = -1;
+}
+
+// ==================================================================
+// QUERIES
+// ==================================================================
+
+int JointIndex::Nearest(const glm::vec3 &pos, int exclude) const {
+	int best = -1;
+	float best_d2 = 0;
+	NearestSubtree(root,pos,exclude,best,best_d2);
+	return best;
+}
+
+void JointIndex::KNearest(const glm::vec3 &pos, int k, std::vector<int> &result, int exclude) const {
+	result.clear();
+	if (k <= 0) return;
+	std::vector<std::pair<float,int> > best;
+	KNearestSubtree(root,pos,k,exclude,best);
+	for (unsigned int i = 0; i < best.size(); i++) {
+		result.push_back(best[i].second);
+	}
+}
+
+void JointIndex::NearestSubtree(int node, const glm::vec3 &pos, int exclude, int &best, float &best_d2) const {
+	if (node == -1) return;
+	const Node &n = nodes[node];
+	const glm::vec3 &p = positions[n.id];
+	if (n.id != exclude) {
+		glm::vec3 d = p - pos;
+		float d2 = glm::dot(d,d);
+		if (Closer(d2,n.id,best_d2,best)) {
+			best = n.id;
+			best_d2 = d2;
+		}
+	}
+	// the side of the split holding pos first, the other only if it
+	// could hold something as close (ties included, for the id order)
+	float diff = pos[n.axis] - p[n.axis];
+	NearestSubtree(diff < 0 ? n.left : n.right,pos,exclude,best,best_d2);
+	if (best == -1 || diff*diff <= best_d2) {
+		NearestSubtree(diff < 0 ? n.right : n.left,pos,exclude,best,best_d2);
+	}
+}
+
+void JointIndex::KNearestSubtree(int node, const glm::vec3 &pos, int k, int exclude,
+				 std::vector<std::pair<float,int> > &best) const {
+	if (node == -1) return;
+	const Node &n = nodes[node];
+	const glm::vec3 &p = positions[n.id];
+	if (n.id != exclude) {
+		glm::vec3 d = p - pos;
+		std::pair<float,int> candidate(glm::dot(d,d),n.id);
+		// best is kept sorted, closest first
+		if ((int)best.size() < k || candidate < best.back()) {
+			best.insert(std::upper_bound(best.begin(),best.end(),candidate),candidate);
+			if ((int)best.size() > k) best.pop_back();
+		}
+	}
+	float diff = pos[n.axis] - p[n.axis];
+	KNearestSubtree(diff < 0 ? n.left : n.right,pos,k,exclude,best);
+	if ((int)best.size() < k || diff*diff <= best.back().first) {
+		KNearestSubtree(diff < 0 ? n.right : n.left,pos,k,exclude,best);
+	}
+}
+
+// ==================================================================
+// HELPERS
+// ==================================================================
+
+// append the nodes from node down to the one holding id (searching
+// both sides of a split equal to its position).  returns false, with
+// path unchanged, if it isn't in this subtree.
+bool JointIndex::FindPath(int node, int id, std::vector<int> &path) const {
+	if (node == -1) return false;
+	const Node &n = nodes[node];
+	path.push_back(node);
+	if (n.id == id) return true;
+	float diff = positions[id][n.axis] - positions[n.id][n.axis];
+	if (diff <= 0 && FindPath(n.left,id,path)) return true;
+	if (diff >= 0 && FindPath(n.right,id,path)) return true;
+	path.pop_back();
+	return false;
+}
+
+// the node in the subtree with the lowest (or highest) position on axis
+int JointIndex::Extreme(int node, int axis, bool lowest) const {
+	if (node == -1) return -1;
+	const Node &n = nodes[node];
+	int best = node;
+	int sides[2] = { n.left, n.right };
+	for (int i = 0; i < 2; i++) {
+		// a split on the same axis rules out one side
+		if (n.axis == axis && i == (lowest ? 1 : 0)) continue;
+		int candidate = Extreme(sides[i],axis,lowest);
+		if (candidate == -1) continue;
+		float a = positions[nodes[candidate].id][axis];
+		float b = positions[nodes[best].id][axis];
+		if (lowest ? (a < b) : (a > b)) best = candidate;
+	}
+	return best;
+}
+
+void JointIndex::CollectSubtree(int node, std::vector<int> &node_list) const {
+	if (node == -1) return;
+	node_list.push_back(node);
+	CollectSubtree(nodes[node].left,node_list);
+	CollectSubtree(nodes[node].right,node_list);
+}
+
+// relink the given nodes into a balanced subtree, split at the median
+// of the longest side of their bounding box.  returns its root.
+int JointIndex::BuildSubtree(int *node_list, int count) {
+	if (count == 0) return -1;
+	glm::vec3 lo = positions[nodes[node_list[0]].id];
+	glm::vec3 hi = lo;
+	for (int i = 1; i < count; i++) {
+		lo = glm::min(lo,positions[nodes[node_list[i]].id]);
+		hi = glm::max(hi,positions[nodes[node_list[i]].id]);
+	}
+	glm::vec3 extent = hi - lo;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	int mid = count/2;
+	std::nth_element(node_list,node_list+mid,node_list+count,
+			 [this,axis](int a, int b) {
+				 return positions[nodes[a].id][axis] < positions[nodes[b].id][axis]; });
+	int node = node_list[mid];
+	int left = BuildSubtree(node_list,mid);
+	int right = BuildSubtree(node_list+mid+1,count-mid-1);
+	Node &n = nodes[node];
+	n.axis = axis;
+	n.left = left;
+	n.right = right;
+	n.size = count;
+	return node;
+}
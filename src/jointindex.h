@@ -0,0 +1,71 @@
+#ifndef _JOINT_INDEX_H
+#define _JOINT_INDEX_H
+
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+// ==================================================================
+// A kd-tree over the joint positions for nearest & k-nearest joint
+// queries.  Joints are inserted one at a time as they are placed; when
+// an insertion leaves a subtree too lopsided (e.g. a chain of joints
+// placed in a line) just that subtree is rebuilt around its medians,
+// so the tree stays O(log n) deep.  A moved joint is taken out and
+// inserted again at its new position.  Distances are compared squared,
+// and equally close joints are ordered by id (lowest first), the same
+// answer as a linear scan.
+
+class JointIndex {
+public:
+	//Constructor
+	JointIndex() : root(-1) {}
+
+	//Accessors
+	int size() const { return nodes.size(); }
+	// the closest joint to pos, other than exclude (-1 if there is none)
+	int Nearest(const glm::vec3 &pos, int exclude = -1) const;
+	// the k closest joints to pos (other than exclude), closest first
+	void KNearest(const glm::vec3 &pos, int k, std::vector<int> &result, int exclude = -1) const;
+
+	//Modifiers
+	void Insert(int id, const glm::vec3 &pos);
+	// a joint already in the index has moved to pos
+	void Move(int id, const glm::vec3 &pos);
+	// replace the contents with the given joints (id = position in the vector)
+	void Build(const std::vector<glm::vec3> &positions);
+	void Clear();
+
+private:
+
+	struct Node {
+		int id;
+		int left;
+		int right;
+		// number of nodes in this subtree
+		int size;
+		int axis;
+	};
+
+	//helpers
+	void Link(int leaf);
+	int Remove(int id);
+	bool FindPath(int node, int id, std::vector<int> &path) const;
+	int Extreme(int node, int axis, bool lowest) const;
+	int BuildSubtree(int *node_list, int count);
+	void CollectSubtree(int node, std::vector<int> &node_list) const;
+	void NearestSubtree(int node, const glm::vec3 &pos, int exclude, int &best, float &best_d2) const;
+	void KNearestSubtree(int node, const glm::vec3 &pos, int k, int exclude,
+			     std::vector<std::pair<float,int> > &best) const;
+	// is (d2,id) closer than (best_d2,best_id)?
+	static bool Closer(float d2, int id, float best_d2, int best_id) {
+		return best_id == -1 || d2 < best_d2 || (d2 == best_d2 && id < best_id);
+	}
+
+	//representation
+	std::vector<Node> nodes;
+	// the position of each joint id
+	std::vector<glm::vec3> positions;
+	int root;
+};
+
+#endif
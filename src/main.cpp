@@ -17,6 +17,8 @@
 #include "glCanvas.h"
 #include "camera.h"
 #include "rigger.h"
+#include "headless.h"
+#include "profiler.h"
 
 #include <time.h>
 
@@ -28,6 +30,8 @@ int main(int argc, char *argv[]) {
 
   // parse the command line arguments
   ArgParser args(argc, argv);
+  // batch processing, without a window
+  if (args.headless) return RunHeadless(&args);
   GLCanvas::initialize(&args); 
 
   glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
@@ -55,6 +59,7 @@ int main(int argc, char *argv[]) {
     fflush(stdout);
     glfwPollEvents();  
     fflush(stdout);
+    Profiler::EndFrame();
 
 #if defined(_WIN32)
   Sleep(100);
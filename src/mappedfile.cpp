@@ -0,0 +1,93 @@
+#include <cassert>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+// ==================================================================
+
+MappedFile::MappedFile() {
+  data = NULL;
+  size = 0;
+#ifdef _WIN32
+  file_handle = NULL;
+  mapping_handle = NULL;
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string &filename) {
+  Close();
+  HANDLE file = CreateFileA(filename.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,
+                            OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if (file == INVALID_HANDLE_VALUE) return false;
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file,&file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+  if (mapping == NULL) {
+    CloseHandle(file);
+    return false;
+  }
+  void *view = MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+  if (view == NULL) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  file_handle = file;
+  mapping_handle = mapping;
+  data = (const char*)view;
+  size = (size_t)file_size.QuadPart;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data != NULL) UnmapViewOfFile(data);
+  if (mapping_handle != NULL) CloseHandle((HANDLE)mapping_handle);
+  if (file_handle != NULL) CloseHandle((HANDLE)file_handle);
+  data = NULL;
+  size = 0;
+  file_handle = NULL;
+  mapping_handle = NULL;
+}
+
+#else
+
+bool MappedFile::Open(const std::string &filename) {
+  Close();
+  int fd = open(filename.c_str(),O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd,&st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *view = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (view == MAP_FAILED) return false;
+  // the whole file is read front to back
+  madvise(view,st.st_size,MADV_SEQUENTIAL);
+  data = (const char*)view;
+  size = st.st_size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data != NULL) munmap((void*)data,size);
+  data = NULL;
+  size = 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <string>
+
+// ==================================================================
+// A read only memory mapping of a whole file.  The loaders parse the
+// mapped bytes directly instead of copying them through an iostream.
+
+class MappedFile {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  MappedFile();
+  ~MappedFile() { Close(); }
+
+  // =========
+  // ACCESSORS
+  bool isOpen() const { return data != NULL; }
+  const char* getData() const { return data; }
+  size_t getSize() const { return size; }
+
+  // =========
+  // MODIFIERS
+  // returns false if the file cannot be opened or is empty
+  bool Open(const std::string &filename);
+  void Close();
+
+ private:
+
+  // don't use these
+  MappedFile(const MappedFile&) { assert(0); }
+  MappedFile& operator=(const MappedFile&) { assert(0); return *this; }
+
+  // REPRESENTATION
+  const char *data;
+  size_t size;
+#ifdef _WIN32
+  void *file_handle;
+  void *mapping_handle;
+#endif
+};
+
+#endif
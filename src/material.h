@@ -46,6 +46,7 @@ public:
   const glm::vec3& getEmittedColor() const { return emittedColor; }  
   float getRoughness() const { return roughness; } 
   bool hasTextureMap() const { return (textureFile != ""); } 
+  const std::string& getTextureFile() const { return textureFile; }
   GLuint getTextureID();
 
   // SHADE
@@ -6,6 +6,7 @@
 #include <string>
 #include <utility>
 #include <iterator>
+#include <map>
 #include <ios>
 #include <omp.h>
 #include <sstream>
@@ -23,6 +24,12 @@
 #include "ray.h"
 #include "hit.h"
 #include "camera.h"
+#include "bvh.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include "meshcache.h"
+#include "radixsort.h"
+#include "meshloader.h"
 
 
 // =======================================================================
@@ -30,28 +37,13 @@
 // =======================================================================
 
 Mesh::~Mesh() {
+  // the vertices, edges & faces are released with their pools
   unsigned int i;
-  for (i = 0; i < rasterized_primitive_faces.size(); i++) {
-    Face *f = rasterized_primitive_faces[i];
-    removeFaceEdges(f);
-    delete f;
-  }
-  if (subdivided_quads.size() != original_quads.size()) {
-    for (i = 0; i < subdivided_quads.size(); i++) {
-      Face *f = subdivided_quads[i];
-      removeFaceEdges(f);
-      delete f;
-    }
-  }
-  for (i = 0; i < original_quads.size(); i++) {
-    Face *f = original_quads[i];
-    removeFaceEdges(f);
-    delete f;
-  }
   for (i = 0; i < primitives.size(); i++) { delete primitives[i]; }
   for (i = 0; i < materials.size(); i++) { delete materials[i]; }
-  for (i = 0; i < vertices.size(); i++) { delete vertices[i]; }
   delete bbox;
+  delete quads_bvh;
+  delete rasterized_bvh;
 }
 
 // =======================================================================
@@ -61,7 +53,8 @@ Mesh::~Mesh() {
 Vertex* Mesh::addVertex(const glm::vec3 &position, int loc) {
   //int index = numVertices();
   //vertices.push_back(new Vertex(index,position));
-  vertices[loc] = new Vertex(loc, position);
+  vertices[loc] = new (vertex_pool.Allocate()) Vertex(loc, position);
+  geometry.setVertex(loc, position);
   // extend the bounding box to include this point
   if (bbox == NULL) 
     bbox = new BoundingBox(position,position);
@@ -71,7 +64,8 @@ Vertex* Mesh::addVertex(const glm::vec3 &position, int loc) {
 }
 Vertex* Mesh::addVertex(const glm::vec3 &position) {
   int index = numVertices();
-  vertices.push_back(new Vertex(index,position));
+  vertices.push_back(new (vertex_pool.Allocate()) Vertex(index,position));
+  geometry.setVertex(index, position);
   //vertices[loc] = new Vertex(loc, position);
   // extend the bounding box to include this point
   if (bbox == NULL) 
@@ -86,21 +80,51 @@ void Mesh::addPrimitive(Primitive* p) {
   p->addRasterizedFaces(this,args);
 }
 
-void Mesh::addFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material, enum FACE_TYPE face_type) {
+Face* Mesh::createFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material) {
   // create the face
-  Face *f = new Face(material);
+  Face *f = new (face_pool.Allocate()) Face(material);
   // create the edges
-  Edge *ea = new Edge(a,b,f);
-  Edge *eb = new Edge(b,c,f);
-  Edge *ec = new Edge(c,d,f);
-  Edge *ed = new Edge(d,a,f);
+  Edge *ea = new (edge_pool.Allocate()) Edge(a,b,f);
+  Edge *eb = new (edge_pool.Allocate()) Edge(b,c,f);
+  Edge *ec = new (edge_pool.Allocate()) Edge(c,d,f);
+  Edge *ed = new (edge_pool.Allocate()) Edge(d,a,f);
   // point the face to one of its edges
   f->setEdge(ea);
+  // and to its precomputed normal, area & centroid
+  f->setGeometryCache(&geometry,geometry.addQuad(a->getIndex(),b->getIndex(),c->getIndex(),d->getIndex()));
   // connect the edges to each other
   ea->setNext(eb);
   eb->setNext(ec);
   ec->setNext(ed);
   ed->setNext(ea);
+  return f;
+}
+
+void Mesh::registerFace(Face *f, enum FACE_TYPE face_type) {
+  // add the face to the appropriate master list
+  if (face_type == FACE_TYPE_ORIGINAL) {
+    original_quads.push_back(f);
+    subdivided_quads.push_back(f);
+  } else if (face_type == FACE_TYPE_RASTERIZED) {
+    rasterized_primitive_faces.push_back(f); 
+  } else {
+    assert (face_type == FACE_TYPE_SUBDIVIDED);
+    subdivided_quads.push_back(f);
+  }
+  // if it's a light, add it to that list too
+  if (glm::length(f->getMaterial()->getEmittedColor()) > 0 && face_type == FACE_TYPE_ORIGINAL) {
+    original_lights.push_back(f);
+  }
+}
+
+void Mesh::addFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material, enum FACE_TYPE face_type) {
+  IndexEdges();
+  // create the face & its edges
+  Face *f = createFace(a,b,c,d,material);
+  Edge *ea = f->getEdge();
+  Edge *eb = ea->getNext();
+  Edge *ec = eb->getNext();
+  Edge *ed = ec->getNext();
   // verify these edges aren't already in the mesh 
   // (which would be a bug, or a non-manifold mesh)
   assert (edges.find(std::make_pair(a,b)) == edges.end());
@@ -121,20 +145,125 @@ void Mesh::addFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *materia
   if (eb_op != edges.end()) { eb_op->second->setOpposite(eb); }
   if (ec_op != edges.end()) { ec_op->second->setOpposite(ec); }
   if (ed_op != edges.end()) { ed_op->second->setOpposite(ed); }
-  // add the face to the appropriate master list
-  if (face_type == FACE_TYPE_ORIGINAL) {
-    original_quads.push_back(f);
-    subdivided_quads.push_back(f);
-  } else if (face_type == FACE_TYPE_RASTERIZED) {
-    rasterized_primitive_faces.push_back(f); 
-  } else {
-    assert (face_type == FACE_TYPE_SUBDIVIDED);
-    subdivided_quads.push_back(f);
+  num_edges += 4;
+  registerFace(f,face_type);
+}
+
+void Mesh::addFaces(const std::vector<int> &quads, const std::vector<Material*> &face_materials,
+                    enum FACE_TYPE face_type, const int *opposites) {
+  int num_faces = face_materials.size();
+  assert ((int)quads.size() == 4*num_faces);
+  if (num_faces == 0) return;
+
+  // the faces & their edges are contiguous, face i owns edges 4*i..4*i+3
+  Face *faces = face_pool.Allocate(num_faces);
+  Edge *half_edges = edge_pool.Allocate(4*num_faces);
+  std::vector<int> slots(num_faces);
+  geometry.addQuads(&quads[0],num_faces,&slots[0]);
+#pragma omp parallel for
+  for (int i = 0; i < num_faces; i++) {
+    Face *f = new (faces+i) Face(face_materials[i]);
+    for (int j = 0; j < 4; j++) {
+      new (half_edges+4*i+j) Edge(vertices[quads[4*i+j]],vertices[quads[4*i+(j+1)%4]],f);
+    }
+    for (int j = 0; j < 4; j++) {
+      half_edges[4*i+j].setNext(half_edges+4*i+(j+1)%4);
+    }
+    f->setEdge(half_edges+4*i);
+    f->setGeometryCache(&geometry,slots[i]);
   }
-  // if it's a light, add it to that list too
-  if (glm::length(material->getEmittedColor()) > 0 && face_type == FACE_TYPE_ORIGINAL) {
-    original_lights.push_back(f);
+
+  // connect the opposite edges within this batch
+  std::vector<int> found;
+  bool match_existing = (opposites == NULL);
+  if (opposites == NULL) {
+    FindOpposites(quads,found);
+    opposites = &found[0];
+  }
+  for (int i = 0; i < 4*num_faces; i++) {
+    int o = opposites[i];
+    if (o > i) half_edges[i].setOpposite(half_edges+o);
+  }
+  // and with the edges already in the mesh (given opposites are complete)
+  if (match_existing && num_edges > 0) {
+    IndexEdges();
+    for (int i = 0; i < 4*num_faces; i++) {
+      if (opposites[i] != -1) continue;
+      Edge *e = half_edges+i;
+      edgeshashtype::iterator op = edges.find(std::make_pair(e->getEndVertex(),e->getStartVertex()));
+      if (op != edges.end() && op->second->getOpposite() == NULL) op->second->setOpposite(e);
+    }
+  }
+
+  for (int i = 0; i < num_faces; i++) {
+    registerFace(faces+i,face_type);
   }
+  num_edges += 4*num_faces;
+  edges.clear();
+  edge_table_valid = false;
+}
+
+// enough bits for any vertex index (at least 1)
+static int VertexIndexBits(int num_vertices) {
+  int bits = 1;
+  while (bits < 31 && (1 << bits) < num_vertices) bits++;
+  return bits;
+}
+
+void Mesh::FindOpposites(const std::vector<int> &quads, std::vector<int> &opposites) const {
+  // the key of an edge is its pair of vertex indices (smaller first),
+  // with the direction in the lowest bit.  after sorting, the two
+  // halves of an interior edge are next to each other.
+  int num_half_edges = quads.size();
+  int vertex_bits = VertexIndexBits(numVertices());
+  std::vector<unsigned long long> keys(num_half_edges);
+  std::vector<int> half_edges(num_half_edges);
+#pragma omp parallel for
+  for (int i = 0; i < num_half_edges; i++) {
+    unsigned long long a = quads[i];
+    unsigned long long b = quads[i - i%4 + (i+1)%4];
+    unsigned long long lo = std::min(a,b);
+    unsigned long long hi = std::max(a,b);
+    keys[i] = (((lo << vertex_bits) | hi) << 1) | (a > b ? 1 : 0);
+    half_edges[i] = i;
+  }
+  RadixSort(keys,half_edges,2*vertex_bits+1);
+
+  opposites.assign(num_half_edges,-1);
+#pragma omp parallel for
+  for (int i = 0; i < num_half_edges-1; i++) {
+    unsigned long long edge = keys[i] >> 1;
+    if ((keys[i+1] >> 1) != edge) continue;
+    // the same directed edge twice would be a bug, or a non-manifold mesh
+    assert (keys[i] != keys[i+1]);
+    // only pair exactly two halves
+    if (i > 0 && (keys[i-1] >> 1) == edge) continue;
+    if (i+2 < num_half_edges && (keys[i+2] >> 1) == edge) continue;
+    opposites[half_edges[i]] = half_edges[i+1];
+    opposites[half_edges[i+1]] = half_edges[i];
+  }
+}
+
+void Mesh::IndexEdges() const {
+  if (edge_table_valid) return;
+  edges.clear();
+  edges.reserve(num_edges);
+  // the live faces, as in the destructor
+  std::vector<const std::vector<Face*>*> lists;
+  lists.push_back(&original_quads);
+  if (subdivided_quads.size() != original_quads.size()) lists.push_back(&subdivided_quads);
+  lists.push_back(&rasterized_primitive_faces);
+  for (unsigned int i = 0; i < lists.size(); i++) {
+    for (unsigned int j = 0; j < lists[i]->size(); j++) {
+      Edge *e = (*lists[i])[j]->getEdge();
+      for (int k = 0; k < 4; k++, e = e->getNext()) {
+        assert (edges.find(std::make_pair(e->getStartVertex(),e->getEndVertex())) == edges.end());
+        edges[std::make_pair(e->getStartVertex(),e->getEndVertex())] = e;
+      }
+    }
+  }
+  assert ((int)edges.size() == num_edges);
+  edge_table_valid = true;
 }
 
 void Mesh::removeFaceEdges(Face *f) {
@@ -149,222 +278,157 @@ void Mesh::removeFaceEdges(Face *f) {
   Vertex *c = ec->getStartVertex();
   Vertex *d = ed->getStartVertex();
   // remove elements from master lists
-  edges.erase(std::make_pair(a,b)); 
-  edges.erase(std::make_pair(b,c)); 
-  edges.erase(std::make_pair(c,d)); 
-  edges.erase(std::make_pair(d,a)); 
+  if (f->getGeometryIndex() >= 0) geometry.removeQuad(f->getGeometryIndex());
+  if (edge_table_valid) {
+    edges.erase(std::make_pair(a,b)); 
+    edges.erase(std::make_pair(b,c)); 
+    edges.erase(std::make_pair(c,d)); 
+    edges.erase(std::make_pair(d,a)); 
+  }
+  num_edges -= 4;
   // clean up memory
-  delete ea;
-  delete eb;
-  delete ec;
-  delete ed;
+  destroyEdge(ea);
+  destroyEdge(eb);
+  destroyEdge(ec);
+  destroyEdge(ed);
+}
+
+// the storage goes back to the pools for reuse
+void Mesh::destroyFace(Face *f) {
+  f->~Face();
+  face_pool.Free(f);
+}
+
+void Mesh::destroyEdge(Edge *e) {
+  e->~Edge();
+  edge_pool.Free(e);
 }
 
 // ==============================================================================
 // EDGE HELPER FUNCTIONS
 
 Edge* Mesh::getEdge(Vertex *a, Vertex *b) const {
+  IndexEdges();
   edgeshashtype::const_iterator iter = edges.find(std::make_pair(a,b));
   if (iter == edges.end()) return NULL;
   return iter->second;
 }
 
-Vertex* Mesh::getChildVertex(Vertex *p1, Vertex *p2) const {
-  vphashtype::const_iterator iter = vertex_parents.find(std::make_pair(p1,p2)); 
-  if (iter == vertex_parents.end()) return NULL;
-  return iter->second; 
-}
-
-void Mesh::setParentsChild(Vertex *p1, Vertex *p2, Vertex *child) {
-  assert (vertex_parents.find(std::make_pair(p1,p2)) == vertex_parents.end());
-  vertex_parents[std::make_pair(p1,p2)] = child; 
-}
-
 //
 // ===============================================================================
 // the load function parses our (non-standard) extension of very simple .obj files
 // ===============================================================================
 
-void Mesh::Parallel(ArgParser *_args) {
-  time_t start, end;
-  time(&start);
-  //set up filename, open up original ifstream for counting number of points
+void Mesh::Parallel(ArgParser *_args, MeshLoader *loader) {
+  double start = omp_get_wtime();
   args = _args;
   std::string file = args->path+'/'+args->input_file;
-  std::ifstream objfile(file.c_str());
-  if (!objfile.good()) {
-    exit(1);
+
+  // reuse the binary cache from an earlier load of the same file
+  if (args->mesh_cache && MeshCache::Load(this,file)) {
+    std::cout << " load time: " << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
+    return;
   }
-  int num_verts = -1;
-  std::string token;
-  
-  do {
-    getline(objfile, token);
-    num_verts++;
+
+  // the .obj file is mapped into memory & scanned by all the threads
+  MappedFile objfile;
+  if (!objfile.Open(file)) {
+    std::cout << "ERROR! CANNOT OPEN " << file << std::endl;
+    exit(1);
   }
-  while ((token != "")&&(token != "\n"));
-  //sets the size of the vertex vector to be the number of vertex lines being read in
+  ObjParser parser(objfile.getData(),objfile.getSize());
+  if (!parser.Parse(omp_get_max_threads())) exit(1);
+  double parse_time = omp_get_wtime()-start;
+  double megabytes = objfile.getSize() / (1024.0*1024.0);
+  std::cout << " parsed " << megabytes << " MB in " << 1000*parse_time << " ms ("
+            << megabytes / std::max(parse_time,1e-9) << " MB/s)." << std::endl;
+
+  Material *default_material = new Material("",glm::vec3(0.5,0.5,0.5), glm::vec3(1,1,1), glm::vec3(0,0,0), 0.3);
+  Material *active_material = default_material;
+  camera = NULL;
+  background_color = glm::vec3(1,1,1);
+
+  // the vertices are created in parallel, each in its own slot
+  const std::vector<glm::vec3> &positions = parser.getPositions();
+  int num_verts = positions.size();
   setVertSize(num_verts);
-  //std::cerr << "hi ";
-  //now, set it back to the beginning. You still need to write the code for this one to parse the extra lines in front.
-
-  objfile.close();
-  objfile.open(file);
-  
-  //calculate the number of lines, etc for each thread to handle
-  const int nt = 8;
-  int extra_lines = num_verts%nt;
-  int lpt = num_verts/nt;
-  std::cout << "number of verts: " << num_verts << "\n";
-  // std::cout << "lines per thread: " << lpt << "\n";
-  // std::cout << "extra lines at beginning: " << extra_lines << "\n";
-  // std::cout << "opening extra file pointers...\n";
-  //each thread has its own ifstream
-  std::ifstream fp[nt];
-  for (int i = 0; i < nt; i++) {
-    //open new ifstream and seek it to the start of the points it will read
-    fp[i].open(file, std::ifstream::in);
-    std::string myfile = "../models/test" + std::to_string(i) + ".txt";
-    int temp_ct = 0;
-    std::string tok;
-    int num = i*lpt;
-    if (i < extra_lines) num += i;
-    else num += extra_lines;
-    while (temp_ct < num) {
-      //just skip the line and inc
-      getline(fp[i],tok);
-      temp_ct++;
-    }
-    //std::cout << "thread " << i << " will start at line " << temp_ct << "\n";
+  Vertex *block = (num_verts > 0) ? vertex_pool.Allocate(num_verts) : NULL;
+#pragma omp parallel for
+  for (int i = 0; i < num_verts; i++) {
+    vertices[i] = new (block+i) Vertex(i,positions[i]);
+    geometry.setVertex(i,positions[i]);
   }
-#pragma omp parallel for num_threads(nt)
   for (int i = 0; i < num_verts; i++) {
-    //each thread will getline with its respective fp
-    //need to add a lock for push_back to make sure shit doesn't hit the fan
-    int tn = omp_get_thread_num();
-    std::string tok;
-    getline(fp[tn], tok);
-    std::string toss_out;
-    float x, y, z;
-    std::stringstream ss(tok, std::ios_base::in);
-    ss >> toss_out >> x >> y >> z;
-    glm::vec3 pt(x,y,z);
-
-
-    #pragma omp critical
-    {
-      addVertex(pt, i);
-
-    }
+    if (bbox == NULL)
+      bbox = new BoundingBox(positions[i],positions[i]);
+    else
+      bbox->Extend(positions[i]);
   }
-
-  std::cout << "finished reading verts\n";
-  //
-  // there should be a line of space between these
-  // advance the objfile to count the number of face lines
-  do {
-    getline(objfile, token);
-    //std::cout << token << std::endl;
+  const std::vector<ObjParser::TextureCoordinate> &texture_coordinates = parser.getTextureCoordinates();
+  for (unsigned int i = 0; i < texture_coordinates.size(); i++) {
+    const ObjParser::TextureCoordinate &tc = texture_coordinates[i];
+    assert (tc.vertex >= 0 && tc.vertex < numVertices());
+    getVertex(tc.vertex)->setTextureCoordinates(tc.s,tc.t);
   }
-  while ((token != "")&&(token != "\n"));
-    Material* active_material = new Material("",glm::vec3(0.5,0.5,0.5), glm::vec3(1,1,1), glm::vec3(0,0,0), 0.3);
 
-  // for (int i = 0; i < vertices.size(); i++) {
-  //   glm::vec3 p = vertices[i]->get();
-  //   std::cerr << i;
-  //   std::cerr << ": " << p.x << ", " << p.y << ", " << p.z << std::endl;
-  // }
-  int face_start = objfile.tellg();
-  while (objfile >> token) {
-    if (token == "f") {
-      int a,b,c,d;
-      objfile >> a >> b >> c >> d;
-      a--;
-      b--;
-      c--;
-      d--;
-      //std::cout << a << " " << b << " " << c << " " << d << std::endl;
-      assert (a >= 0 && a < numVertices());
-      assert (b >= 0 && b < numVertices());
-      assert (c >= 0 && c < numVertices());
-      assert (d >= 0 && d < numVertices());
-      assert (active_material != NULL);
-      addOriginalQuad(getVertex(a),getVertex(b),getVertex(c),getVertex(d),active_material);
-
-    }
-    else if (token == "PerspectiveCamera") {
-      camera = new PerspectiveCamera();
-      objfile >> *(PerspectiveCamera*)camera;
-    } else if (token == "OrthographicCamera") {
-      camera = new OrthographicCamera();
-      objfile >> *(OrthographicCamera*)camera;
-    }
-    else {
-      continue;
+  // the other statements are parsed in order with the same code as
+  // Load.  a statement may span several lines (e.g., a camera), the
+  // lines it consumed are skipped.  the statements of ordinary .obj
+  // files we don't use (o, g, usemtl, smoothing groups, ...) are
+  // skipped, with one warning.  NOTE: primitives are rasterized after
+  // all of the .obj vertices have been added, so their vertices never
+  // shift the indices used by the faces.
+  const std::vector<size_t> &statements = parser.getStatements();
+  std::vector<Material*> statement_materials(statements.size());
+  MemoryStreamBuffer buffer(objfile.getData(),objfile.getSize());
+  std::istream istr(&buffer);
+  size_t consumed = 0;
+  std::map<std::string,int> skipped;
+  for (unsigned int i = 0; i < statements.size(); i++) {
+    if (statements[i] >= consumed) {
+      istr.clear();
+      buffer.setPosition(statements[i]);
+      std::string token;
+      istr >> token;
+      if (ParseStatement(token,istr,active_material)) {
+        consumed = buffer.getPosition();
+      } else {
+        skipped[token]++;
+      }
     }
+    statement_materials[i] = active_material;
   }
-  time(&end);
-  std::cout << "time elapsed: " << end - start << std::endl; 
-  /*
-  //now find number of faces
-  num_verts = 0;
-  do {
-    getline(objfile, token);
-    std::cout << token << std::endl;
-    num_verts++;
-  }
-  while ((token != "")&&(token != "\n"));
-  objfile.seekg(face_start);
-  std::cout << "number of face lines: " << num_verts;
-  //compute thread info
-  extra_lines = num_verts%nt;
-  lpt = num_verts/nt;
-  //advance threads to their starting positions
-  for (int i = 0; i < nt; i++) {
-    std::string tok;
-    // if ( i != nt -1) {
-    //   do {
-    //     getline(fp[i],tok);
-    //   }
-    //   while ((tok != "") && (tok != "\n"));
-    // }
-    fp[i].seekg(face_start);
-    int t = 0;
-    while (t < i*lpt+extra_lines) {
-      getline(fp[i], tok);
-      t++;
+  if (!skipped.empty() || parser.numSkippedTriangles() > 0) {
+    std::cout << "WARNING: skipped unsupported lines:";
+    for (std::map<std::string,int>::const_iterator itr = skipped.begin(); itr != skipped.end(); itr++) {
+      std::cout << " " << itr->first << " (" << itr->second << ")";
     }
+    if (parser.numSkippedTriangles() > 0) std::cout << " triangles (" << parser.numSkippedTriangles() << ")";
+    std::cout << std::endl;
   }
-  
-  Material* active_material = new Material("",glm::vec3(0.5,0.5,0.5), glm::vec3(1,1,1), glm::vec3(0,0,0), 0.3);
-  for (int i = 0; i < extra_lines; i++) {
-    getline(objfile, token);
-    std::stringstream ss(token);
-    std::string ignore;
-    int f,s,t,fr;
-    ss >> ignore >> f >> s >> t >> fr;
-    f--;s--;t--;fr--;
-    std::cerr << token << std::endl;;
-    addOriginalQuad(getVertex(f),getVertex(s),getVertex(t),getVertex(fr),active_material);
-  }
-#pragma omp parallel for num_threads(nt)
-  for (int i = 0; i < num_verts; i++) {
-    int tn = omp_get_thread_num();
-    std::string tok;
-    getline(fp[tn], tok);
-    std::string ignore;
-    int f, s, t, fr;
-    if (tok == "") continue;
-    std::stringstream ss(tok, std::ios_base::in);
-    ss >> ignore >> f >> s >> t >> fr;
-    f--;s--;t--;fr--;
-    #pragma omp critical
-    {
-      addOriginalQuad(getVertex(f),getVertex(s),getVertex(t),getVertex(fr),active_material);
-    }
+  // (the primitives have extended the bounding box, the faces add no vertices)
+  SetupCamera();
+
+  // a first look at the faces for the loading view, while the topology is built
+  if (loader != NULL) loader->addParsedGeometry(positions,parser.getQuads(),camera);
+
+  // finally the faces, each with the material active where it appeared
+  const std::vector<int> &quads = parser.getQuads();
+  const std::vector<int> &face_statements = parser.getFaceStatements();
+  std::vector<Material*> face_materials(parser.numFaces());
+  for (int i = 0; i < parser.numFaces(); i++) {
+    assert (quads[4*i+0] >= 0 && quads[4*i+0] < num_verts);
+    assert (quads[4*i+1] >= 0 && quads[4*i+1] < num_verts);
+    assert (quads[4*i+2] >= 0 && quads[4*i+2] < num_verts);
+    assert (quads[4*i+3] >= 0 && quads[4*i+3] < num_verts);
+    face_materials[i] = face_statements[i] < 0 ? default_material : statement_materials[face_statements[i]];
   }
-  std::cout << "finished assembling faces\n";
-  */
+  addOriginalQuads(quads,face_materials);
+  std::cout << " mesh loaded: " << numFaces() << " faces and " << numEdges() << " edges." << std::endl;
+
+  BuildAccelerationStructures();
+  if (args->mesh_cache) MeshCache::Save(this,file);
+  std::cout << " load time: " << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
 }
 
 
@@ -373,6 +437,9 @@ void Mesh::Load(ArgParser *_args) {
 
   std::string file = args->path+'/'+args->input_file;
 
+  // reuse the binary cache from an earlier load of the same file
+  if (args->mesh_cache && MeshCache::Load(this,file)) return;
+
   std::ifstream objfile(file.c_str());
   if (!objfile.good()) {
     std::cout << "ERROR! CANNOT OPEN " << file << std::endl;
@@ -409,69 +476,85 @@ void Mesh::Load(ArgParser *_args) {
       assert (d >= 0 && d < numVertices());
       assert (active_material != NULL);
       addOriginalQuad(getVertex(a),getVertex(b),getVertex(c),getVertex(d),active_material);
-    } else if (token == "s") {
-      float x,y,z,r;
-      objfile >> x >> y >> z >> r;
-      assert (active_material != NULL);
-      addPrimitive(new Sphere(glm::vec3(x,y,z),r,active_material));
-    } else if (token == "r") {
-      float x,y,z,h,r,r2;
-      objfile >> x >> y >> z >> h >> r >> r2;
-      assert (active_material != NULL);
-      addPrimitive(new CylinderRing(glm::vec3(x,y,z),h,r,r2,active_material));
-    } else if (token == "background_color") {
-      float r,g,b;
-      objfile >> r >> g >> b;
-      background_color = glm::vec3(r,g,b);
-    } else if (token == "PerspectiveCamera") {
-      camera = new PerspectiveCamera();
-      objfile >> *(PerspectiveCamera*)camera;
-    } else if (token == "OrthographicCamera") {
-      camera = new OrthographicCamera();
-      objfile >> *(OrthographicCamera*)camera;
-    } else if (token == "m") {
-      // this is not standard .obj format!!
-      // materials
-      int m;
-      objfile >> m;
-      assert (m >= 0 && m < (int)materials.size());
-      active_material = materials[m];
-    } else if (token == "material") {
-      // this is not standard .obj format!!
-      std::string texture_file = "";
-      glm::vec3 diffuse(0,0,0);
-      float r,g,b;
-      objfile >> token;
-      if (token == "diffuse") {
-	objfile >> r >> g >> b;
-	diffuse = glm::vec3(r,g,b);
-      } else {
-	assert (token == "texture_file");
-	objfile >> texture_file;
-	// prepend the directory name
-	texture_file = args->path + '/' + texture_file;
-      }
-      glm::vec3 reflective,emitted;      
-      objfile >> token >> r >> g >> b;
-      assert (token == "reflective");
-      reflective = glm::vec3(r,g,b);
-      float roughness = 0;
-      objfile >> token;
-      if (token == "roughness") {
-	objfile >> roughness;
-	objfile >> token;
-      } 
-      assert (token == "emitted");
-      objfile >> r >> g >> b;
-      emitted = glm::vec3(r,g,b);
-      materials.push_back(new Material(texture_file,diffuse,reflective,emitted,roughness));
-    } else {
+    } else if (!ParseStatement(token,objfile,active_material)) {
       std::cout << "UNKNOWN TOKEN " << token << std::endl;
       exit(0);
     }
   }
   std::cout << " mesh loaded: " << numFaces() << " faces and " << numEdges() << " edges." << std::endl;
 
+  SetupCamera();
+  BuildAccelerationStructures();
+  if (args->mesh_cache) MeshCache::Save(this,file);
+}
+
+// the statements shared by Load & Parallel (everything except v, vt & f)
+bool Mesh::ParseStatement(const std::string &token, std::istream &istr, Material *&active_material) {
+  if (token == "s") {
+    // (not a smoothing group, "s 1" or "s off" fails here)
+    float x,y,z,r;
+    if (!(istr >> x >> y >> z >> r)) return false;
+    assert (active_material != NULL);
+    addPrimitive(new Sphere(glm::vec3(x,y,z),r,active_material));
+  } else if (token == "r") {
+    float x,y,z,h,r,r2;
+    istr >> x >> y >> z >> h >> r >> r2;
+    assert (active_material != NULL);
+    addPrimitive(new CylinderRing(glm::vec3(x,y,z),h,r,r2,active_material));
+  } else if (token == "background_color") {
+    float r,g,b;
+    istr >> r >> g >> b;
+    background_color = glm::vec3(r,g,b);
+  } else if (token == "PerspectiveCamera") {
+    camera = new PerspectiveCamera();
+    istr >> *(PerspectiveCamera*)camera;
+  } else if (token == "OrthographicCamera") {
+    camera = new OrthographicCamera();
+    istr >> *(OrthographicCamera*)camera;
+  } else if (token == "m") {
+    // this is not standard .obj format!!
+    // materials
+    int m;
+    istr >> m;
+    assert (m >= 0 && m < (int)materials.size());
+    active_material = materials[m];
+  } else if (token == "material") {
+    // this is not standard .obj format!!
+    std::string keyword;
+    std::string texture_file = "";
+    glm::vec3 diffuse(0,0,0);
+    float r,g,b;
+    istr >> keyword;
+    if (keyword == "diffuse") {
+      istr >> r >> g >> b;
+      diffuse = glm::vec3(r,g,b);
+    } else {
+      assert (keyword == "texture_file");
+      istr >> texture_file;
+      // prepend the directory name
+      texture_file = args->path + '/' + texture_file;
+    }
+    glm::vec3 reflective,emitted;      
+    istr >> keyword >> r >> g >> b;
+    assert (keyword == "reflective");
+    reflective = glm::vec3(r,g,b);
+    float roughness = 0;
+    istr >> keyword;
+    if (keyword == "roughness") {
+      istr >> roughness;
+      istr >> keyword;
+    } 
+    assert (keyword == "emitted");
+    istr >> r >> g >> b;
+    emitted = glm::vec3(r,g,b);
+    materials.push_back(new Material(texture_file,diffuse,reflective,emitted,roughness));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Mesh::SetupCamera() {
   if (camera == NULL) {
     // if not initialized, position a perspective camera and scale it so it fits in the window
     assert (bbox != NULL);
@@ -484,81 +567,282 @@ void Mesh::Load(ArgParser *_args) {
 }
 
 // =================================================================
-// SUBDIVISION
+// ACCELERATION STRUCTURES
 // =================================================================
 
-Vertex* Mesh::AddEdgeVertex(Vertex *a, Vertex *b) {
-  Vertex *v = getChildVertex(a,b);
-  if (v != NULL) return v;
-  glm::vec3 pos = 0.5f*a->get() + 0.5f*b->get();
-  float s = 0.5f*a->get_s() + 0.5f*b->get_s();
-  float t = 0.5f*a->get_t() + 0.5f*b->get_t();
-  v = addVertex(pos);
-  v->setTextureCoordinates(s,t);
-  setParentsChild(a,b,v);
-  return v;
+void Mesh::BuildAccelerationStructures() {
+  double start = omp_get_wtime();
+  if (quads_bvh == NULL) quads_bvh = new BVH();
+  if (rasterized_bvh == NULL) rasterized_bvh = new BVH();
+  quads_bvh->Build(original_quads,geometry);
+  rasterized_bvh->Build(rasterized_primitive_faces,geometry);
+  std::cout << " bvh built: " << quads_bvh->numNodes() + rasterized_bvh->numNodes() << " nodes in "
+            << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
 }
 
-Vertex* Mesh::AddMidVertex(Vertex *a, Vertex *b, Vertex *c, Vertex *d) {
-  glm::vec3 pos = 0.25f*a->get() + 0.25f*b->get() + 0.25f*c->get() + 0.25f*d->get();
-  float s = 0.25f*a->get_s() + 0.25f*b->get_s() + 0.25f*c->get_s() + 0.25f*d->get_s();
-  float t = 0.25f*a->get_t() + 0.25f*b->get_t() + 0.25f*c->get_t() + 0.25f*d->get_t();
-  Vertex *v = addVertex(pos);
-  v->setTextureCoordinates(s,t);
-  return v;
+void Mesh::RefitAccelerationStructures() {
+  if (quads_bvh != NULL) quads_bvh->Refit();
+  if (rasterized_bvh != NULL) rasterized_bvh->Refit();
 }
 
+// =================================================================
+// SUBDIVISION
+// =================================================================
+// Every quad is split into 4, in phases that each run in parallel over
+// the faces, the edges or the vertices:
+//   1. number the unique edges (the two halves of an interior edge are
+//      paired by sorting)
+//   2. create a point on every edge & in the middle of every face (&
+//      with Catmull-Clark smoothing, a new point for every corner)
+//   3. write the vertex indices & opposite half-edges of the new quads
+//   4. replace the old quads with the new ones in one bulk add (& drop
+//      the old points no longer used)
+// The midpoint split keeps the corners where they are.  Catmull-Clark
+// moves them, so the corners are copied rather than moved: the original
+// quads (used for ray tracing) share those vertices.
+
 void Mesh::Subdivision() {
+  double start = omp_get_wtime();
+  bool catmull_clark = (args != NULL && args->catmull_clark);
 
   bool first_subdivision = false;
   if (original_quads.size() == subdivided_quads.size()) {
     first_subdivision = true;
+    first_subdivided_vertex = numVertices();
   }
 
-  std::vector<Face*> tmp = subdivided_quads;
-  subdivided_quads.clear();
-  
-  for (unsigned int i = 0; i < tmp.size(); i++) {
-    Face *f = tmp[i];
-    
-    Vertex *a = (*f)[0];
-    Vertex *b = (*f)[1];
-    Vertex *c = (*f)[2];
-    Vertex *d = (*f)[3];
-    // add new vertices on the edges
-    Vertex *ab = AddEdgeVertex(a,b);
-    Vertex *bc = AddEdgeVertex(b,c);
-    Vertex *cd = AddEdgeVertex(c,d);
-    Vertex *da = AddEdgeVertex(d,a);
-    // add new point in the middle of the patch
-    Vertex *mid = AddMidVertex(a,b,c,d);
-
-    assert (getEdge(a,b) != NULL);
-    assert (getEdge(b,c) != NULL);
-    assert (getEdge(c,d) != NULL);
-    assert (getEdge(d,a) != NULL);
-
-    // copy the color and emission from the old patch to the new
-    Material *material = f->getMaterial();
-    if (!first_subdivision) {
-      removeFaceEdges(f);
-      delete f;
+  int num_faces = subdivided_quads.size();
+  if (num_faces == 0) return;
+  int num_half_edges = 4*num_faces;
+  int num_old_vertices = numVertices();
+  // half-edge 4*i+j of face i starts at its j-th vertex
+  std::vector<int> quads(num_half_edges);
+#pragma omp parallel for
+  for (int i = 0; i < num_faces; i++) {
+    Face *f = subdivided_quads[i];
+    for (int j = 0; j < 4; j++) quads[4*i+j] = (*f)[j]->getIndex();
+  }
+
+  // 1. UNIQUE EDGES
+  // an edge belongs to its first half (or its only half, on a boundary)
+  std::vector<int> opposites;
+  FindOpposites(quads,opposites);
+  std::vector<int> edge_of(num_half_edges);
+  int num_unique_edges = 0;
+  for (int i = 0; i < num_half_edges; i++) {
+    edge_of[i] = num_unique_edges;
+    if (opposites[i] == -1 || opposites[i] > i) num_unique_edges++;
+  }
+#pragma omp parallel for
+  for (int i = 0; i < num_half_edges; i++) {
+    if (opposites[i] != -1 && opposites[i] < i) edge_of[i] = edge_of[opposites[i]];
+  }
+
+  // with smoothing, the corners are grouped by vertex (sorted by index)
+  std::vector<unsigned long long> corner_keys;
+  std::vector<int> corners;
+  std::vector<int> corner_groups;
+  if (catmull_clark) {
+    corner_keys.resize(num_half_edges);
+    corners.resize(num_half_edges);
+#pragma omp parallel for
+    for (int i = 0; i < num_half_edges; i++) {
+      corner_keys[i] = quads[i];
+      corners[i] = i;
+    }
+    RadixSort(corner_keys,corners,VertexIndexBits(num_old_vertices));
+    for (int i = 0; i < num_half_edges; i++) {
+      if (i == 0 || corner_keys[i] != corner_keys[i-1]) corner_groups.push_back(i);
+    }
+    corner_groups.push_back(num_half_edges);
+  }
+  int num_corner_points = catmull_clark ? (int)corner_groups.size()-1 : 0;
+
+  // 2. NEW POINTS
+  // the edge points, then the face points, then the corner points
+  int first_edge_point = num_old_vertices;
+  int first_face_point = first_edge_point + num_unique_edges;
+  int first_corner_point = first_face_point + num_faces;
+  int num_new_vertices = num_unique_edges + num_faces + num_corner_points;
+  Vertex *new_vertices = vertex_pool.Allocate(num_new_vertices);
+  vertices.resize(num_old_vertices + num_new_vertices);
+  geometry.resizeVertices(num_old_vertices + num_new_vertices);
+  // (all of the new points are averages of the old ones, so the
+  // bounding box doesn't change)
+
+#pragma omp parallel for
+  for (int i = 0; i < num_faces; i++) {
+    Vertex *a = vertices[quads[4*i+0]];
+    Vertex *b = vertices[quads[4*i+1]];
+    Vertex *c = vertices[quads[4*i+2]];
+    Vertex *d = vertices[quads[4*i+3]];
+    glm::vec3 pos = 0.25f*a->get() + 0.25f*b->get() + 0.25f*c->get() + 0.25f*d->get();
+    float s = 0.25f*a->get_s() + 0.25f*b->get_s() + 0.25f*c->get_s() + 0.25f*d->get_s();
+    float t = 0.25f*a->get_t() + 0.25f*b->get_t() + 0.25f*c->get_t() + 0.25f*d->get_t();
+    createVertex(new_vertices+num_unique_edges+i,first_face_point+i,pos,s,t);
+  }
+
+#pragma omp parallel for
+  for (int i = 0; i < num_half_edges; i++) {
+    int o = opposites[i];
+    if (o != -1 && o < i) continue;
+    Vertex *a = vertices[quads[i]];
+    Vertex *b = vertices[quads[i - i%4 + (i+1)%4]];
+    glm::vec3 pos = 0.5f*a->get() + 0.5f*b->get();
+    if (catmull_clark && o != -1) {
+      // an interior edge point also averages the 2 face points
+      pos = 0.25f*(a->get() + b->get() +
+                   vertices[first_face_point + i/4]->get() +
+                   vertices[first_face_point + o/4]->get());
+    }
+    float s = 0.5f*a->get_s() + 0.5f*b->get_s();
+    float t = 0.5f*a->get_t() + 0.5f*b->get_t();
+    createVertex(new_vertices+edge_of[i],first_edge_point+edge_of[i],pos,s,t);
+  }
+
+  // the new index of each old vertex (the same vertex for the midpoint split)
+  std::vector<int> corner_of;
+  if (catmull_clark) {
+    corner_of.resize(num_old_vertices,-1);
+#pragma omp parallel for schedule(dynamic,1024)
+    for (int g = 0; g < num_corner_points; g++) {
+      Vertex *v = vertices[corner_keys[corner_groups[g]]];
+      glm::vec3 pos = CatmullClarkCorner(v,&corners[corner_groups[g]],corner_groups[g+1]-corner_groups[g],
+                                         quads,opposites,first_face_point);
+      createVertex(new_vertices+num_unique_edges+num_faces+g,first_corner_point+g,pos,v->get_s(),v->get_t());
+      corner_of[v->getIndex()] = first_corner_point+g;
+    }
+  }
+
+  // 3. NEW QUADS
+  // child k of face i is (corner k, edge point k, face point, edge point
+  // k-1).  the outer halves of the children are opposite the children
+  // of the neighbor across the old edge, the inner halves are opposite
+  // the neighboring children of the same face.
+  std::vector<int> new_quads(4*num_half_edges);
+  std::vector<int> new_opposites(4*num_half_edges);
+  std::vector<Material*> new_materials(num_half_edges);
+#pragma omp parallel for
+  for (int i = 0; i < num_faces; i++) {
+    Material *material = subdivided_quads[i]->getMaterial();
+    for (int k = 0; k < 4; k++) {
+      int child = 4*i+k;
+      // the old half-edges leaving & entering corner k
+      int out = 4*i+k;
+      int in = 4*i+(k+3)%4;
+      int *q = &new_quads[4*child];
+      q[0] = catmull_clark ? corner_of[quads[out]] : quads[out];
+      q[1] = first_edge_point + edge_of[out];
+      q[2] = first_face_point + i;
+      q[3] = first_edge_point + edge_of[in];
+      int *o = &new_opposites[4*child];
+      int out_op = opposites[out];
+      int in_op = opposites[in];
+      o[0] = (out_op == -1) ? -1 : 4*(out_op - out_op%4 + (out_op+1)%4) + 3;
+      o[1] = 4*(4*i+(k+1)%4) + 2;
+      o[2] = 4*(4*i+(k+3)%4) + 1;
+      o[3] = (in_op == -1) ? -1 : 4*in_op;
+      new_materials[child] = material;
     }
+  }
+
+  // 4. REBUILD
+  // the original quads are kept for ray tracing, after that the
+  // previous level is discarded
+  if (!first_subdivision) {
+    edges.clear();
+    edge_table_valid = false;
+    for (int i = 0; i < num_faces; i++) {
+      removeFaceEdges(subdivided_quads[i]);
+      destroyFace(subdivided_quads[i]);
+    }
+  }
+  subdivided_quads.clear();
+  if (!first_subdivision) CompactSubdividedVertices(new_quads);
+  addFaces(new_quads,new_materials,FACE_TYPE_SUBDIVIDED,&new_opposites[0]);
+
+  std::cout << " subdivided" << (catmull_clark ? " (catmull-clark): " : ": ") << numFaces() << " faces in "
+            << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
 
-    // create the new faces
-    addSubdividedQuad(a,ab,mid,da,material);
-    addSubdividedQuad(b,bc,mid,ab,material);
-    addSubdividedQuad(c,cd,mid,bc,material);
-    addSubdividedQuad(d,da,mid,cd,material);
-
-    assert (getEdge(a,ab) != NULL);
-    assert (getEdge(ab,b) != NULL);
-    assert (getEdge(b,bc) != NULL);
-    assert (getEdge(bc,c) != NULL);
-    assert (getEdge(c,cd) != NULL);
-    assert (getEdge(cd,d) != NULL);
-    assert (getEdge(d,da) != NULL);
-    assert (getEdge(da,a) != NULL);
+  // (a no-op unless the vertices of the ray traced quads moved)
+  RefitAccelerationStructures();
+}
+
+// with Catmull-Clark smoothing the corners are copied, so the points of
+// the level just discarded are used by no face.  the original quads (&
+// primitives) only use the vertices before the first subdivision, so
+// only the subdivision points are checked.  the ones still used are
+// moved down (in order) to fill the gaps.
+void Mesh::CompactSubdividedVertices(std::vector<int> &new_quads) {
+  int first = first_subdivided_vertex;
+  int num_vertices = numVertices();
+  assert (first >= 0 && first <= num_vertices);
+  std::vector<char> used(num_vertices-first,0);
+  for (unsigned int i = 0; i < new_quads.size(); i++) {
+    if (new_quads[i] >= first) used[new_quads[i]-first] = 1;
+  }
+  std::vector<int> new_index(num_vertices-first);
+  int kept = first;
+  for (int i = first; i < num_vertices; i++) {
+    if (used[i-first]) {
+      new_index[i-first] = kept;
+      if (kept != i) {
+        vertices[kept] = vertices[i];
+        vertices[kept]->setIndex(kept);
+        geometry.setVertex(kept,vertices[kept]->get());
+      }
+      kept++;
+    } else {
+      vertices[i]->~Vertex();
+      vertex_pool.Free(vertices[i]);
+    }
   }
+  if (kept == num_vertices) return;
+  vertices.resize(kept);
+  geometry.resizeVertices(kept);
+#pragma omp parallel for
+  for (int i = 0; i < (int)new_quads.size(); i++) {
+    if (new_quads[i] >= first) new_quads[i] = new_index[new_quads[i]-first];
+  }
+}
+
+void Mesh::createVertex(Vertex *storage, int index, const glm::vec3 &pos, float s, float t) {
+  // the vertex list & the geometry mirror are already big enough, so
+  // this is safe to call from a parallel loop
+  Vertex *v = new (storage) Vertex(index,pos);
+  v->setTextureCoordinates(s,t);
+  vertices[index] = v;
+  geometry.setVertex(index,pos);
 }
 
+glm::vec3 Mesh::CatmullClarkCorner(Vertex *v, const int *corners, int num_corners,
+                                   const std::vector<int> &quads, const std::vector<int> &opposites,
+                                   int first_face_point) const {
+  // corners are the old half-edges leaving v, one per adjacent face
+  const glm::vec3 &p = v->get();
+  glm::vec3 face_sum(0,0,0);
+  glm::vec3 edge_sum(0,0,0);
+  glm::vec3 boundary_sum(0,0,0);
+  int num_boundary = 0;
+  for (int i = 0; i < num_corners; i++) {
+    int out = corners[i];
+    int in = out - out%4 + (out+3)%4;
+    face_sum += vertices[first_face_point + out/4]->get();
+    const glm::vec3 &next = vertices[quads[out - out%4 + (out+1)%4]]->get();
+    edge_sum += 0.5f*(p + next);
+    if (opposites[out] == -1) { boundary_sum += next; num_boundary++; }
+    // a boundary edge coming in has no matching half leaving v
+    if (opposites[in] == -1) { boundary_sum += vertices[quads[in]]->get(); num_boundary++; }
+  }
+  if (num_boundary == 0) {
+    // (F + 2R + (n-3)P) / n, with F & R the averages of the adjacent
+    // face points & edge midpoints
+    float n = num_corners;
+    return (face_sum/n + 2.0f*edge_sum/n + (n-3.0f)*p) / n;
+  } else if (num_boundary == 2) {
+    // on the boundary only the 2 boundary neighbors count
+    return 0.75f*p + 0.125f*boundary_sum;
+  }
+  // a corner where several boundaries meet (non-manifold) stays put
+  return p;
+}
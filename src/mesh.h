@@ -6,6 +6,8 @@
 #include <vector>
 #include "hash.h"
 #include "material.h"
+#include "geometrycache.h"
+#include "pool.h"
 
 class Vertex;
 class Edge;
@@ -16,6 +18,8 @@ class ArgParser;
 class Ray;
 class Hit;
 class Camera;
+class BVH;
+class MeshLoader;
 
 enum FACE_TYPE { FACE_TYPE_ORIGINAL, FACE_TYPE_RASTERIZED, FACE_TYPE_SUBDIVIDED };
 
@@ -28,14 +32,19 @@ enum FACE_TYPE { FACE_TYPE_ORIGINAL, FACE_TYPE_RASTERIZED, FACE_TYPE_SUBDIVIDED
 
 class Mesh {
 
+  // the binary cache reads & writes the representation directly
+  friend class MeshCache;
+
 public:
 
   // ===============================
   // CONSTRUCTOR & DESTRUCTOR & LOAD
-  Mesh() { bbox = NULL; }
+  Mesh() { bbox = NULL; quads_bvh = NULL; rasterized_bvh = NULL; num_edges = 0; edge_table_valid = true;
+           first_subdivided_vertex = -1; }
   virtual ~Mesh();
   void Load(ArgParser *_args);
-  void Parallel(ArgParser *_args);
+  // the loader (if any) is given the parsed faces before the topology is built
+  void Parallel(ArgParser *_args, MeshLoader *loader = NULL);
     
   // ========
   // VERTICES
@@ -46,18 +55,13 @@ public:
   Vertex* getVertex(int i) const {
     assert (i >= 0 && i < numVertices());
     return vertices[i]; }
-  // this creates a relationship between 3 vertices (2 parents, 1 child)
-  void setParentsChild(Vertex *p1, Vertex *p2, Vertex *child);
-  // this accessor will find a child vertex (if it exists) when given
-  // two parent vertices
-  Vertex* getChildVertex(Vertex *p1, Vertex *p2) const;
 
   // =====
   // EDGES
-  int numEdges() const { return edges.size(); }
+  int numEdges() const { return num_edges; }
   // this efficiently looks for an edge with the given vertices, using a hash table
   Edge* getEdge(Vertex *a, Vertex *b) const;
-  const edgeshashtype& getEdges() const { return edges; }
+  const edgeshashtype& getEdges() const { IndexEdges(); return edges; }
 
   // =================
   // ACCESS THE LIGHTS
@@ -99,28 +103,74 @@ public:
     addFace(a,b,c,d,material,FACE_TYPE_ORIGINAL); }
   void addSubdividedQuad(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material) {
     addFace(a,b,c,d,material,FACE_TYPE_SUBDIVIDED); }
-
-
+  // add many quads at once: 4 vertex indices & a material per face.
+  // the opposite half-edges (4*face+i, or -1) are found by sorting
+  // the edges (& matched with the edges already in the mesh) unless
+  // they are given
+  void addOriginalQuads(const std::vector<int> &quads, const std::vector<Material*> &face_materials,
+                        const int *opposites = NULL) {
+    addFaces(quads,face_materials,FACE_TYPE_ORIGINAL,opposites); }
+
+
+
+  // ===========================================
+  // ACCELERATION STRUCTURES (for ray tracing)
+  // built once the geometry is loaded
+  void BuildAccelerationStructures();
+  // after vertices move (but the faces stay the same) only the boxes are
+  // updated, nothing is done if the ray traced faces didn't move
+  void RefitAccelerationStructures();
+  const BVH* getOriginalQuadsBVH() const { return quads_bvh; }
+  const BVH* getRasterizedPrimitiveFacesBVH() const { return rasterized_bvh; }
 
   // ===============
   // OTHER ACCESSORS
   BoundingBox* getBoundingBox() const { return bbox; }
+  // flat positions, quad indices, normals, areas & centroids
+  const GeometryCache& getGeometryCache() const { return geometry; }
+  // the storage of the vertices, faces & edges
+  const Pool<Vertex>& getVertexPool() const { return vertex_pool; }
+  const Pool<Face>& getFacePool() const { return face_pool; }
+  const Pool<Edge>& getEdgePool() const { return edge_pool; }
 
   // ===============
   // OTHER FUNCTIONS
+  // split every quad into 4, smoothing with Catmull-Clark if requested
   void Subdivision();
 
 private:
 
   // ==================================================
   // HELPER FUNCTIONS FOR CREATING/SUBDIVIDING GEOMETRY
-  Vertex* AddEdgeVertex(Vertex *a, Vertex *b);
-  Vertex* AddMidVertex(Vertex *a, Vertex *b, Vertex *c, Vertex *d);
+  // construct a subdivision point in preallocated storage
+  void createVertex(Vertex *storage, int index, const glm::vec3 &pos, float s, float t);
+  // the smoothed position of an old vertex, from the old half-edges leaving it
+  glm::vec3 CatmullClarkCorner(Vertex *v, const int *corners, int num_corners,
+                               const std::vector<int> &quads, const std::vector<int> &opposites,
+                               int first_face_point) const;
   void addFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material, enum FACE_TYPE face_type);
+  void addFaces(const std::vector<int> &quads, const std::vector<Material*> &face_materials,
+                enum FACE_TYPE face_type, const int *opposites);
+  void FindOpposites(const std::vector<int> &quads, std::vector<int> &opposites) const;
+  // drop the subdivision points no longer used by the new level's quads
+  void CompactSubdividedVertices(std::vector<int> &new_quads);
+  // (re)build the edge table if a bulk add made it stale
+  void IndexEdges() const;
+  void destroyFace(Face *f);
+  void destroyEdge(Edge *e);
+  // the pieces of addFace: a face with its 4 linked edges (not yet in
+  // the edge table), and adding a finished face to the face lists
+  Face* createFace(Vertex *a, Vertex *b, Vertex *c, Vertex *d, Material *material);
+  void registerFace(Face *f, enum FACE_TYPE face_type);
   void removeFaceEdges(Face *f);
   void addPrimitive(Primitive *p); 
+  // parse a material, primitive, camera, etc. (returns false for an unknown token)
+  bool ParseStatement(const std::string &token, std::istream &istr, Material *&active_material);
+  // place a default camera if the file didn't have one
+  void SetupCamera();
   void setVertSize(int i) {
     vertices = std::vector<Vertex*>(i);
+    geometry.resizeVertices(i);
   }
 
   // ==============
@@ -134,11 +184,26 @@ private:
 
   // the bounding box of all rasterized faces in the scene
   BoundingBox *bbox; 
+  // hierarchies over the original quads & the rasterized primitive faces
+  BVH *quads_bvh;
+  BVH *rasterized_bvh;
 
   // the vertices & edges used by all quads (including rasterized primitives)
   std::vector<Vertex*> vertices;  
-  edgeshashtype edges;
-  vphashtype vertex_parents;
+  // the edge table is only needed by the per face edits, so a bulk add
+  // leaves it stale & it is rebuilt on first use
+  mutable edgeshashtype edges;
+  mutable bool edge_table_valid;
+  int num_edges;
+  // the vertices from here on were made by subdivision (-1 before the first)
+  int first_subdivided_vertex;
+  // storage for the vertices, faces & edges
+  Pool<Vertex> vertex_pool;
+  Pool<Face> face_pool;
+  Pool<Edge> edge_pool;
+  // read only mirror of the vertices & faces, updated by addVertex,
+  // addFace & removeFaceEdges
+  GeometryCache geometry;
 
   // the quads from the .obj file (before subdivision)
   std::vector<Face*> original_quads;
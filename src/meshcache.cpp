@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include "meshcache.h"
+#include "mesh.h"
+#include "mappedfile.h"
+#include "argparser.h"
+#include "vertex.h"
+#include "edge.h"
+#include "face.h"
+#include "camera.h"
+#include "boundingbox.h"
+#include "bvh.h"
+
+// bump this whenever the layout below changes
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_BYTE_ORDER 0x01020304
+
+// ==================================================================
+// FILE LAYOUT
+//   header
+//   float positions[3*num_vertices]
+//   float texture_coordinates[2*num_vertices]
+//   int   quads[4*num_faces]             vertex indices
+//   int   opposites[4*num_faces]         half-edge 4*face+i, or -1
+//   int   face_materials[num_faces]
+//   num_materials x material record (+ texture file name)
+//   camera (text, as written by operator<<)
+//   BVH (see BVH::Write)
+// every section is padded to a multiple of 4 bytes
+
+struct MeshCacheHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int byte_order;
+  unsigned long long source_size;
+  long long source_mtime;
+  int num_vertices;
+  int num_faces;
+  int num_materials;
+  int camera_size;
+  float background_color[3];
+  int padding;
+};
+
+struct MeshCacheMaterial {
+  float diffuse[3];
+  float reflective[3];
+  float emitted[3];
+  float roughness;
+  // 0 for materials that are not in Mesh::materials (e.g., the default material)
+  int listed;
+  int texture_file_size;
+};
+
+static const char MESH_CACHE_MAGIC[8] = { 'R','I','G','M','E','S','H','\0' };
+
+// ==================================================================
+// HELPER FUNCTIONS
+
+static bool GetSourceInfo(const std::string &filename, unsigned long long &size, long long &mtime) {
+  struct stat st;
+  if (stat(filename.c_str(),&st) != 0) return false;
+  size = st.st_size;
+#if defined(__linux__)
+  mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+  mtime = (long long)st.st_mtime;
+#endif
+  return true;
+}
+
+static void Append(std::vector<char> &out, const void *data, size_t bytes) {
+  out.insert(out.end(),(const char*)data,(const char*)data+bytes);
+  // keep every section 4 byte aligned
+  while (out.size() % 4 != 0) out.push_back('\0');
+}
+
+// a bounds checked cursor over the mapped file
+class MeshCacheReader {
+public:
+  MeshCacheReader(const char *begin, const char *_end) : p(begin), end(_end) {}
+  template <class T> bool Take(const T *&ptr, size_t count) {
+    size_t bytes = count*sizeof(T);
+    if ((size_t)(end-p) < bytes) return false;
+    ptr = (const T*)p;
+    // skip the padding after the section
+    size_t padded = (bytes+3) & ~(size_t)3;
+    p += std::min(padded,(size_t)(end-p));
+    return true;
+  }
+  const char *p;
+  const char *end;
+};
+
+// ==================================================================
+// SAVE
+// ==================================================================
+
+bool MeshCache::Save(const Mesh *mesh, const std::string &obj_file) {
+  // only a freshly loaded mesh made of .obj quads can be cached
+  if (mesh->primitives.size() != 0 ||
+      mesh->subdivided_quads.size() != mesh->original_quads.size() ||
+      mesh->quads_bvh == NULL || mesh->camera == NULL) return false;
+
+  MeshCacheHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,MESH_CACHE_MAGIC,sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.byte_order = MESH_CACHE_BYTE_ORDER;
+  if (!GetSourceInfo(obj_file,header.source_size,header.source_mtime)) return false;
+  header.num_vertices = mesh->numVertices();
+  header.num_faces = mesh->original_quads.size();
+  for (int i = 0; i < 3; i++) header.background_color[i] = mesh->background_color[i];
+
+  // vertices
+  std::vector<float> positions(3*header.num_vertices);
+  std::vector<float> texture_coordinates(2*header.num_vertices);
+  for (int i = 0; i < header.num_vertices; i++) {
+    Vertex *v = mesh->getVertex(i);
+    positions[3*i+0] = v->get().x;
+    positions[3*i+1] = v->get().y;
+    positions[3*i+2] = v->get().z;
+    texture_coordinates[2*i+0] = v->get_s();
+    texture_coordinates[2*i+1] = v->get_t();
+  }
+
+  // faces, materials & the opposite half-edges
+  std::map<Material*,int> material_index;
+  std::vector<Material*> materials = mesh->materials;
+  for (unsigned int i = 0; i < materials.size(); i++) material_index[materials[i]] = i;
+  std::map<Face*,int> face_index;
+  for (int i = 0; i < header.num_faces; i++) face_index[mesh->original_quads[i]] = i;
+  std::vector<int> quads(4*header.num_faces);
+  std::vector<int> opposites(4*header.num_faces,-1);
+  std::vector<int> face_materials(header.num_faces);
+  for (int i = 0; i < header.num_faces; i++) {
+    Face *f = mesh->original_quads[i];
+    Edge *e = f->getEdge();
+    for (int j = 0; j < 4; j++, e = e->getNext()) {
+      quads[4*i+j] = e->getStartVertex()->getIndex();
+      Edge *opposite = e->getOpposite();
+      if (opposite == NULL) continue;
+      Face *g = opposite->getFace();
+      assert (face_index.find(g) != face_index.end());
+      int k = 0;
+      for (Edge *e2 = g->getEdge(); e2 != opposite; e2 = e2->getNext()) k++;
+      opposites[4*i+j] = 4*face_index[g]+k;
+    }
+    Material *m = f->getMaterial();
+    if (material_index.find(m) == material_index.end()) {
+      material_index[m] = materials.size();
+      materials.push_back(m);
+    }
+    face_materials[i] = material_index[m];
+  }
+  header.num_materials = materials.size();
+
+  std::ostringstream camera_text;
+  camera_text << *mesh->camera;
+  std::string camera_string = camera_text.str();
+  header.camera_size = camera_string.size();
+
+  std::vector<char> out;
+  Append(out,&header,sizeof(header));
+  Append(out,positions.data(),positions.size()*sizeof(float));
+  Append(out,texture_coordinates.data(),texture_coordinates.size()*sizeof(float));
+  Append(out,quads.data(),quads.size()*sizeof(int));
+  Append(out,opposites.data(),opposites.size()*sizeof(int));
+  Append(out,face_materials.data(),face_materials.size()*sizeof(int));
+  for (unsigned int i = 0; i < materials.size(); i++) {
+    Material *m = materials[i];
+    MeshCacheMaterial record;
+    memset(&record,0,sizeof(record));
+    for (int j = 0; j < 3; j++) {
+      record.diffuse[j] = m->getDiffuseColor()[j];
+      record.reflective[j] = m->getReflectiveColor()[j];
+      record.emitted[j] = m->getEmittedColor()[j];
+    }
+    record.roughness = m->getRoughness();
+    record.listed = (i < mesh->materials.size());
+    record.texture_file_size = m->getTextureFile().size();
+    Append(out,&record,sizeof(record));
+    Append(out,m->getTextureFile().data(),record.texture_file_size);
+  }
+  Append(out,camera_string.data(),camera_string.size());
+  mesh->quads_bvh->Write(out);
+
+  // write to a temporary file first so a reader never sees half a cache
+  std::string cache_file = getFilename(obj_file);
+  std::string tmp_file = cache_file + ".tmp";
+  FILE *file = fopen(tmp_file.c_str(),"wb");
+  if (file == NULL) return false;
+  bool ok = fwrite(out.data(),1,out.size(),file) == out.size();
+  ok = (fclose(file) == 0) && ok;
+  if (ok) {
+#ifdef _WIN32
+    // rename doesn't replace an existing file on windows
+    remove(cache_file.c_str());
+#endif
+    ok = rename(tmp_file.c_str(),cache_file.c_str()) == 0;
+  }
+  if (!ok) remove(tmp_file.c_str());
+  return ok;
+}
+
+// ==================================================================
+// LOAD
+// ==================================================================
+
+bool MeshCache::Load(Mesh *mesh, const std::string &obj_file) {
+  assert (mesh->numVertices() == 0 && mesh->numFaces() == 0);
+  double start = omp_get_wtime();
+  MappedFile cache;
+  if (!cache.Open(getFilename(obj_file))) return false;
+  MeshCacheReader reader(cache.getData(),cache.getData()+cache.getSize());
+
+  // is this the cache for the current version of the .obj file?
+  const MeshCacheHeader *header;
+  if (!reader.Take(header,1)) return false;
+  unsigned long long source_size;
+  long long source_mtime;
+  if (memcmp(header->magic,MESH_CACHE_MAGIC,sizeof(header->magic)) != 0 ||
+      header->version != MESH_CACHE_VERSION ||
+      header->byte_order != MESH_CACHE_BYTE_ORDER ||
+      !GetSourceInfo(obj_file,source_size,source_mtime) ||
+      header->source_size != source_size ||
+      header->source_mtime != source_mtime) return false;
+  int num_vertices = header->num_vertices;
+  int num_faces = header->num_faces;
+  int num_materials = header->num_materials;
+  if (num_vertices < 0 || num_faces < 0 || num_materials < 0 || header->camera_size < 0) return false;
+
+  // point into the mapped file (no copies) & check every index before
+  // anything is added to the mesh
+  const float *positions, *texture_coordinates;
+  const int *quads, *opposites, *face_materials;
+  if (!reader.Take(positions,3*(size_t)num_vertices) ||
+      !reader.Take(texture_coordinates,2*(size_t)num_vertices) ||
+      !reader.Take(quads,4*(size_t)num_faces) ||
+      !reader.Take(opposites,4*(size_t)num_faces) ||
+      !reader.Take(face_materials,(size_t)num_faces)) return false;
+  for (int i = 0; i < 4*num_faces; i++) {
+    if (quads[i] < 0 || quads[i] >= num_vertices) return false;
+    int o = opposites[i];
+    if (o != -1 && (o < 0 || o >= 4*num_faces || o == i || opposites[o] != i)) return false;
+  }
+  for (int i = 0; i < num_faces; i++) {
+    if (face_materials[i] < 0 || face_materials[i] >= num_materials) return false;
+  }
+  std::vector<const MeshCacheMaterial*> material_records(num_materials);
+  std::vector<std::string> texture_files(num_materials);
+  for (int i = 0; i < num_materials; i++) {
+    const char *name;
+    if (!reader.Take(material_records[i],1) ||
+        material_records[i]->texture_file_size < 0 ||
+        !reader.Take(name,material_records[i]->texture_file_size)) return false;
+    texture_files[i] = std::string(name,material_records[i]->texture_file_size);
+  }
+  const char *camera_text;
+  if (!reader.Take(camera_text,header->camera_size)) return false;
+
+  // materials
+  std::vector<Material*> materials(num_materials);
+  for (int i = 0; i < num_materials; i++) {
+    const MeshCacheMaterial *r = material_records[i];
+    materials[i] = new Material(texture_files[i],
+                                glm::vec3(r->diffuse[0],r->diffuse[1],r->diffuse[2]),
+                                glm::vec3(r->reflective[0],r->reflective[1],r->reflective[2]),
+                                glm::vec3(r->emitted[0],r->emitted[1],r->emitted[2]),
+                                r->roughness);
+    if (r->listed) mesh->materials.push_back(materials[i]);
+  }
+
+  // vertices
+  mesh->setVertSize(num_vertices);
+  Vertex *block = (num_vertices > 0) ? mesh->vertex_pool.Allocate(num_vertices) : NULL;
+#pragma omp parallel for
+  for (int i = 0; i < num_vertices; i++) {
+    glm::vec3 pos(positions[3*i+0],positions[3*i+1],positions[3*i+2]);
+    Vertex *v = new (block+i) Vertex(i,pos);
+    v->setTextureCoordinates(texture_coordinates[2*i+0],texture_coordinates[2*i+1]);
+    mesh->vertices[i] = v;
+    mesh->geometry.setVertex(i,pos);
+  }
+  for (int i = 0; i < num_vertices; i++) {
+    const glm::vec3 &pos = mesh->vertices[i]->get();
+    if (mesh->bbox == NULL)
+      mesh->bbox = new BoundingBox(pos,pos);
+    else
+      mesh->bbox->Extend(pos);
+  }
+
+  // faces, the stored opposite links replace sorting the edges
+  std::vector<int> quad_indices(quads,quads+4*num_faces);
+  std::vector<Material*> face_material_pointers(num_faces);
+  for (int i = 0; i < num_faces; i++) face_material_pointers[i] = materials[face_materials[i]];
+  mesh->addOriginalQuads(quad_indices,face_material_pointers,opposites);
+
+  // scene
+  mesh->background_color = glm::vec3(header->background_color[0],
+                                     header->background_color[1],
+                                     header->background_color[2]);
+  mesh->camera = NULL;
+  std::istringstream camera_stream(std::string(camera_text,header->camera_size));
+  std::string token;
+  Material *active_material = NULL;
+  if (camera_stream >> token) mesh->ParseStatement(token,camera_stream,active_material);
+  mesh->SetupCamera();
+
+  // acceleration structures
+  mesh->quads_bvh = new BVH();
+  mesh->rasterized_bvh = new BVH();
+  mesh->rasterized_bvh->Build(mesh->rasterized_primitive_faces,mesh->geometry);
+  if (!mesh->quads_bvh->Read(mesh->original_quads,mesh->geometry,reader.p,reader.end)) {
+    mesh->quads_bvh->Build(mesh->original_quads,mesh->geometry);
+  }
+
+  std::cout << " mesh cache loaded: " << mesh->numFaces() << " faces and " << mesh->numEdges()
+            << " edges in " << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
+  return true;
+}
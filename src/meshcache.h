@@ -0,0 +1,33 @@
+#ifndef _MESH_CACHE_H_
+#define _MESH_CACHE_H_
+
+#include <string>
+
+class Mesh;
+
+// ==================================================================
+// A versioned binary copy of a loaded .obj file, stored next to it as
+// "<file>.cache".  It is written after the first load and holds the
+// vertex positions & texture coordinates, the quads, the opposite
+// half-edge links, the materials, the camera and the BVH, so a reload
+// maps the file and builds the mesh without parsing or hash lookups.
+//
+// The cache records the size & modification time of the .obj file &
+// is ignored (and rewritten) when either changes.  Scenes with
+// primitives (spheres, cylinder rings) are not cached, since their
+// rasterization depends on the command line arguments.
+
+class MeshCache {
+
+ public:
+
+  static std::string getFilename(const std::string &obj_file) { return obj_file + ".cache"; }
+
+  // returns false if there is no valid cache for this .obj file, the
+  // mesh must be empty
+  static bool Load(Mesh *mesh, const std::string &obj_file);
+  // returns false if the mesh can't be cached or the file can't be written
+  static bool Save(const Mesh *mesh, const std::string &obj_file);
+};
+
+#endif
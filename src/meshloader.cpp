@@ -0,0 +1,185 @@
+#include "glCanvas.h"
+
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <omp.h>
+
+#include "meshloader.h"
+#include "argparser.h"
+#include "mesh.h"
+#include "camera.h"
+#include "joint.h"
+#include "autorigger.h"
+
+// the faces in each chunk of the loading view
+#define MESH_LOADER_CHUNK 4096
+
+// ===========================================================================
+// the loader thread
+
+MeshLoader::~MeshLoader() {
+  if (thread.joinable()) thread.join();
+  for (unsigned int i = 0; i < queue.size(); i++) delete queue[i];
+  if (!handed_over) {
+    delete mesh;
+    delete tree;
+  }
+}
+
+void MeshLoader::Start() {
+  thread = std::thread(&MeshLoader::Run,this);
+}
+
+void MeshLoader::Run() {
+  double start = omp_get_wtime();
+  mesh = new Mesh();
+  mesh->Parallel(args,this);
+  tree = new JointTree();
+  if (args->auto_rig) {
+    AutoRigger auto_rigger(mesh,args);
+    auto_rigger.Rig(tree);
+  }
+  printf ("loaded in the background in %.3f s\n",omp_get_wtime()-start);
+  fflush(stdout);
+  finished = true;
+}
+
+// each quad as 2 triangles with the quad's normal (4 vertices, so the
+// faces don't share normals)
+void MeshLoader::addParsedGeometry(const std::vector<glm::vec3> &positions, const std::vector<int> &quads,
+                                   const Camera *camera) {
+  if (camera != NULL) {
+    std::ostringstream text;
+    text << *camera;
+    std::lock_guard<std::mutex> guard(lock);
+    camera_text = text.str();
+  }
+  glm::vec4 color(0.7,0.7,0.7,1);
+  int num_faces = quads.size()/4;
+  for (int begin = 0; begin < num_faces; begin += MESH_LOADER_CHUNK) {
+    int end = std::min(num_faces,begin+MESH_LOADER_CHUNK);
+    Chunk *chunk = new Chunk;
+    chunk->verts.reserve(4*(end-begin));
+    chunk->tris.reserve(2*(end-begin));
+    for (int f = begin; f < end; f++) {
+      const glm::vec3 &a = positions[quads[4*f]];
+      const glm::vec3 &b = positions[quads[4*f+1]];
+      const glm::vec3 &c = positions[quads[4*f+2]];
+      const glm::vec3 &d = positions[quads[4*f+3]];
+      // the diagonals also work for a quad with a repeated corner
+      glm::vec3 normal = glm::cross(c-a,d-b);
+      float length = glm::length(normal);
+      normal = (length > 0) ? normal/length : glm::vec3(0,0,1);
+      int v = chunk->verts.size();
+      chunk->verts.push_back(VBOPosNormalColor(a,normal,color));
+      chunk->verts.push_back(VBOPosNormalColor(b,normal,color));
+      chunk->verts.push_back(VBOPosNormalColor(c,normal,color));
+      chunk->verts.push_back(VBOPosNormalColor(d,normal,color));
+      chunk->tris.push_back(VBOIndexedTri(v,v+1,v+2));
+      chunk->tris.push_back(VBOIndexedTri(v,v+2,v+3));
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    queue.push_back(chunk);
+  }
+}
+
+// ===========================================================================
+// the GL thread
+
+// the same as the camera statement in the .obj
+Camera* MeshLoader::TakeCamera() {
+  if (camera_taken) return NULL;
+  std::string text;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    text = camera_text;
+  }
+  if (text == "") return NULL;
+  std::istringstream istr(text);
+  std::string token;
+  istr >> token;
+  Camera *camera = NULL;
+  if (token == "PerspectiveCamera") {
+    camera = new PerspectiveCamera();
+    istr >> *(PerspectiveCamera*)camera;
+  } else if (token == "OrthographicCamera") {
+    camera = new OrthographicCamera();
+    istr >> *(OrthographicCamera*)camera;
+  }
+  camera_taken = (camera != NULL);
+  return camera;
+}
+
+Mesh* MeshLoader::getMesh() {
+  assert (finished);
+  if (thread.joinable()) thread.join();
+  handed_over = true;
+  return mesh;
+}
+
+JointTree* MeshLoader::getJointTree() {
+  assert (handed_over);
+  return tree;
+}
+
+void MeshLoader::initializeVBOs() {
+}
+
+// a VBO pair per chunk, as they arrive
+void MeshLoader::setupVBOs() {
+  std::vector<Chunk*> arrived;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    arrived.swap(queue);
+  }
+  for (unsigned int i = 0; i < arrived.size(); i++) {
+    Chunk *chunk = arrived[i];
+    GLuint VBOs[2];
+    glGenBuffers(2, VBOs);
+    glBindBuffer(GL_ARRAY_BUFFER,VBOs[0]);
+    glBufferData(GL_ARRAY_BUFFER,sizeof(VBOPosNormalColor)*chunk->verts.size(),&chunk->verts[0],GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,VBOs[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(VBOIndexedTri)*chunk->tris.size(),&chunk->tris[0],GL_STATIC_DRAW);
+    chunk_verts_VBOs.push_back(VBOs[0]);
+    chunk_tri_indices_VBOs.push_back(VBOs[1]);
+    chunk_num_tris.push_back(chunk->tris.size());
+    delete chunk;
+  }
+}
+
+void MeshLoader::drawVBOs() {
+  // with local shading
+  glUniform1i(GLCanvas::colormodeID, 1);
+  for (unsigned int i = 0; i < chunk_verts_VBOs.size(); i++) {
+    glBindBuffer(GL_ARRAY_BUFFER,chunk_verts_VBOs[i]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,chunk_tri_indices_VBOs[i]);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)sizeof(glm::vec3) );
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 2, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)*2));
+    glDrawElements(GL_TRIANGLES, chunk_num_tris[i]*3, GL_UNSIGNED_INT, 0);
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(2);
+    glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(4);
+  }
+  glUniform1i(GLCanvas::colormodeID, 0);
+}
+
+void MeshLoader::cleanupVBOs() {
+  for (unsigned int i = 0; i < chunk_verts_VBOs.size(); i++) {
+    glDeleteBuffers(1, &chunk_verts_VBOs[i]);
+    glDeleteBuffers(1, &chunk_tri_indices_VBOs[i]);
+  }
+  chunk_verts_VBOs.clear();
+  chunk_tri_indices_VBOs.clear();
+  chunk_num_tris.clear();
+}
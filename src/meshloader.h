@@ -0,0 +1,99 @@
+#ifndef _MESH_LOADER_H_
+#define _MESH_LOADER_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vbo_structs.h"
+
+class ArgParser;
+class Mesh;
+class Camera;
+class JointTree;
+
+// ====================================================================
+// ====================================================================
+// Loads the mesh on a background thread, so the window is up (& the
+// camera can be moved) right away.  Once the .obj is parsed,
+// Mesh::Parallel hands over the faces & the camera, and they are
+// turned into flat shaded triangles a chunk at a time & queued.  Each
+// frame the GL thread takes the chunks finished so far & uploads them
+// (all the GL calls stay on the GL thread).  Meanwhile the loader
+// thread builds the topology, the acceleration structures & the auto
+// rig.  Once isFinished, getMesh hands over the mesh & the rig.
+//
+// The threads only share the queue (& the camera, as text) behind a
+// mutex, and the finished flag.
+
+class MeshLoader {
+
+public:
+
+  // CONSTRUCTOR & DESTRUCTOR
+  MeshLoader(ArgParser *a) : args(a), mesh(NULL), tree(NULL), finished(false), handed_over(false),
+                             camera_taken(false) {}
+  // waits for the thread (a load can't be interrupted)
+  ~MeshLoader();
+
+  // LOADER THREAD
+  void Start();
+  // from Mesh::Parallel, once the vertices, faces & camera are parsed
+  void addParsedGeometry(const std::vector<glm::vec3> &positions, const std::vector<int> &quads,
+                         const Camera *camera);
+
+  // GL THREAD
+  bool isFinished() const { return finished; }
+  // a copy of the mesh camera, once it's known (only the first call)
+  Camera* TakeCamera();
+  bool cameraTaken() const { return camera_taken; }
+  // once finished: the mesh & the rig (auto rigged if requested),
+  // which the caller then owns
+  Mesh* getMesh();
+  JointTree* getJointTree();
+
+  // the chunks that have arrived
+  void initializeVBOs();
+  void setupVBOs();
+  void drawVBOs();
+  void cleanupVBOs();
+
+private:
+
+  // flat shaded triangles, ready to upload
+  struct Chunk {
+    std::vector<VBOPosNormalColor> verts;
+    std::vector<VBOIndexedTri> tris;
+  };
+
+  // HELPERS
+  void Run();
+
+  // REPRESENTATION
+  ArgParser *args;
+  Mesh *mesh;
+  JointTree *tree;
+  std::thread thread;
+  std::atomic<bool> finished;
+  bool handed_over;
+
+  // shared, behind the lock
+  std::mutex lock;
+  std::vector<Chunk*> queue;
+  std::string camera_text;
+
+  // GL thread only
+  bool camera_taken;
+  std::vector<GLuint> chunk_verts_VBOs;
+  std::vector<GLuint> chunk_tri_indices_VBOs;
+  std::vector<int> chunk_num_tris;
+};
+
+// ====================================================================
+// ====================================================================
+
+#endif
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <omp.h>
+
+#include "objparser.h"
+
+// files smaller than this are parsed by a single thread
+#define MIN_CHUNK_SIZE 65536
+
+// ==================================================================
+// NUMBER SCANNERS
+// ==================================================================
+
+inline bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// reads a decimal floating point number starting at p (after any
+// blanks), advances p past it.  the significant digits are gathered in
+// an integer and scaled once by a power of 10 in double precision.
+inline bool ScanFloat(const char *&p, const char *end, float &value) {
+  static const double powers_of_10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  while (p < end && IsBlank(*p)) p++;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); p++; }
+  uint64_t mantissa = 0;
+  int num_digits = 0;
+  int exponent = 0;
+  bool any_digits = false;
+  for (; p < end && IsDigit(*p); p++) {
+    any_digits = true;
+    if (num_digits < 19) {
+      mantissa = 10*mantissa + (*p-'0');
+      if (mantissa != 0) num_digits++;
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && IsDigit(*p); p++) {
+      any_digits = true;
+      if (num_digits < 19) {
+        mantissa = 10*mantissa + (*p-'0');
+        if (mantissa != 0) num_digits++;
+        exponent--;
+      }
+    }
+  }
+  if (!any_digits) return false;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negative_exponent = false;
+    if (p < end && (*p == '-' || *p == '+')) { negative_exponent = (*p == '-'); p++; }
+    if (p >= end || !IsDigit(*p)) return false;
+    int e = 0;
+    for (; p < end && IsDigit(*p); p++) {
+      if (e < 10000) e = 10*e + (*p-'0');
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  double v = (double)mantissa;
+  if (exponent < 0) {
+    if (exponent >= -22) v /= powers_of_10[-exponent];
+    else v *= pow(10.0,exponent);
+  } else if (exponent > 0) {
+    if (exponent <= 22) v *= powers_of_10[exponent];
+    else v *= pow(10.0,exponent);
+  }
+  value = (float)(negative ? -v : v);
+  return true;
+}
+
+// reads an integer starting at p (after any blanks), advances p past
+// it & any "/vt/vn" suffix
+inline bool ScanInt(const char *&p, const char *end, int &value) {
+  while (p < end && IsBlank(*p)) p++;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) { negative = (*p == '-'); p++; }
+  if (p >= end || !IsDigit(*p)) return false;
+  int v = 0;
+  for (; p < end && IsDigit(*p); p++) v = 10*v + (*p-'0');
+  while (p < end && !IsBlank(*p) && *p != '\n') p++;
+  value = negative ? -v : v;
+  return true;
+}
+
+// ==================================================================
+// PARSING
+// ==================================================================
+
+bool ObjParser::Parse(int num_threads) {
+  positions.clear();
+  texture_coordinates.clear();
+  quads.clear();
+  face_statements.clear();
+  statements.clear();
+  num_skipped_triangles = 0;
+
+  // split the file into chunks that start at the beginning of a line
+  int num_chunks = std::max(1,std::min(num_threads,(int)(size/MIN_CHUNK_SIZE)));
+  std::vector<Chunk> chunks(num_chunks);
+  chunks[0].begin = 0;
+  for (int i = 1; i < num_chunks; i++) {
+    size_t pos = std::max(chunks[i-1].begin,(size_t)((double)size*i/num_chunks));
+    const char *eol = (const char*)memchr(data+pos,'\n',size-pos);
+    chunks[i].begin = (eol == NULL) ? size : eol+1-data;
+    chunks[i-1].end = chunks[i].begin;
+  }
+  chunks[num_chunks-1].end = size;
+
+#pragma omp parallel for schedule(static,1) num_threads(num_chunks)
+  for (int i = 0; i < num_chunks; i++) {
+    ParseChunk(chunks[i]);
+  }
+
+  for (int i = 0; i < num_chunks; i++) {
+    if (chunks[i].error < size) {
+      int line = 1 + std::count(data,data+chunks[i].error,'\n');
+      std::cout << "ERROR! CANNOT PARSE LINE " << line << std::endl;
+      return false;
+    }
+  }
+  MergeChunks(chunks);
+  return true;
+}
+
+void ObjParser::ParseChunk(Chunk &chunk) const {
+  chunk.error = size;
+  chunk.num_skipped_triangles = 0;
+  const char *p = data+chunk.begin;
+  const char *end = data+chunk.end;
+  while (p < end) {
+    const char *eol = (const char*)memchr(p,'\n',end-p);
+    if (eol == NULL) eol = end;
+    const char *line = p;
+    p = eol+1;
+    while (line < eol && IsBlank(*line)) line++;
+    if (line == eol || *line == '#') continue;
+    const char *q = line;
+    while (q < eol && !IsBlank(*q)) q++;
+    size_t len = q-line;
+    bool ok = true;
+    if (len == 1 && line[0] == 'v') {
+      glm::vec3 pos;
+      ok = ScanFloat(q,eol,pos.x) && ScanFloat(q,eol,pos.y) && ScanFloat(q,eol,pos.z);
+      chunk.positions.push_back(pos);
+    } else if (len == 2 && line[0] == 'v' && line[1] == 't') {
+      TextureCoordinate tc;
+      tc.vertex = (int)chunk.positions.size()-1;
+      ok = ScanFloat(q,eol,tc.s) && ScanFloat(q,eol,tc.t);
+      chunk.texture_coordinates.push_back(tc);
+    } else if (len == 2 && line[0] == 'v' && (line[1] == 'n' || line[1] == 'p')) {
+      continue;
+    } else if (len == 1 && line[0] == 'f') {
+      int a,b,c,d;
+      ok = ScanInt(q,eol,a) && ScanInt(q,eol,b) && ScanInt(q,eol,c);
+      while (q < eol && IsBlank(*q)) q++;
+      if (ok && q == eol) {
+        chunk.num_skipped_triangles++;
+        continue;
+      }
+      ok = ok && ScanInt(q,eol,d);
+      chunk.quads.push_back(a-1);
+      chunk.quads.push_back(b-1);
+      chunk.quads.push_back(c-1);
+      chunk.quads.push_back(d-1);
+      chunk.face_statements.push_back((int)chunk.statements.size()-1);
+    } else {
+      chunk.statements.push_back(line-data);
+    }
+    if (!ok) {
+      chunk.error = line-data;
+      return;
+    }
+  }
+}
+
+void ObjParser::MergeChunks(const std::vector<Chunk> &chunks) {
+  // where each chunk's results go in the combined arrays
+  int num_chunks = chunks.size();
+  std::vector<int> vertex_offset(num_chunks+1,0);
+  std::vector<int> texture_offset(num_chunks+1,0);
+  std::vector<int> face_offset(num_chunks+1,0);
+  std::vector<int> statement_offset(num_chunks+1,0);
+  for (int i = 0; i < num_chunks; i++) {
+    vertex_offset[i+1] = vertex_offset[i] + chunks[i].positions.size();
+    texture_offset[i+1] = texture_offset[i] + chunks[i].texture_coordinates.size();
+    face_offset[i+1] = face_offset[i] + chunks[i].face_statements.size();
+    statement_offset[i+1] = statement_offset[i] + chunks[i].statements.size();
+  }
+  positions.resize(vertex_offset[num_chunks]);
+  texture_coordinates.resize(texture_offset[num_chunks]);
+  quads.resize(4*face_offset[num_chunks]);
+  face_statements.resize(face_offset[num_chunks]);
+  statements.resize(statement_offset[num_chunks]);
+
+#pragma omp parallel for schedule(static,1) num_threads(num_chunks)
+  for (int i = 0; i < num_chunks; i++) {
+    const Chunk &chunk = chunks[i];
+    std::copy(chunk.positions.begin(),chunk.positions.end(),positions.begin()+vertex_offset[i]);
+    std::copy(chunk.quads.begin(),chunk.quads.end(),quads.begin()+4*face_offset[i]);
+    std::copy(chunk.statements.begin(),chunk.statements.end(),statements.begin()+statement_offset[i]);
+    // local indices of -1 refer back to the end of the previous chunks
+    for (unsigned int j = 0; j < chunk.texture_coordinates.size(); j++) {
+      TextureCoordinate tc = chunk.texture_coordinates[j];
+      tc.vertex += vertex_offset[i];
+      texture_coordinates[texture_offset[i]+j] = tc;
+    }
+    for (unsigned int j = 0; j < chunk.face_statements.size(); j++) {
+      face_statements[face_offset[i]+j] = chunk.face_statements[j] + statement_offset[i];
+    }
+  }
+  for (int i = 0; i < num_chunks; i++) num_skipped_triangles += chunks[i].num_skipped_triangles;
+}
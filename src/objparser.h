@@ -0,0 +1,100 @@
+#ifndef _OBJ_PARSER_H_
+#define _OBJ_PARSER_H_
+
+#include <cstddef>
+#include <streambuf>
+#include <vector>
+#include <glm/glm.hpp>
+
+// ==================================================================
+// A parallel scanner for our (non-standard) .obj files.  The file
+// (usually memory mapped) is split into one chunk per thread at line
+// boundaries, and every thread parses the v, vt & f lines of its chunk
+// with a hand rolled number scanner into its own arrays.  The chunks
+// are then concatenated in file order, so no locks are needed.
+//
+// All other lines (materials, primitives, cameras, ...) are rare, so
+// they are only recorded as "statements" (byte offsets) to be parsed
+// in order afterwards by Mesh.  Each face remembers the last statement
+// before it, which is how the active material is recovered.  Comments
+// & the vertex normals (vn, vp) of ordinary .obj files are skipped
+// here, since the mesh computes its own normals.  The mesh is made of
+// quads, so triangle faces are skipped (& counted).
+
+class ObjParser {
+
+ public:
+
+  // a "vt" line applies to the most recent vertex
+  struct TextureCoordinate {
+    int vertex;
+    float s,t;
+  };
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  ObjParser(const char *_data, size_t _size) : data(_data), size(_size), num_skipped_triangles(0) {}
+
+  // returns false (with a message) on a malformed v, vt or f line
+  bool Parse(int num_threads);
+
+  // =========
+  // ACCESSORS
+  int numVertices() const { return positions.size(); }
+  int numFaces() const { return quads.size()/4; }
+  int numStatements() const { return statements.size(); }
+  int numSkippedTriangles() const { return num_skipped_triangles; }
+  const std::vector<glm::vec3>& getPositions() const { return positions; }
+  const std::vector<TextureCoordinate>& getTextureCoordinates() const { return texture_coordinates; }
+  // 4 vertex indices per face (starting from 0)
+  const std::vector<int>& getQuads() const { return quads; }
+  // the last statement before each face, or -1
+  const std::vector<int>& getFaceStatements() const { return face_statements; }
+  // byte offset of the first character of each statement
+  const std::vector<size_t>& getStatements() const { return statements; }
+
+ private:
+
+  // one thread's share of the file
+  struct Chunk {
+    size_t begin, end;
+    std::vector<glm::vec3> positions;
+    std::vector<TextureCoordinate> texture_coordinates;
+    std::vector<int> quads;
+    std::vector<int> face_statements;
+    std::vector<size_t> statements;
+    int num_skipped_triangles;
+    // the offset of a malformed line, or size if there was none
+    size_t error;
+  };
+
+  // HELPER FUNCTIONS
+  void ParseChunk(Chunk &chunk) const;
+  void MergeChunks(const std::vector<Chunk> &chunks);
+
+  // REPRESENTATION
+  const char *data;
+  size_t size;
+  std::vector<glm::vec3> positions;
+  std::vector<TextureCoordinate> texture_coordinates;
+  std::vector<int> quads;
+  std::vector<int> face_statements;
+  std::vector<size_t> statements;
+  int num_skipped_triangles;
+};
+
+// ==================================================================
+// A std::istream source reading directly from memory, so the existing
+// operator>> code can parse a statement in place without a copy.
+
+class MemoryStreamBuffer : public std::streambuf {
+ public:
+  MemoryStreamBuffer(const char *begin, size_t size) {
+    char *p = const_cast<char*>(begin);
+    setg(p,p,p+size);
+  }
+  void setPosition(size_t offset) { setg(eback(),eback()+offset,egptr()); }
+  size_t getPosition() const { return gptr()-eback(); }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <new>
+#include <vector>
+
+// ==================================================================
+// Typed storage for the mesh elements (vertices, edges & faces),
+// handed out from large contiguous slabs instead of one heap
+// allocation per object.  Fresh storage is handed out in order, so
+// elements created one after another (and every bulk request) are
+// adjacent in memory, and walking the mesh lists in creation order
+// walks the slabs in order.  A bulk request of at least a slab gets a
+// slab of its own.  Freed elements go on a free list and are reused
+// (most recent first) by the next single allocation.  Each slab
+// counts its live elements, and a slab whose elements have all been
+// freed goes back to the heap, so when subdivision discards a level
+// (allocated in bulk) its storage is released.
+//
+// The pool only provides raw storage: objects are constructed with
+// placement new and destroyed by explicitly calling the destructor
+// before Free.  Clearing or destroying the pool releases the slabs
+// without visiting the objects, so T must not own other resources.
+
+template <class T>
+class Pool {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  Pool(int _slab_size = 4096) : slab_size(_slab_size), current(NULL), used(0), capacity(0), num_live(0) {}
+  ~Pool() { Clear(); }
+
+  // =========
+  // ACCESSORS
+  int numSlabs() const { return slabs.size(); }
+  int numFree() const { return free_list.size(); }
+  // allocated & not freed
+  int numLive() const { return num_live; }
+  // the storage held, in objects
+  long long numReserved() const {
+    long long total = 0;
+    for (typename std::map<T*,Slab>::const_iterator itr = slabs.begin(); itr != slabs.end(); itr++)
+      total += itr->second.capacity;
+    return total;
+  }
+
+  // =========
+  // MODIFIERS
+  // uninitialized storage for n contiguous objects (a single object
+  // may reuse a freed one)
+  T* Allocate(int n = 1) {
+    assert (n > 0);
+    num_live += n;
+    if (n == 1 && !free_list.empty()) {
+      T *answer = free_list.back();
+      free_list.pop_back();
+      findSlab(answer).live++;
+      return answer;
+    }
+    if (n >= slab_size) {
+      // a slab of its own, the current slab keeps filling
+      T *block = newSlab(n);
+      slabs[block].live = n;
+      return block;
+    }
+    if (used + n > capacity) {
+      T *previous = current;
+      current = newSlab(slab_size);
+      capacity = slab_size;
+      used = 0;
+      if (previous != NULL && slabs[previous].live == 0) releaseSlab(previous);
+    }
+    T *answer = current + used;
+    used += n;
+    slabs[current].live += n;
+    return answer;
+  }
+  // return the storage of an already destroyed object
+  void Free(T *t) {
+    assert (t != NULL);
+    assert (num_live > 0);
+    num_live--;
+    free_list.push_back(t);
+    T *begin = findSlabBegin(t);
+    Slab &slab = slabs[begin];
+    assert (slab.live > 0);
+    slab.live--;
+    if (slab.live == 0 && begin != current) releaseSlab(begin);
+  }
+  // release all of the slabs at once
+  void Clear() {
+    for (typename std::map<T*,Slab>::iterator itr = slabs.begin(); itr != slabs.end(); itr++)
+      ::operator delete(itr->first);
+    slabs.clear();
+    free_list.clear();
+    current = NULL;
+    used = capacity = num_live = 0;
+  }
+
+ private:
+
+  struct Slab {
+    int capacity;
+    int live;
+  };
+
+  // HELPER FUNCTIONS
+  T* newSlab(int n) {
+    T *begin = (T*)::operator new(n*sizeof(T));
+    Slab slab = { n, 0 };
+    slabs[begin] = slab;
+    return begin;
+  }
+  T* findSlabBegin(T *t) {
+    typename std::map<T*,Slab>::iterator itr = slabs.upper_bound(t);
+    assert (itr != slabs.begin());
+    itr--;
+    assert (t < itr->first + itr->second.capacity);
+    return itr->first;
+  }
+  Slab& findSlab(T *t) { return slabs[findSlabBegin(t)]; }
+  // a slab with no live objects: drop its free entries & the storage
+  void releaseSlab(T *begin) {
+    T *end = begin + slabs[begin].capacity;
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < free_list.size(); i++) {
+      if (free_list[i] < begin || free_list[i] >= end) free_list[kept++] = free_list[i];
+    }
+    free_list.resize(kept);
+    slabs.erase(begin);
+    ::operator delete(begin);
+  }
+
+  // don't use these
+  Pool(const Pool&) { assert(0); }
+  Pool& operator=(const Pool&) { assert(0); return *this; }
+
+  // REPRESENTATION
+  // by address, to find the slab of an object
+  std::map<T*,Slab> slabs;
+  std::vector<T*> free_list;
+  int slab_size;
+  // the slab handed out in order, & how much of it is in use
+  T *current;
+  int used;
+  int capacity;
+  int num_live;
+};
+
+#endif
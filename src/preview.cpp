@@ -0,0 +1,205 @@
+#include "glCanvas.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <omp.h>
+
+#include "preview.h"
+#include "raytracer.h"
+#include "camera.h"
+#include "hit.h"
+#include "utils.h"
+#include "vbo_structs.h"
+#include "profiler.h"
+
+// a tile is a multiple of every block size
+#define PREVIEW_TILE 81
+// roughly how many blocks across the shorter side in the first pass
+#define PREVIEW_FIRST_DIVISIONS 10
+
+// ===========================================================================
+// the passes
+
+void Preview::Start(Camera *c, int w, int h) {
+  camera = c;
+  width = std::max(1,w);
+  height = std::max(1,h);
+  framebuffer.assign(width*height*3,0);
+  // the largest power of 3 block (up to a tile) with ~10 across, then a third each pass
+  int first = 1;
+  while (first*3 <= std::min(PREVIEW_TILE,std::min(width,height)/PREVIEW_FIRST_DIVISIONS)) first *= 3;
+  block_sizes.clear();
+  for (int b = first; b >= 1; b /= 3) block_sizes.push_back(b);
+  tiles_x = (width+PREVIEW_TILE-1) / PREVIEW_TILE;
+  tiles_y = (height+PREVIEW_TILE-1) / PREVIEW_TILE;
+  pass = 0;
+  next_tile = 0;
+  rendering = true;
+  seconds = 0;
+  dirty_begin = height;
+  dirty_end = 0;
+  shown_passes = 0;
+  // the corners of the image on the image plane (as GLCanvas draws it)
+  corners[0] = GLCanvas::GetPos(0,0);
+  corners[1] = GLCanvas::GetPos(width,0);
+  corners[2] = GLCanvas::GetPos(width,height);
+  corners[3] = GLCanvas::GetPos(0,height);
+}
+
+bool Preview::Render(double budget_ms) {
+  if (!rendering) return false;
+  PROFILE_SCOPE(PROFILE_PREVIEW_RENDER);
+  double start = omp_get_wtime();
+  int num_tiles = tiles_x*tiles_y;
+  while (pass < numPasses()) {
+    // a few tiles per thread, then check the clock
+    int batch = std::min(num_tiles-next_tile,4*omp_get_max_threads());
+#pragma omp parallel for schedule(dynamic,1)
+    for (int t = 0; t < batch; t++) {
+      RenderTile(next_tile+t);
+    }
+    dirty_begin = std::min(dirty_begin,(next_tile/tiles_x)*PREVIEW_TILE);
+    dirty_end = std::max(dirty_end,std::min(height,((next_tile+batch-1)/tiles_x+1)*PREVIEW_TILE));
+    next_tile += batch;
+    if (next_tile == num_tiles) {
+      pass++;
+      next_tile = 0;
+    }
+    if (1000*(omp_get_wtime()-start) > budget_ms) break;
+  }
+  seconds += omp_get_wtime()-start;
+  if (pass < numPasses()) return true;
+  rendering = false;
+  printf ("ray traced preview: %dx%d in %.3f s (%d threads)\n",width,height,seconds,omp_get_max_threads());
+  return false;
+}
+
+// the tiles go across each row from the lower left corner, then up
+void Preview::RenderTile(int tile) {
+  int b = block_sizes[pass];
+  int x_begin = (tile%tiles_x)*PREVIEW_TILE;
+  int y_begin = (tile/tiles_x)*PREVIEW_TILE;
+  int x_end = std::min(width,x_begin+PREVIEW_TILE);
+  int y_end = std::min(height,y_begin+PREVIEW_TILE);
+  for (int y0 = y_begin; y0 < y_end; y0 += b) {
+    for (int x0 = x_begin; x0 < x_end; x0 += b) {
+      // the middle of the block it was in last pass: same ray, same block
+      if (pass > 0 && (x0/b)%3 == 1 && (y0/b)%3 == 1) continue;
+      // the middle of the block, even if the image edge cuts it off
+      glm::vec3 color = TracePixel(x0+(b-1)/2+0.5,y0+(b-1)/2+0.5);
+      for (int y = y0; y < std::min(y_end,y0+b); y++) {
+        float *row = &framebuffer[3*(y*width)];
+        for (int x = x0; x < std::min(x_end,x0+b); x++) {
+          row[3*x] = color.r;
+          row[3*x+1] = color.g;
+          row[3*x+2] = color.b;
+        }
+      }
+    }
+  }
+}
+
+// a ray through pixel (i,j) as GLCanvas::TraceRay makes it
+glm::vec3 Preview::TracePixel(double i, double j) const {
+  int max_d = std::max(width,height);
+  double x = (i-width/2.0)/double(max_d)+0.5;
+  double y = (j-height/2.0)/double(max_d)+0.5;
+  Ray r = camera->generateRay(x,y);
+  Hit h;
+  return raytracer->TraceRay(r,h);
+}
+
+// ===========================================================================
+// the texture
+
+void Preview::initializeVBOs() {
+  glGenTextures(1, &texture);
+  glGenBuffers(1, &quad_VBO);
+  glGenBuffers(1, &quad_indices_VBO);
+  texture_width = 0;
+  texture_height = 0;
+  VBOIndexedTri tris[2] = { VBOIndexedTri(0,1,2), VBOIndexedTri(0,2,3) };
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,quad_indices_VBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(tris),tris,GL_STATIC_DRAW);
+}
+
+void Preview::resetVBOs() {
+  rendering = false;
+  shown_passes = 0;
+}
+
+// upload the rows traced since the last call (in srgb)
+void Preview::setupVBOs() {
+  if (width == 0) return;
+  PROFILE_SCOPE(PROFILE_PREVIEW_VBOS);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  if (texture_width != width || texture_height != height) {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    texture_width = width;
+    texture_height = height;
+  }
+  if (dirty_begin < dirty_end) {
+    int n = (dirty_end-dirty_begin)*width*3;
+    upload.resize(n);
+    const float *linear = &framebuffer[dirty_begin*width*3];
+#pragma omp parallel for
+    for (int i = 0; i < n; i++) upload[i] = linear_to_srgb(linear[i]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_begin, width, dirty_end-dirty_begin, GL_RGB, GL_FLOAT, &upload[0]);
+    PROFILE_COUNT(PROFILE_BYTES_UPLOADED,sizeof(float)*n);
+    dirty_begin = height;
+    dirty_end = 0;
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  shown_passes = pass;
+
+  glm::vec4 white(1,1,1,1);
+  float st[4][2] = { {0,0}, {1,0}, {1,1}, {0,1} };
+  std::vector<VBOPosNormalColor> quad;
+  for (int i = 0; i < 4; i++) {
+    quad.push_back(VBOPosNormalColor(corners[i],glm::vec3(0,0,0),white,white,st[i][0],st[i][1]));
+  }
+  glBindBuffer(GL_ARRAY_BUFFER,quad_VBO);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(VBOPosNormalColor)*quad.size(),&quad[0],GL_STATIC_DRAW);
+  PROFILE_COUNT(PROFILE_BYTES_UPLOADED,sizeof(VBOPosNormalColor)*quad.size());
+}
+
+// once the first pass covers the whole image
+void Preview::drawVBOs() {
+  if (shown_passes == 0) return;
+  glUniform1i(GLCanvas::colormodeID, 2);
+  glDisable(GL_DEPTH_TEST);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindBuffer(GL_ARRAY_BUFFER, quad_VBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,quad_indices_VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)sizeof(glm::vec3) );
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)));
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 2, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)*2));
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glDisableVertexAttribArray(2);
+  glDisableVertexAttribArray(3);
+  glDisableVertexAttribArray(4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glEnable(GL_DEPTH_TEST);
+  glUniform1i(GLCanvas::colormodeID, 0);
+}
+
+void Preview::cleanupVBOs() {
+  glDeleteTextures(1, &texture);
+  glDeleteBuffers(1, &quad_VBO);
+  glDeleteBuffers(1, &quad_indices_VBO);
+}
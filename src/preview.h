@@ -0,0 +1,96 @@
+#ifndef _PREVIEW_H_
+#define _PREVIEW_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+class RayTracer;
+class Camera;
+
+// ====================================================================
+// ====================================================================
+// A progressive ray traced image of the view, traced into a float
+// framebuffer (linear rgb, rows from the bottom) & shown as a single
+// texture on the image plane.  The image is refined coarse to fine:
+// each pass traces one ray per block of pixels & fills the block, the
+// blocks a third the size of the last pass, down to single pixels (a
+// block's middle third was traced by the last pass & is skipped).
+// Each pass is split into tiles that are traced in parallel, a batch
+// at a time, so Render can return after a time budget & the window
+// stays responsive.  Restarting (e.g. when the camera moves) just
+// drops the passes in progress.
+
+class Preview {
+
+public:
+
+  // CONSTRUCTOR
+  Preview(RayTracer *r) : raytracer(r), camera(NULL), width(0), height(0), pass(0), next_tile(0),
+                          rendering(false), seconds(0), dirty_begin(0), dirty_end(0),
+                          texture_width(0), texture_height(0), shown_passes(0) {}
+
+  // ACCESSORS
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  // width*height rgb triples, linear
+  const std::vector<float>& getFramebuffer() const { return framebuffer; }
+  bool isRendering() const { return rendering; }
+  int numPasses() const { return block_sizes.size(); }
+  int numPassesDone() const { return pass; }
+  // the time spent tracing since the last Start
+  double getSeconds() const { return seconds; }
+
+  // MODIFIERS
+  // start over from the coarsest pass, with the camera as it is now
+  void Start(Camera *c, int w, int h);
+  void Cancel() { rendering = false; }
+  // trace for about budget_ms, returns true if there's more to do
+  bool Render(double budget_ms);
+
+  // the texture & the quad on the image plane
+  void initializeVBOs();
+  void resetVBOs();
+  void setupVBOs();
+  void drawVBOs();
+  void cleanupVBOs();
+
+private:
+
+  // HELPERS
+  void RenderTile(int tile);
+  glm::vec3 TracePixel(double i, double j) const;
+
+  // REPRESENTATION
+  RayTracer *raytracer;
+  Camera *camera;
+  int width;
+  int height;
+  std::vector<float> framebuffer;
+  // the block size of each pass, & where the current pass is
+  std::vector<int> block_sizes;
+  int tiles_x;
+  int tiles_y;
+  int pass;
+  int next_tile;
+  bool rendering;
+  double seconds;
+  // the rows traced since the last upload
+  int dirty_begin;
+  int dirty_end;
+
+  // the image plane corners, from the camera at Start
+  glm::vec3 corners[4];
+  std::vector<float> upload;
+  int texture_width;
+  int texture_height;
+  int shown_passes;
+  GLuint texture;
+  GLuint quad_VBO;
+  GLuint quad_indices_VBO;
+};
+
+// ====================================================================
+// ====================================================================
+
+#endif
@@ -0,0 +1,232 @@
+#include "glCanvas.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "profiler.h"
+#include "argparser.h"
+
+// the overlay: the last frames as bars, full height at this many ms
+#define PROFILE_GRAPH_MS 50.0
+// frames averaged for the title, & how often it is rewritten
+#define PROFILE_TITLE_FRAMES 30
+#define PROFILE_TITLE_SECONDS 0.5
+
+static const char *scope_names[NUM_PROFILE_SCOPES] = {
+  "animate", "radiosity_vbos", "rigger_joints", "rigger_bones", "preview_render", "preview_vbos" };
+static const char *counter_names[NUM_PROFILE_COUNTERS] = { "rays_cast", "faces_uploaded", "bytes_uploaded" };
+
+// the scopes that never overlap, stacked in the bars (the rest of the
+// frame is grey).  animate holds some of them, so it isn't drawn.
+#define NUM_STACKED_SCOPES 5
+static const int stacked_scopes[NUM_STACKED_SCOPES] = {
+  PROFILE_RADIOSITY_VBOS, PROFILE_RIGGER_JOINTS, PROFILE_RIGGER_BONES, PROFILE_PREVIEW_RENDER, PROFILE_PREVIEW_VBOS };
+static const glm::vec4 stacked_colors[NUM_STACKED_SCOPES] = {
+  glm::vec4(0.2,0.8,0.2,1), glm::vec4(0.9,0.9,0.1,1), glm::vec4(0.9,0.5,0.1,1),
+  glm::vec4(0.2,0.4,1.0,1), glm::vec4(0.8,0.2,0.8,1) };
+
+// the trace times are from here
+static double profile_epoch = omp_get_wtime();
+
+Profiler::ProfileThread Profiler::threads[PROFILE_MAX_THREADS];
+Profiler::ProfileFrame Profiler::frames[PROFILE_FRAMES];
+long long Profiler::next_frame = 0;
+double Profiler::frame_begin = profile_epoch;
+Profiler::ProfileEvent Profiler::events[PROFILE_EVENTS];
+long long Profiler::next_event = 0;
+
+bool Profiler::shown = false;
+double Profiler::title_time = 0;
+GLuint Profiler::overlay_verts_VBO;
+GLuint Profiler::overlay_tri_indices_VBO;
+std::vector<VBOPosNormalColor> Profiler::overlay_verts;
+std::vector<VBOIndexedTri> Profiler::overlay_tri_indices;
+
+// ===========================================================================
+// the frames
+
+bool Profiler::isEnabled() {
+#ifdef RIGGER_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Profiler::EndFrame() {
+  double now = omp_get_wtime();
+  ProfileFrame &frame = frames[next_frame % PROFILE_FRAMES];
+  memset(&frame,0,sizeof(ProfileFrame));
+  frame.begin = frame_begin;
+  frame.seconds = now-frame_begin;
+  for (int t = 0; t < PROFILE_MAX_THREADS; t++) {
+    for (int s = 0; s < NUM_PROFILE_SCOPES; s++) {
+      frame.scope_seconds[s] += threads[t].seconds[s];
+      frame.calls[s] += threads[t].calls[s];
+    }
+    for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) frame.counts[c] += threads[t].counts[c];
+  }
+  memset(threads,0,sizeof(threads));
+  next_frame++;
+  frame_begin = now;
+}
+
+// complete ("X") events for the scopes & the frames, a counter ("C")
+// event per frame, all in microseconds
+bool Profiler::ExportTrace(const std::string &filename) {
+  FILE *file = fopen(filename.c_str(),"w");
+  if (file == NULL) return false;
+  fprintf (file,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf (file,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"frames\"}},\n");
+  fprintf (file,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"main\"}}");
+  long long first_frame = std::max(0LL,next_frame-PROFILE_FRAMES);
+  for (long long i = first_frame; i < next_frame; i++) {
+    const ProfileFrame &frame = frames[i % PROFILE_FRAMES];
+    double ts = 1e6*(frame.begin-profile_epoch);
+    fprintf (file,",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+             ts,1e6*frame.seconds);
+    fprintf (file,",\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{",ts);
+    for (int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+      fprintf (file,"%s\"%s\":%lld",c > 0 ? "," : "",counter_names[c],frame.counts[c]);
+    fprintf (file,"}}");
+  }
+  long long first_event = std::max(0LL,next_event-PROFILE_EVENTS);
+  for (long long i = first_event; i < next_event; i++) {
+    const ProfileEvent &event = events[i % PROFILE_EVENTS];
+    fprintf (file,",\n{\"name\":\"%s\",\"cat\":\"rigger\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":2}",
+             scope_names[event.scope],1e6*(event.begin-profile_epoch),1e6*event.seconds);
+  }
+  fprintf (file,"\n]}\n");
+  fclose(file);
+  return true;
+}
+
+// ===========================================================================
+// the overlay
+
+void Profiler::Toggle() {
+  if (!isEnabled()) {
+    std::cout << "profiling is compiled out (build with RIGGER_PROFILE)" << std::endl;
+    return;
+  }
+  shown = !shown;
+  if (!shown) glfwSetWindowTitle(GLCanvas::window,"OpenGL viewer");
+  title_time = 0;
+}
+
+// the averages over the last few frames, per frame
+void Profiler::setTitle() {
+  int n = std::min<long long>(next_frame,PROFILE_TITLE_FRAMES);
+  if (n == 0) return;
+  double seconds = 0, scope_seconds[NUM_PROFILE_SCOPES] = {0}, counts[NUM_PROFILE_COUNTERS] = {0};
+  for (long long i = next_frame-n; i < next_frame; i++) {
+    const ProfileFrame &frame = frames[i % PROFILE_FRAMES];
+    seconds += frame.seconds / n;
+    for (int s = 0; s < NUM_PROFILE_SCOPES; s++) scope_seconds[s] += 1000*frame.scope_seconds[s] / n;
+    for (int c = 0; c < NUM_PROFILE_COUNTERS; c++) counts[c] += frame.counts[c] / double(n);
+  }
+  char title[512];
+  snprintf (title,sizeof(title),"frame %.1f ms (%.0f fps) | animate %.2f | radiosity vbos %.2f | joints %.2f | "
+            "bones %.2f | preview %.2f + %.2f upload | %.0f rays, %.0f faces, %.1f KB to GL",
+            1000*seconds,seconds > 0 ? 1/seconds : 0,scope_seconds[PROFILE_ANIMATE],scope_seconds[PROFILE_RADIOSITY_VBOS],
+            scope_seconds[PROFILE_RIGGER_JOINTS],scope_seconds[PROFILE_RIGGER_BONES],scope_seconds[PROFILE_PREVIEW_RENDER],
+            scope_seconds[PROFILE_PREVIEW_VBOS],counts[PROFILE_RAYS_CAST],
+            counts[PROFILE_FACES_UPLOADED],counts[PROFILE_BYTES_UPLOADED]/1024);
+  glfwSetWindowTitle(GLCanvas::window,title);
+}
+
+// a quad in normalized device coordinates (counter clockwise)
+static void AddQuad(std::vector<VBOPosNormalColor> &verts, std::vector<VBOIndexedTri> &tris,
+                    float x0, float y0, float x1, float y1, const glm::vec4 &color) {
+  int start = verts.size();
+  glm::vec3 normal(0,0,1);
+  verts.push_back(VBOPosNormalColor(glm::vec3(x0,y0,0),normal,color));
+  verts.push_back(VBOPosNormalColor(glm::vec3(x1,y0,0),normal,color));
+  verts.push_back(VBOPosNormalColor(glm::vec3(x1,y1,0),normal,color));
+  verts.push_back(VBOPosNormalColor(glm::vec3(x0,y1,0),normal,color));
+  tris.push_back(VBOIndexedTri(start,start+1,start+2));
+  tris.push_back(VBOIndexedTri(start,start+2,start+3));
+}
+
+void Profiler::initializeVBOs() {
+  glGenBuffers(1, &overlay_verts_VBO);
+  glGenBuffers(1, &overlay_tri_indices_VBO);
+}
+
+// a bar per frame in the lower left corner, oldest on the left
+void Profiler::setupVBOs() {
+  if (!shown) return;
+  double now = omp_get_wtime();
+  if (now-title_time > PROFILE_TITLE_SECONDS) {
+    setTitle();
+    title_time = now;
+  }
+  overlay_verts.clear();
+  overlay_tri_indices.clear();
+  float left = -0.98, bottom = -0.98, width = 0.9, height = 0.5;
+  float column = width / PROFILE_FRAMES;
+  float scale = height / PROFILE_GRAPH_MS;
+  AddQuad(overlay_verts,overlay_tri_indices,left,bottom,left+width,bottom+height,glm::vec4(0.1,0.1,0.1,1));
+  long long first_frame = std::max(0LL,next_frame-PROFILE_FRAMES);
+  for (long long i = first_frame; i < next_frame; i++) {
+    const ProfileFrame &frame = frames[i % PROFILE_FRAMES];
+    float x = left + column*(i-first_frame);
+    float y = bottom;
+    for (int k = 0; k < NUM_STACKED_SCOPES; k++) {
+      float h = std::min(bottom+height-y,float(scale*1000*frame.scope_seconds[stacked_scopes[k]]));
+      if (h <= 0) continue;
+      AddQuad(overlay_verts,overlay_tri_indices,x,y,x+column,y+h,stacked_colors[k]);
+      y += h;
+    }
+    float top = std::min(bottom+height,float(bottom+scale*1000*frame.seconds));
+    if (top > y) AddQuad(overlay_verts,overlay_tri_indices,x,y,x+column,top,glm::vec4(0.5,0.5,0.5,1));
+  }
+  // 60 & 30 frames per second
+  for (int fps = 30; fps <= 60; fps += 30) {
+    float y = bottom + scale*1000.0/fps;
+    AddQuad(overlay_verts,overlay_tri_indices,left,y,left+width,y+0.004,glm::vec4(1,1,1,1));
+  }
+  glBindBuffer(GL_ARRAY_BUFFER,overlay_verts_VBO);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(VBOPosNormalColor)*overlay_verts.size(),&overlay_verts[0],GL_STREAM_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,overlay_tri_indices_VBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(VBOIndexedTri)*overlay_tri_indices.size(),&overlay_tri_indices[0],GL_STREAM_DRAW);
+}
+
+// on top of everything, without the camera
+void Profiler::drawVBOs() {
+  if (!shown || overlay_tri_indices.size() == 0) return;
+  glm::mat4 identity(1.0f);
+  glUniformMatrix4fv(GLCanvas::MatrixID, 1, GL_FALSE, &identity[0][0]);
+  glUniformMatrix4fv(GLCanvas::ModelMatrixID, 1, GL_FALSE, &identity[0][0]);
+  glUniformMatrix4fv(GLCanvas::ViewMatrixID, 1, GL_FALSE, &identity[0][0]);
+  glUniform1i(GLCanvas::colormodeID, 0);
+  glUniform1i(GLCanvas::wireframeID, 0);
+  glDisable(GL_DEPTH_TEST);
+  glBindBuffer(GL_ARRAY_BUFFER,overlay_verts_VBO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,overlay_tri_indices_VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)sizeof(glm::vec3) );
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2));
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)));
+  glEnableVertexAttribArray(4);
+  glVertexAttribPointer(4, 2, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)*2));
+  glDrawElements(GL_TRIANGLES, overlay_tri_indices.size()*3, GL_UNSIGNED_INT, 0);
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glDisableVertexAttribArray(2);
+  glDisableVertexAttribArray(3);
+  glDisableVertexAttribArray(4);
+  glEnable(GL_DEPTH_TEST);
+  glUniform1i(GLCanvas::wireframeID, GLCanvas::args->wireframe);
+}
+
+void Profiler::cleanupVBOs() {
+  glDeleteBuffers(1, &overlay_verts_VBO);
+  glDeleteBuffers(1, &overlay_tri_indices_VBO);
+}
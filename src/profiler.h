@@ -0,0 +1,147 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include "vbo_structs.h"
+
+// WHAT IS TIMED & COUNTED
+#define NUM_PROFILE_SCOPES 6
+enum PROFILE_SCOPE { PROFILE_ANIMATE, PROFILE_RADIOSITY_VBOS, PROFILE_RIGGER_JOINTS, PROFILE_RIGGER_BONES,
+                     PROFILE_PREVIEW_RENDER, PROFILE_PREVIEW_VBOS };
+#define NUM_PROFILE_COUNTERS 3
+enum PROFILE_COUNTER { PROFILE_RAYS_CAST, PROFILE_FACES_UPLOADED, PROFILE_BYTES_UPLOADED };
+
+// the frames kept for the overlay, & the scopes kept for the trace
+#define PROFILE_FRAMES 240
+#define PROFILE_EVENTS 65536
+// threads beyond this share slots (& may lose a few counts)
+#define PROFILE_MAX_THREADS 64
+
+// ====================================================================
+// ====================================================================
+// Scoped timers & counters on the hot paths, compiled in with
+// RIGGER_PROFILE (otherwise the macros below are empty):
+//
+//   PROFILE_SCOPE(PROFILE_ANIMATE);           // until the end of the block
+//   PROFILE_COUNT(PROFILE_BYTES_UPLOADED,n);
+//
+// Each thread adds into its own slot, so the timers & counters are
+// safe (& cheap) inside parallel loops.  Reading the clock costs about
+// as much as a ray that misses, so the per ray code (CastRay) is only
+// counted, the tracing is timed by its callers.  EndFrame sums the
+// slots into a ring buffer of the last PROFILE_FRAMES frames.  The
+// scopes timed on the main thread (outside parallel regions) are also
+// kept as events, which ExportTrace writes in the Chrome trace event
+// format (load the file in chrome://tracing or Perfetto).  The overlay
+// draws the recent frames as stacked bars & the averages go in the
+// window title.
+//
+// This class only contains static variables and static member
+// functions, like RayTree.
+
+class Profiler {
+
+public:
+
+  // true if built with RIGGER_PROFILE
+  static bool isEnabled();
+
+  // ADD TO THE CURRENT FRAME
+  static void Record(int scope, double begin, double seconds) {
+    ProfileThread &t = threads[omp_get_thread_num() % PROFILE_MAX_THREADS];
+    t.seconds[scope] += seconds;
+    t.calls[scope]++;
+    if (!omp_in_parallel()) AddEvent(scope,begin,seconds);
+  }
+  static void Count(int counter, long long n) {
+    threads[omp_get_thread_num() % PROFILE_MAX_THREADS].counts[counter] += n;
+  }
+
+  // once per frame, from the main loop (outside any parallel region)
+  static void EndFrame();
+  // the events & frames in the rings, in the Chrome trace event format
+  static bool ExportTrace(const std::string &filename);
+
+  // THE OVERLAY
+  static bool isShown() { return shown; }
+  static void Toggle();
+  static void initializeVBOs();
+  static void setupVBOs();
+  static void drawVBOs();
+  static void cleanupVBOs();
+
+private:
+
+  // one thread's share of the current frame, a cache line apart
+  struct ProfileThread {
+    double seconds[NUM_PROFILE_SCOPES];
+    int calls[NUM_PROFILE_SCOPES];
+    long long counts[NUM_PROFILE_COUNTERS];
+    char padding[64];
+  };
+  struct ProfileFrame {
+    double begin;
+    double seconds;
+    double scope_seconds[NUM_PROFILE_SCOPES];
+    int calls[NUM_PROFILE_SCOPES];
+    long long counts[NUM_PROFILE_COUNTERS];
+  };
+  struct ProfileEvent {
+    int scope;
+    double begin;
+    double seconds;
+  };
+
+  // HELPER FUNCTIONS
+  static void AddEvent(int scope, double begin, double seconds) {
+    events[next_event % PROFILE_EVENTS] = ProfileEvent{scope,begin,seconds};
+    next_event++;
+  }
+  static void setTitle();
+
+  // REPRESENTATION
+  static ProfileThread threads[PROFILE_MAX_THREADS];
+  static ProfileFrame frames[PROFILE_FRAMES];
+  static long long next_frame;
+  static double frame_begin;
+  static ProfileEvent events[PROFILE_EVENTS];
+  static long long next_event;
+  // the overlay
+  static bool shown;
+  static double title_time;
+  static GLuint overlay_verts_VBO;
+  static GLuint overlay_tri_indices_VBO;
+  static std::vector<VBOPosNormalColor> overlay_verts;
+  static std::vector<VBOIndexedTri> overlay_tri_indices;
+};
+
+// ====================================================================
+// ====================================================================
+
+// times its block
+class ProfileTimer {
+public:
+  ProfileTimer(int s) : scope(s), begin(omp_get_wtime()) {}
+  ~ProfileTimer() { Profiler::Record(scope,begin,omp_get_wtime()-begin); }
+private:
+  int scope;
+  double begin;
+};
+
+#define PROFILE_CONCAT_HELPER(a,b) a##b
+#define PROFILE_CONCAT(a,b) PROFILE_CONCAT_HELPER(a,b)
+
+#ifdef RIGGER_PROFILE
+#define PROFILE_SCOPE(scope) ProfileTimer PROFILE_CONCAT(profile_timer_,__LINE__)(scope)
+#define PROFILE_COUNT(counter,n) Profiler::Count(counter,n)
+#else
+#define PROFILE_SCOPE(scope)
+#define PROFILE_COUNT(counter,n)
+#endif
+
+#endif
@@ -8,6 +8,7 @@
 #include "raytree.h"
 #include "raytracer.h"
 #include "utils.h"
+#include "profiler.h"
 
 // ================================================================
 // CONSTRUCTOR & DESTRUCTOR
@@ -59,10 +60,11 @@ void Radiosity::Reset() {
   undistributed = new glm::vec3[num_faces];
   absorbed = new glm::vec3[num_faces];
   radiance = new glm::vec3[num_faces];
+  const GeometryCache &geometry = mesh->getGeometryCache();
   for (int i = 0; i < num_faces; i++) {
     Face *f = mesh->getFace(i);
     f->setRadiosityPatchIndex(i);
-    setArea(i,f->getArea());
+    setArea(i,geometry.getArea(f->getGeometryIndex()));
     glm::vec3 emit = f->getMaterial()->getEmittedColor();
     setUndistributed(i,emit);
     setAbsorbed(i,glm::vec3(0,0,0));
@@ -146,22 +148,23 @@ float Radiosity::Iterate() {
 // VBO & DISPLAY FUNCTIONS
 // =======================================================================================
 
-// for interpolation
-void CollectFacesWithVertex(Vertex *have, Face *f, std::vector<Face*> &faces) {
+// for interpolation (have is a vertex index)
+void CollectFacesWithVertex(const GeometryCache &geometry, int have, Face *f, std::vector<Face*> &faces) {
   for (unsigned int i = 0; i < faces.size(); i++) {
     if (faces[i] == f) return;
   }
-  if (have != (*f)[0] && have != (*f)[1] && have != (*f)[2] && have != (*f)[3]) return;
+  const int *verts = geometry.getQuadVertices(f->getGeometryIndex());
+  if (have != verts[0] && have != verts[1] && have != verts[2] && have != verts[3]) return;
   faces.push_back(f);
   for (int i = 0; i < 4; i++) {
     Edge *ea = f->getEdge()->getOpposite();
     Edge *eb = f->getEdge()->getNext()->getOpposite();
     Edge *ec = f->getEdge()->getNext()->getNext()->getOpposite();
     Edge *ed = f->getEdge()->getNext()->getNext()->getNext()->getOpposite();
-    if (ea != NULL) CollectFacesWithVertex(have,ea->getFace(),faces);
-    if (eb != NULL) CollectFacesWithVertex(have,eb->getFace(),faces);
-    if (ec != NULL) CollectFacesWithVertex(have,ec->getFace(),faces);
-    if (ed != NULL) CollectFacesWithVertex(have,ed->getFace(),faces);
+    if (ea != NULL) CollectFacesWithVertex(geometry,have,ea->getFace(),faces);
+    if (eb != NULL) CollectFacesWithVertex(geometry,have,eb->getFace(),faces);
+    if (ec != NULL) CollectFacesWithVertex(geometry,have,ec->getFace(),faces);
+    if (ed != NULL) CollectFacesWithVertex(geometry,have,ed->getFace(),faces);
   }
 }
 
@@ -172,14 +175,16 @@ glm::vec3 Radiosity::setupHelperForColor(Face *f, int i, int j) {
   if (args->render_mode == RENDER_MATERIALS) {
     return f->getMaterial()->getDiffuseColor();
   } else if (args->render_mode == RENDER_RADIANCE && args->interpolate == true) {
+    const GeometryCache &geometry = mesh->getGeometryCache();
     std::vector<Face*> faces;
-    CollectFacesWithVertex((*f)[j],f,faces);
+    CollectFacesWithVertex(geometry,geometry.getQuadVertices(f->getGeometryIndex())[j],f,faces);
     float total = 0;
     glm::vec3 color = glm::vec3(0,0,0);
-    glm::vec3 normal = f->computeNormal();
+    glm::vec3 normal = geometry.getNormal(f->getGeometryIndex());
     for (unsigned int i = 0; i < faces.size(); i++) {
-      glm::vec3 normal2 = faces[i]->computeNormal();
-      float area = faces[i]->getArea();
+      int slot = faces[i]->getGeometryIndex();
+      glm::vec3 normal2 = geometry.getNormal(slot);
+      float area = geometry.getArea(slot);
       if (glm::dot(normal,normal2) < 0.5) continue;
       assert (area > 0);
       total += area;
@@ -217,19 +222,22 @@ void Radiosity::initializeVBOs() {
 }
 
 
-void Radiosity::setupVBOs() {
-  HandleGLError("enter radiosity setupVBOs()");
+// the vertices & triangles of every face, as setupVBOs uploads them
+// (no GL calls, so they can be built & timed without a window)
+void Radiosity::setupVBOArrays() {
   mesh_tri_verts.clear();
   mesh_tri_indices.clear();
   mesh_textured_tri_indices.clear();
 
-  // initialize the data in each vector
+  // initialize the data in each vector, from the flat geometry mirror
+  const GeometryCache &geometry = mesh->getGeometryCache();
   int num_faces = mesh->numFaces();
   assert (num_faces > 0);
   for (int i = 0; i < num_faces; i++) {
     Face *f = mesh->getFace(i);
-    Edge *e = f->getEdge();
-    glm::vec3 normal = f->computeNormal();
+    int slot = f->getGeometryIndex();
+    const int *verts = geometry.getQuadVertices(slot);
+    const glm::vec3 &normal = geometry.getNormal(slot);
 
     double avg_s = 0;
     double avg_t = 0;
@@ -246,9 +254,10 @@ void Radiosity::setupVBOs() {
 
     // add the 4 corner vertices
     for (int j = 0; j < 4; j++) {
-      glm::vec3 pos = ((*f)[j])->get();
-      double s = (*f)[j]->get_s();
-      double t = (*f)[j]->get_t();
+      glm::vec3 pos = geometry.getPosition(verts[j]);
+      const Vertex *v = mesh->getVertex(verts[j]);
+      double s = v->get_s();
+      double t = v->get_t();
       glm::vec3 color = setupHelperForColor(f,i,j);
       color = glm::vec3(linear_to_srgb(color.r),
                         linear_to_srgb(color.g),
@@ -260,11 +269,10 @@ void Radiosity::setupVBOs() {
                                                  s,t));
       avg_s += 0.25 * s;
       avg_t += 0.25 * t;
-      e = e->getNext();
     }
 
     // the centroid (for wireframe rendering)
-    glm::vec3 centroid = f->computeCentroid();
+    const glm::vec3 &centroid = geometry.getCentroid(slot);
     mesh_tri_verts.push_back(VBOPosNormalColor(centroid,normal,
                                                glm::vec4(avg_color.r,avg_color.g,avg_color.b,1),
                                                glm::vec4(1,1,1,1),
@@ -284,6 +292,14 @@ void Radiosity::setupVBOs() {
   }
   assert ((int)mesh_tri_verts.size() == num_faces*5);
   assert ((int)mesh_tri_indices.size() + (int)mesh_textured_tri_indices.size() == num_faces*4);
+}
+
+
+void Radiosity::setupVBOs() {
+  PROFILE_SCOPE(PROFILE_RADIOSITY_VBOS);
+  HandleGLError("enter radiosity setupVBOs()");
+  setupVBOArrays();
+  int num_faces = mesh->numFaces();
   
   // copy the data to each VBO
   glBindBuffer(GL_ARRAY_BUFFER,mesh_tri_verts_VBO); 
@@ -302,6 +318,9 @@ void Radiosity::setupVBOs() {
                  &mesh_textured_tri_indices[0], GL_STATIC_DRAW);
     
   }
+  PROFILE_COUNT(PROFILE_FACES_UPLOADED,num_faces);
+  PROFILE_COUNT(PROFILE_BYTES_UPLOADED,sizeof(VBOPosNormalColor) * mesh_tri_verts.size() +
+                sizeof(VBOIndexedTri) * (mesh_tri_indices.size() + mesh_textured_tri_indices.size()));
 
   HandleGLError("radiosity setupVBOs() just before texture");
 
@@ -33,6 +33,8 @@ public:
 
   void initializeVBOs(); 
   void setupVBOs(); 
+  // the arrays setupVBOs uploads, without touching GL
+  void setupVBOArrays();
   void drawVBOs();
   void cleanupVBOs();
 
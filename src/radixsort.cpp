@@ -0,0 +1,61 @@
+#include <algorithm>
+#include <cassert>
+#include <omp.h>
+
+#include "radixsort.h"
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+// arrays smaller than this are sorted by a single thread
+#define PARALLEL_SORT_THRESHOLD 65536
+
+void RadixSort(std::vector<unsigned long long> &keys, std::vector<int> &values, int key_bits) {
+  assert (keys.size() == values.size());
+  assert (key_bits >= 0 && key_bits <= 64);
+  int n = keys.size();
+  if (n < 2) return;
+  int num_passes = (key_bits + RADIX_BITS - 1) / RADIX_BITS;
+  int num_threads = (n < PARALLEL_SORT_THRESHOLD) ? 1 : omp_get_max_threads();
+
+  std::vector<unsigned long long> tmp_keys(n);
+  std::vector<int> tmp_values(n);
+  // counts[t*RADIX_SIZE+d] is the number of keys with digit d in the
+  // range of thread t, then where thread t writes its first such key
+  std::vector<int> counts(num_threads*RADIX_SIZE);
+
+  for (int pass = 0; pass < num_passes; pass++) {
+    int shift = pass*RADIX_BITS;
+#pragma omp parallel num_threads(num_threads)
+    {
+      int t = omp_get_thread_num();
+      int nt = omp_get_num_threads();
+      int begin = (long long)n*t/nt;
+      int end = (long long)n*(t+1)/nt;
+      int *my_counts = &counts[t*RADIX_SIZE];
+      std::fill(my_counts,my_counts+RADIX_SIZE,0);
+      for (int i = begin; i < end; i++) {
+        my_counts[(keys[i] >> shift) & (RADIX_SIZE-1)]++;
+      }
+#pragma omp barrier
+#pragma omp single
+      {
+        // digit major, then thread order, keeps the sort stable
+        int offset = 0;
+        for (int d = 0; d < RADIX_SIZE; d++) {
+          for (int t2 = 0; t2 < nt; t2++) {
+            int count = counts[t2*RADIX_SIZE+d];
+            counts[t2*RADIX_SIZE+d] = offset;
+            offset += count;
+          }
+        }
+      }
+      for (int i = begin; i < end; i++) {
+        int j = my_counts[(keys[i] >> shift) & (RADIX_SIZE-1)]++;
+        tmp_keys[j] = keys[i];
+        tmp_values[j] = values[i];
+      }
+    }
+    keys.swap(tmp_keys);
+    values.swap(tmp_values);
+  }
+}
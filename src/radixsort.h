@@ -0,0 +1,14 @@
+#ifndef _RADIX_SORT_H_
+#define _RADIX_SORT_H_
+
+#include <vector>
+
+// ==================================================================
+// A parallel least significant digit radix sort of 64 bit keys, 8
+// bits per pass.  Only the low key_bits bits are examined (the higher
+// bits must be zero), so small keys take fewer passes.  The sort is
+// stable and the values are permuted along with the keys.
+
+void RadixSort(std::vector<unsigned long long> &keys, std::vector<int> &values, int key_bits);
+
+#endif
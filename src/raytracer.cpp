@@ -9,27 +9,24 @@
 #include "face.h"
 #include "primitive.h"
 #include "photon_mapping.h"
+#include "bvh.h"
+#include "profiler.h"
 
 
 // ===========================================================================
 // casts a single ray through the scene geometry and finds the closest hit
 bool RayTracer::CastRay(const Ray &ray, Hit &h, bool use_rasterized_patches) const {
+  PROFILE_COUNT(PROFILE_RAYS_CAST,1);
 
   bool answer = false;
 
   // intersect each of the quads
-  for (int i = 0; i < mesh->numOriginalQuads(); i++) {
-    Face *f = mesh->getOriginalQuad(i);
-    if (f->intersect(ray,h,args->intersect_backfacing)) answer = true;
-  }
-  
+  // (the hierarchy gives the same hit as testing every quad in order)
+  if (mesh->getOriginalQuadsBVH()->Intersect(ray,h,args->intersect_backfacing)) answer = true;
 
   // intersect each of the primitives (either the patches, or the original primitives)
   if (use_rasterized_patches) {
-    for (int i = 0; i < mesh->numRasterizedPrimitiveFaces(); i++) {
-      Face *f = mesh->getRasterizedPrimitiveFace(i);
-      if (f->intersect(ray,h,args->intersect_backfacing	)) answer = true;
-    }
+    if (mesh->getRasterizedPrimitiveFacesBVH()->Intersect(ray,h,args->intersect_backfacing)) answer = true;
   } else {
     int num_primitives = mesh->numPrimitives();
     for (int i = 0; i < num_primitives; i++) {
@@ -127,105 +124,3 @@ glm::vec3 RayTracer::TraceRay(Ray &ray, Hit &hit, int bounce_count) const {
 
 
 
-void RayTracer::initializeVBOs() {
-  glGenBuffers(1, &pixels_a_VBO);
-  glGenBuffers(1, &pixels_b_VBO);
-  glGenBuffers(1, &pixels_indices_a_VBO);
-  glGenBuffers(1, &pixels_indices_b_VBO);
-  render_to_a = true;
-}
-
-
-void RayTracer::resetVBOs() {
-
-  pixels_a.clear();
-  pixels_b.clear();
-
-  pixels_indices_a.clear();
-  pixels_indices_b.clear();
-
-  render_to_a = true;
-}
-
-void RayTracer::setupVBOs() {
-
-  glBindBuffer(GL_ARRAY_BUFFER,pixels_a_VBO); 
-  glBufferData(GL_ARRAY_BUFFER,sizeof(VBOPosNormalColor)*pixels_a.size(),&pixels_a[0],GL_STATIC_DRAW); 
-  glBindBuffer(GL_ARRAY_BUFFER,pixels_b_VBO); 
-  glBufferData(GL_ARRAY_BUFFER,sizeof(VBOPosNormalColor)*pixels_b.size(),&pixels_b[0],GL_STATIC_DRAW); 
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,pixels_indices_a_VBO); 
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	       sizeof(VBOIndexedTri) * pixels_indices_a.size(),
-	       &pixels_indices_a[0], GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,pixels_indices_b_VBO); 
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-	       sizeof(VBOIndexedTri) * pixels_indices_b.size(),
-	       &pixels_indices_b[0], GL_STATIC_DRAW);
-
-}
-
-void RayTracer::drawVBOs() {
-  // turn off lighting
-  glUniform1i(GLCanvas::colormodeID, 0);
-  // turn off depth buffer
-  glDisable(GL_DEPTH_TEST);
-
-  if (render_to_a) {
-    drawVBOs_b();
-    drawVBOs_a();
-  } else {
-    drawVBOs_a();
-    drawVBOs_b();
-  }
-
-  glEnable(GL_DEPTH_TEST);
-}
-
-void RayTracer::drawVBOs_a() {
-  if (pixels_a.size() == 0) return;
-  glBindBuffer(GL_ARRAY_BUFFER, pixels_a_VBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,pixels_indices_a_VBO); 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)sizeof(glm::vec3) );
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2));
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)));
-  glDrawElements(GL_TRIANGLES,
-                 pixels_indices_a.size()*3,
-                 GL_UNSIGNED_INT, 0);
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-  glDisableVertexAttribArray(2);
-  glDisableVertexAttribArray(3);
-}
-
-void RayTracer::drawVBOs_b() {
-  if (pixels_b.size() == 0) return;
-  glBindBuffer(GL_ARRAY_BUFFER, pixels_b_VBO);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,pixels_indices_b_VBO); 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)0);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor),(void*)sizeof(glm::vec3) );
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2));
-  glEnableVertexAttribArray(3);
-  glVertexAttribPointer(3, 3, GL_FLOAT,GL_FALSE,sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3)*2 + sizeof(glm::vec4)));
-  glDrawElements(GL_TRIANGLES,
-                 pixels_indices_b.size()*3,
-                 GL_UNSIGNED_INT, 0);
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-  glDisableVertexAttribArray(2);
-  glDisableVertexAttribArray(3);
-}
-
-
-void RayTracer::cleanupVBOs() {
-  glDeleteBuffers(1, &pixels_a_VBO);
-  glDeleteBuffers(1, &pixels_b_VBO);
-}
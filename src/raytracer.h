@@ -11,7 +11,6 @@
 #include <vector>
 #include "ray.h"
 #include "hit.h"
-#include "vbo_structs.h"
 
 class Mesh;
 class ArgParser;
@@ -35,12 +34,6 @@ public:
   void setRadiosity(Radiosity *r) { radiosity = r; }
   void setPhotonMapping(PhotonMapping *pm) { photon_mapping = pm; }
 
-  void initializeVBOs(); 
-  void resetVBOs(); 
-  void setupVBOs(); 
-  void drawVBOs();
-  void cleanupVBOs();
-
   // casts a single ray through the scene geometry and finds the closest hit
   bool CastRay(const Ray &ray, Hit &h, bool use_sphere_patches) const;
 
@@ -49,34 +42,12 @@ public:
 
 private:
 
-  void drawVBOs_a();
-  void drawVBOs_b();
-
   // REPRESENTATION
   Mesh *mesh;
   ArgParser *args;
   Radiosity *radiosity;
   PhotonMapping *photon_mapping;
 
-public:
-  //float pixels_a_size;
-  ///float pixels_b_size;
-
-
-  bool render_to_a;
-  std::vector<VBOPosNormalColor> pixels_a;
-  std::vector<VBOPosNormalColor> pixels_b;
-  std::vector<VBOIndexedTri> pixels_indices_a;
-  std::vector<VBOIndexedTri> pixels_indices_b;
-
-
-private:
-
-  GLuint pixels_a_VBO;
-  GLuint pixels_b_VBO;
-  GLuint pixels_indices_a_VBO;
-  GLuint pixels_indices_b_VBO;
-
 };
 
 // ====================================================================
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+#include "joint.h"
+
+// ====================================================================
+// Converts a rig between the text (.rig) and binary (.rigb) formats.
+// The input format is detected from the file, the output format
+// follows the extension of the output file:
+//
+//   rig_convert character.rig character.rigb
+//   rig_convert character.rigb character.rig
+// ====================================================================
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <input .rig/.rigb> <output .rig/.rigb>" << std::endl;
+    return 1;
+  }
+  JointTree tree;
+  if (!tree.Parallel_load(argv[1])) {
+    std::cerr << "ERROR: could not read " << argv[1] << std::endl;
+    return 1;
+  }
+  if (!tree.Save(argv[2])) {
+    std::cerr << "ERROR: could not write " << argv[2] << std::endl;
+    return 1;
+  }
+  std::cout << "converted " << tree.size() << " joints: " << argv[1] << " -> " << argv[2] << std::endl;
+  return 0;
+}
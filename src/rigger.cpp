@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cassert>
 #include "rigger.h"
 #include "raytracer.h"
+#include "camera.h"
+#include "ray.h"
 #include "joint.h"
 #include "hit.h"
 #include "vbo_structs.h"
@@ -7,196 +11,258 @@
 #include <omp.h>
 #include "glCanvas.h"
 #include "utils.h"
+#include "profiler.h"
 #include "argparser.h"
 
 
 
-void Rigger::initializeVBOs() {
-	glGenBuffers(1, &joints_pixels_VBO);
-	glGenBuffers(1, &joints_pixels_indices_VBO);
-	glGenBuffers(1, &bones_pixels_VBO);
-	glGenBuffers(1, &bones_pixels_indices_VBO);
-	glGenBuffers(1, &sketch_pixels_VBO);
-	glGenBuffers(1, &sketch_pixels_indices_VBO);
-}
-
-void Rigger::resetVBOs() {
-
-	joints_pixel.clear();
-	bones_pixels.clear();
+// the size of the joint cubes & the bone boxes
+#define RIGGER_JOINT_SIZE 0.05f
+#define RIGGER_BONE_THICKNESS 0.01f
 
-	joints_pixel_indices.clear();
-	bones_pixels_indices.clear();
-}
-
-void Rigger::setupJoints() {
-	float offset = 0.05f; //controls the size of rendered joint nodes
+static glm::vec4 JointColor(const Joint &joint) {
 	glm::vec4 selected_color = glm::vec4(1.0, 1.0, 0.0, 1.0);
 	glm::vec4 unselected_color = glm::vec4(1.0, 0.0, 0.0, 1.0);
+	return joint.isSelected() ? unselected_color : selected_color;
+}
 
-//#pragma omp parallel for
-	//run through "tree" and get positions to make cubes to represent joints3
-	for (int j = 0; j < jt->size(); ++j) {
-		//run through each joint and create cube
-		//BONUS: make cube camera facing
+// the cube around the origin, a quad per face
+static void JointCube(std::vector<VBOPosNormalColor> &verts, std::vector<VBOIndexedTri> &tris) {
+	float offset = RIGGER_JOINT_SIZE;
+	glm::vec3 a = glm::vec3(-offset, offset, offset);
+	glm::vec3 b = glm::vec3(offset, offset, offset);
+	glm::vec3 c = glm::vec3(offset, offset, -offset);
+	glm::vec3 d = glm::vec3(-offset, offset, -offset);
+	glm::vec3 e = glm::vec3(-offset, -offset, offset);
+	glm::vec3 f = glm::vec3(offset, -offset, offset);
+	glm::vec3 g = glm::vec3(offset, -offset, -offset);
+	glm::vec3 h = glm::vec3(-offset, -offset, -offset);
 
-		Joint joint_node = jt->getJoint(j);
-		glm::vec3 p = joint_node.getPos();
-		glm::vec3 a = p + glm::vec3(-offset, offset, offset);
-		glm::vec3 b = p + glm::vec3(offset, offset, offset);
-		glm::vec3 c = p + glm::vec3(offset, offset, -offset);
-		glm::vec3 d = p + glm::vec3(-offset, offset, -offset);
-		glm::vec3 e = p + glm::vec3(-offset, -offset, offset);
-		glm::vec3 f = p + glm::vec3(offset, -offset, offset);
-		glm::vec3 g = p + glm::vec3(offset, -offset, -offset);
-		glm::vec3 h = p + glm::vec3(-offset, -offset, -offset);
+	//normals
+	glm::vec3 normal_FF = computeNormal(a, e, b);
+	glm::vec3 normal_BF = computeNormal(c, g, d);
+	glm::vec3 normal_LF = computeNormal(d, h, a);
+	glm::vec3 normal_RF = computeNormal(b, f, c);
+	glm::vec3 normal_TF = computeNormal(d, a, c);
+	glm::vec3 normal_UF = computeNormal(e, f, h);
+
+	// front, back, left, right, top & under faces
+	glm::vec3 corners[24] = { a, e, b, f,  c, g, d, h,  d, h, a, e,  b, f, c, g,  d, a, c, b,  e, h, f, g };
+	glm::vec3 normals[6] = { normal_FF, normal_BF, normal_LF, normal_RF, normal_TF, normal_UF };
+	glm::vec4 color(1, 1, 1, 1); // per instance
+	for (int start = 0; start < 24; start += 4) {
+		for (int v = start; v < start + 4; v++) verts.push_back(VBOPosNormalColor(corners[v], normals[start / 4], color));
+		tris.push_back(VBOIndexedTri(start, start + 1, start + 2));
+		tris.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
+	}
+}
 
-		//normals
-		glm::vec3 normal_FF = computeNormal(a, e, b);
-		glm::vec3 normal_BF = computeNormal(c, g, d);
-		glm::vec3 normal_LF = computeNormal(d, h, a);
-		glm::vec3 normal_RF = computeNormal(b, f, c);
-		glm::vec3 normal_TF = computeNormal(d, a, c);
-		glm::vec3 normal_UF = computeNormal(e, f, h);
+static void PackColor(const glm::vec4 &color, unsigned char *rgba) {
+	for (int i = 0; i < 4; i++) rgba[i] = (unsigned char)(255 * glm::clamp(color[i], 0.0f, 1.0f) + 0.5f);
+}
 
-		//color based on selection
-		glm::vec4 color;
-		joint_node.isSelected() ? color = unselected_color : color = selected_color;
+// the rotation taking +x to the unit vector dir, as a quaternion (xyzw)
+static glm::vec4 RotationFromX(const glm::vec3 &dir) {
+	if (dir.x < -1 + 1e-6f) return glm::vec4(0, 1, 0, 0);
+	return glm::normalize(glm::vec4(0, -dir.z, dir.y, 1 + dir.x));
+}
 
-		//FF - Front Face
-		int start;
-		start = joints_pixel.size();
-		joints_pixel.push_back(VBOPosNormalColor(a, normal_FF, color));
-		joints_pixel.push_back(VBOPosNormalColor(e, normal_FF, color));
-		joints_pixel.push_back(VBOPosNormalColor(b, normal_FF, color));
-		joints_pixel.push_back(VBOPosNormalColor(f, normal_FF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
-		
-		//BF - Back Face
-		start += 4;
-		joints_pixel.push_back(VBOPosNormalColor(c, normal_BF, color));
-		joints_pixel.push_back(VBOPosNormalColor(g, normal_BF, color));
-		joints_pixel.push_back(VBOPosNormalColor(d, normal_BF, color));
-		joints_pixel.push_back(VBOPosNormalColor(h, normal_BF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
+// make room for n instances.  a reallocation doubles the capacity & empties
+// the buffers, so the caller uploads every instance again.
+static bool ReserveInstances(int n, int &capacity, GLuint instance_VBO, size_t instance_size, GLuint color_VBO,
+			     size_t color_size) {
+	if (n <= capacity) return false;
+	capacity = std::max(n, std::max(16, 2 * capacity));
+	glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+	glBufferData(GL_ARRAY_BUFFER, instance_size * capacity, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, color_VBO);
+	glBufferData(GL_ARRAY_BUFFER, color_size * capacity, NULL, GL_DYNAMIC_DRAW);
+	return true;
+}
 
-		//LF - Left Face
-		start += 4;
-		joints_pixel.push_back(VBOPosNormalColor(d, normal_LF, color));
-		joints_pixel.push_back(VBOPosNormalColor(h, normal_LF, color));
-		joints_pixel.push_back(VBOPosNormalColor(a, normal_LF, color));
-		joints_pixel.push_back(VBOPosNormalColor(e, normal_LF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
+// upload each run of consecutive dirty instances with one glBufferSubData
+template <class T>
+static void UploadRuns(GLuint VBO, const std::vector<char> &dirty, const std::vector<T> &data) {
+	int n = dirty.size();
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	for (int s = 0; s < n; s++) {
+		if (!dirty[s]) continue;
+		int end = s + 1;
+		while (end < n && dirty[end]) end++;
+		glBufferSubData(GL_ARRAY_BUFFER, sizeof(T) * s, sizeof(T) * (end - s), &data[s]);
+		PROFILE_COUNT(PROFILE_BYTES_UPLOADED, sizeof(T) * (end - s));
+		s = end;
+	}
+}
 
-		//RF - Right Face
-		start += 4;
-		joints_pixel.push_back(VBOPosNormalColor(b, normal_RF, color));
-		joints_pixel.push_back(VBOPosNormalColor(f, normal_RF, color));
-		joints_pixel.push_back(VBOPosNormalColor(c, normal_RF, color));
-		joints_pixel.push_back(VBOPosNormalColor(g, normal_RF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
+void Rigger::initializeVBOs() {
+	glGenBuffers(1, &joints_pixels_VBO);
+	glGenBuffers(1, &joints_pixels_indices_VBO);
+	glGenBuffers(1, &joints_instances_VBO);
+	glGenBuffers(1, &joints_colors_VBO);
+	glGenBuffers(1, &bones_pixels_VBO);
+	glGenBuffers(1, &bones_pixels_indices_VBO);
+	glGenBuffers(1, &bones_instances_VBO);
+	glGenBuffers(1, &bones_colors_VBO);
+	glGenBuffers(1, &sketch_pixels_VBO);
+	glGenBuffers(1, &sketch_pixels_indices_VBO);
 
-		//TF - Top Face
-		start += 4;
-		joints_pixel.push_back(VBOPosNormalColor(d, normal_TF, color));
-		joints_pixel.push_back(VBOPosNormalColor(a, normal_TF, color));
-		joints_pixel.push_back(VBOPosNormalColor(c, normal_TF, color));
-		joints_pixel.push_back(VBOPosNormalColor(b, normal_TF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
+	// the shared meshes, uploaded once
+	std::vector<VBOPosNormalColor> verts;
+	std::vector<VBOIndexedTri> tris;
+	JointCube(verts, tris);
+	joint_mesh_tris = tris.size();
+	glBindBuffer(GL_ARRAY_BUFFER, joints_pixels_VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor) * verts.size(), &verts[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, joints_pixels_indices_VBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(VBOIndexedTri) * tris.size(), &tris[0], GL_STATIC_DRAW);
+	verts.clear();
+	tris.clear();
+	glm::vec4 color(1, 1, 1, 1); // per instance
+	addEdgeGeometry(verts, tris, glm::vec3(0, 0, 0), glm::vec3(1, 0, 0), color, color, RIGGER_BONE_THICKNESS, RIGGER_BONE_THICKNESS);
+	bone_mesh_tris = tris.size();
+	glBindBuffer(GL_ARRAY_BUFFER, bones_pixels_VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor) * verts.size(), &verts[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bones_pixels_indices_VBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(VBOIndexedTri) * tris.size(), &tris[0], GL_STATIC_DRAW);
 
-		//UF - Under Face
-		start += 4;
-		joints_pixel.push_back(VBOPosNormalColor(e, normal_UF, color));
-		joints_pixel.push_back(VBOPosNormalColor(h, normal_UF, color));
-		joints_pixel.push_back(VBOPosNormalColor(f, normal_UF, color));
-		joints_pixel.push_back(VBOPosNormalColor(g, normal_UF, color));
-		joints_pixel_indices.push_back(VBOIndexedTri(start, start + 1, start + 2));
-		joints_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 1, start + 3));
-	}
+	joint_capacity = 0;
+	bone_capacity = 0;
+	resetVBOs();
+}
 
-	if (joints_pixel.size() > 0) {
-		glBindBuffer(GL_ARRAY_BUFFER, joints_pixels_VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor)*joints_pixel.size(), &joints_pixel[0], GL_STATIC_DRAW);
+void Rigger::resetVBOs() {
+	uploaded_joints.clear();
+	uploaded_bones.clear();
+}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, joints_pixels_indices_VBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			sizeof(VBOIndexedTri) * joints_pixel_indices.size(),
-			&joints_pixel_indices[0], GL_STATIC_DRAW);
+void Rigger::setupJoints() {
+	PROFILE_SCOPE(PROFILE_RIGGER_JOINTS);
+	int n = jt->size();
+	if (ReserveInstances(n, joint_capacity, joints_instances_VBO, sizeof(Instance), joints_colors_VBO, sizeof(InstanceColor))) {
+		uploaded_joints.clear();
 	}
+	UploadedJoint nothing = { glm::vec3(0, 0, 0), -1 };
+	uploaded_joints.resize(n, nothing);
+	joints_instances.resize(n);
+	joints_colors.resize(n);
+	num_joints = n;
+
+	// compare with what was uploaded: a move rewrites the instance, a
+	// selection only the colour
+	std::vector<char> moved(n, 0), recolored(n, 0);
+	bool any_moved = false, any_recolored = false;
+	for (int j = 0; j < n; ++j) {
+		const Joint &joint_node = jt->getJoint(j);
+		UploadedJoint &uploaded = uploaded_joints[j];
+		int selected = joint_node.isSelected() ? 1 : 0;
+		if (uploaded.selected < 0 || uploaded.pos != joint_node.getPos()) {
+			joints_instances[j].position_length = glm::vec4(joint_node.getPos(), 1);
+			joints_instances[j].rotation = glm::vec4(0, 0, 0, 1);
+			uploaded.pos = joint_node.getPos();
+			moved[j] = any_moved = true;
+		}
+		if (uploaded.selected != selected) {
+			PackColor(JointColor(joint_node), joints_colors[j].rgba);
+			uploaded.selected = selected;
+			recolored[j] = any_recolored = true;
+		}
+	}
+	if (any_moved) UploadRuns(joints_instances_VBO, moved, joints_instances);
+	if (any_recolored) UploadRuns(joints_colors_VBO, recolored, joints_colors);
 }
 
 void Rigger::setupBones() {
-	float line_thickness = 0.01f; //controls the size of rendered joint nodes
-	glm::vec4 selected_color = glm::vec4(1.0, 1.0, 0.0, 1.0);
-	glm::vec4 unselected_color = glm::vec4(1.0, 0.0, 0.0, 1.0);
-
-	//run through "tree" and get positions to make cubes to represent joints3
-//#pragma omp parallel for
-	for (int j = 0; j < jt->size(); ++j) {
-		Joint joint_node = jt->getJoint(j);
-		if (joint_node.getParent() < 0) { continue; }
-
-		int parent_id = joint_node.getParent();
-		Joint parent_joint = jt->getJoint(parent_id);
-
-		//color based on selection
-		glm::vec4 color;
-		joint_node.isSelected() ? color = unselected_color : color = selected_color;
-
-		addEdgeGeometry(bones_pixels, bones_pixels_indices, parent_joint.getPos(), joint_node.getPos(), color, color, line_thickness, line_thickness);
+	PROFILE_SCOPE(PROFILE_RIGGER_BONES);
+	int n = jt->size();
+	if (ReserveInstances(n, bone_capacity, bones_instances_VBO, sizeof(Instance), bones_colors_VBO, sizeof(InstanceColor))) {
+		uploaded_bones.clear();
 	}
-
-	if (bones_pixels.size() > 0) {
-		glBindBuffer(GL_ARRAY_BUFFER, bones_pixels_VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor)*bones_pixels.size(), &bones_pixels[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bones_pixels_indices_VBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			sizeof(VBOIndexedTri) * bones_pixels_indices.size(),
-			&bones_pixels_indices[0], GL_STATIC_DRAW);
+	UploadedBone nothing = { glm::vec3(0, 0, 0), glm::vec3(0, 0, 0), -1, -1 };
+	uploaded_bones.resize(n, nothing);
+	bones_instances.resize(n);
+	bones_colors.resize(n);
+	num_bones = n;
+
+	// a bone moves with either of its joints
+	std::vector<char> moved(n, 0), recolored(n, 0);
+	bool any_moved = false, any_recolored = false;
+	for (int j = 0; j < n; ++j) {
+		const Joint &joint_node = jt->getJoint(j);
+		int parent = joint_node.getParent();
+		bool has_parent = parent >= 0 && parent < n;
+		glm::vec3 parent_pos = has_parent ? jt->getJoint(parent).getPos() : joint_node.getPos();
+		UploadedBone &uploaded = uploaded_bones[j];
+		int selected = joint_node.isSelected() ? 1 : 0;
+		if (uploaded.selected < 0 || uploaded.parent != parent || uploaded.pos != joint_node.getPos() ||
+		    uploaded.parent_pos != parent_pos) {
+			glm::vec3 bone = joint_node.getPos() - parent_pos;
+			float length = glm::length(bone);
+			Instance &instance = bones_instances[j];
+			if (has_parent && length > 0) {
+				instance.position_length = glm::vec4(parent_pos, length);
+				instance.rotation = RotationFromX(bone / length);
+			} else {
+				instance.position_length = glm::vec4(joint_node.getPos(), 0);
+				instance.rotation = glm::vec4(0, 0, 0, 1);
+			}
+			uploaded.parent = parent;
+			uploaded.pos = joint_node.getPos();
+			uploaded.parent_pos = parent_pos;
+			moved[j] = any_moved = true;
+		}
+		if (uploaded.selected != selected) {
+			PackColor(JointColor(joint_node), bones_colors[j].rgba);
+			uploaded.selected = selected;
+			recolored[j] = any_recolored = true;
+		}
 	}
+	if (any_moved) UploadRuns(bones_instances_VBO, moved, bones_instances);
+	if (any_recolored) UploadRuns(bones_colors_VBO, recolored, bones_colors);
 }
 
-void Rigger::setupsketch() {
-	//std::cout << "setting up sketch\n" << sketch_strokes.size() << std::endl;
-	//normals
-	glm::vec3 normal;
-	if (sketch_strokes_coords.size() > 0) {
-		normal = computeNormal(sketch_strokes[0], sketch_strokes[2], sketch_strokes[1]);
+void Rigger::setupsketch(Camera *camera, float pixel_size) {
+	// a new stroke (or none) starts the quads over
+	int drawn = sketch_pixel.size()/4;
+	if (stroke.numSamples() < drawn) {
+		sketch_pixel.clear();
+		sketch_pixel_indices.clear();
+		drawn = 0;
 	}
-
-	//color based on selection
+	if (stroke.numSamples() == drawn) return;
+
+	// image coordinates map linearly onto a plane facing the camera, so
+	// 3 rays place every sample
+	glm::vec3 dir = camera->getDirection();
+	float distance = glm::length(camera->point_of_interest-camera->camera_position)/2.0f;
+	glm::vec3 corners[3];
+	for (int k = 0; k < 3; k++) {
+		Ray r = camera->generateRay(k == 1, k == 2);
+		corners[k] = r.getOrigin() + r.getDirection()*(distance/glm::dot(r.getDirection(),dir));
+	}
+	glm::vec3 xAxis = corners[1]-corners[0];
+	glm::vec3 yAxis = corners[2]-corners[0];
+	glm::vec3 normal = -dir;
 	glm::vec4 color = glm::vec4(0.0, 0.0, 1.0, 1.0);
-	sketch_pixel.empty();
-	sketch_pixel_indices.empty();
-
-//#pragma omp parallel for
-	for (int s = 0; s < sketch_strokes_coords.size(); s++) {
-		//FF - Front Face
-		int start = s*4;
-		start = sketch_pixel.size();
-		sketch_pixel.push_back(VBOPosNormalColor(sketch_strokes[start], normal, color));
-		sketch_pixel.push_back(VBOPosNormalColor(sketch_strokes[start+1], normal, color));
-		sketch_pixel.push_back(VBOPosNormalColor(sketch_strokes[start+2], normal, color));
-		sketch_pixel.push_back(VBOPosNormalColor(sketch_strokes[start+3], normal, color));
+	for (int s = drawn; s < stroke.numSamples(); s++) {
+		glm::vec2 sample = stroke.getSample(s);
+		int start = sketch_pixel.size();
+		// upper left, upper right, lower left, lower right
+		for (int k = 0; k < 4; k++) {
+			float x = sample.x + ((k % 2) ? pixel_size : -pixel_size);
+			float y = sample.y + ((k < 2) ? pixel_size : -pixel_size);
+			sketch_pixel.push_back(VBOPosNormalColor(corners[0] + x*xAxis + y*yAxis, normal, color));
+		}
 		sketch_pixel_indices.push_back(VBOIndexedTri(start, start + 2, start + 1));
 		sketch_pixel_indices.push_back(VBOIndexedTri(start + 2, start + 3, start + 1));
 	}
 
-	if (sketch_pixel.size() > 0) {
-		glBindBuffer(GL_ARRAY_BUFFER, sketch_pixels_VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor)*sketch_pixel.size(), &sketch_pixel[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sketch_pixels_indices_VBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-			sizeof(VBOIndexedTri) * sketch_pixel_indices.size(),
-			&sketch_pixel_indices[0], GL_STATIC_DRAW);
-	}
+	glBindBuffer(GL_ARRAY_BUFFER, sketch_pixels_VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(VBOPosNormalColor)*sketch_pixel.size(), &sketch_pixel[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sketch_pixels_indices_VBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+		sizeof(VBOIndexedTri) * sketch_pixel_indices.size(),
+		&sketch_pixel_indices[0], GL_STATIC_DRAW);
 }
 
 void Rigger::drawVBOs() {
@@ -211,49 +277,85 @@ void Rigger::drawVBOs() {
 }
 
 void Rigger::drawVBOs_joints() {
-	if (joints_pixel.size() == 0) return;
+	if (num_joints == 0) return;
 	HandleGLError("enter draw joints");
+	// the shared mesh
 	glBindBuffer(GL_ARRAY_BUFFER, joints_pixels_VBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, joints_pixels_indices_VBO);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)sizeof(glm::vec3));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3) * 2));
 	glEnableVertexAttribArray(3);
 	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3) * 2 + sizeof(glm::vec4)));
-	glDrawElements(GL_TRIANGLES,
-		joints_pixel_indices.size() * 3,
-		GL_UNSIGNED_INT, 0);
+	// per instance
+	glBindBuffer(GL_ARRAY_BUFFER, joints_colors_VBO);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceColor), (void*)0);
+	glVertexAttribDivisor(2, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, joints_instances_VBO);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+	glVertexAttribDivisor(5, 1);
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)sizeof(glm::vec4));
+	glVertexAttribDivisor(6, 1);
+	glUniform1i(GLCanvas::instancedID, 1);
+	glDrawElementsInstanced(GL_TRIANGLES,
+		joint_mesh_tris * 3,
+		GL_UNSIGNED_INT, 0, num_joints);
+	glUniform1i(GLCanvas::instancedID, 0);
+	glVertexAttribDivisor(2, 0);
+	glVertexAttribDivisor(5, 0);
+	glVertexAttribDivisor(6, 0);
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 	glDisableVertexAttribArray(2);
 	glDisableVertexAttribArray(3);
+	glDisableVertexAttribArray(5);
+	glDisableVertexAttribArray(6);
 	HandleGLError("exit draw joints");
 }
 
 void Rigger::drawVBOs_bones() {
-	if (joints_pixel.size() == 0) return;
-	HandleGLError("enter draw joints");
+	if (num_bones == 0) return;
+	HandleGLError("enter draw bones");
+	// the shared mesh
 	glBindBuffer(GL_ARRAY_BUFFER, bones_pixels_VBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bones_pixels_indices_VBO);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)sizeof(glm::vec3));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3) * 2));
 	glEnableVertexAttribArray(3);
 	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VBOPosNormalColor), (void*)(sizeof(glm::vec3) * 2 + sizeof(glm::vec4)));
-	glDrawElements(GL_TRIANGLES,
-		bones_pixels_indices.size() * 3,
-		GL_UNSIGNED_INT, 0);
+	// per instance
+	glBindBuffer(GL_ARRAY_BUFFER, bones_colors_VBO);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceColor), (void*)0);
+	glVertexAttribDivisor(2, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, bones_instances_VBO);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+	glVertexAttribDivisor(5, 1);
+	glEnableVertexAttribArray(6);
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)sizeof(glm::vec4));
+	glVertexAttribDivisor(6, 1);
+	glUniform1i(GLCanvas::instancedID, 1);
+	glDrawElementsInstanced(GL_TRIANGLES,
+		bone_mesh_tris * 3,
+		GL_UNSIGNED_INT, 0, num_bones);
+	glUniform1i(GLCanvas::instancedID, 0);
+	glVertexAttribDivisor(2, 0);
+	glVertexAttribDivisor(5, 0);
+	glVertexAttribDivisor(6, 0);
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 	glDisableVertexAttribArray(2);
 	glDisableVertexAttribArray(3);
-	HandleGLError("exit draw joints");
+	glDisableVertexAttribArray(5);
+	glDisableVertexAttribArray(6);
+	HandleGLError("exit draw bones");
 }
 
 void Rigger::drawVBOs_sketch(){
@@ -281,29 +383,23 @@ void Rigger::drawVBOs_sketch(){
 
 void Rigger::cleanupVBOs() {
 	glDeleteBuffers(1, &joints_pixels_VBO);
+	glDeleteBuffers(1, &joints_pixels_indices_VBO);
+	glDeleteBuffers(1, &joints_instances_VBO);
+	glDeleteBuffers(1, &joints_colors_VBO);
 	glDeleteBuffers(1, &bones_pixels_VBO);
+	glDeleteBuffers(1, &bones_pixels_indices_VBO);
+	glDeleteBuffers(1, &bones_instances_VBO);
+	glDeleteBuffers(1, &bones_colors_VBO);
 	glDeleteBuffers(1, &sketch_pixels_VBO);
+	glDeleteBuffers(1, &sketch_pixels_indices_VBO);
+	joint_capacity = 0;
+	bone_capacity = 0;
+	resetVBOs();
 }
 
-//add one "pixel" of line stroke using square vertex coordinates
-void Rigger::sketch(glm::vec3 center, glm::vec3 upRight, glm::vec3 upLeft, glm::vec3 lowRight, glm::vec3 lowLeft){
-	//printf("%f | %f | %f\n", upRight.x, upRight.y, upRight.z);
-	sketch_strokes_coords.push_back(center);
-	sketch_strokes.push_back(upLeft);
-	sketch_strokes.push_back(upRight);
-	sketch_strokes.push_back(lowLeft);
-	sketch_strokes.push_back(lowRight);
-
-}	
-
-
-
-
-
-
-
-
-
-
-
-
+int Rigger::finishStroke(Camera *camera, const Mesh *mesh, float pixel_size) {
+	int added = 0;
+	if (stroke.numSamples() > 0) added = stroke.ToJoints(camera, mesh, jt, pixel_size);
+	stroke.clear();
+	return added;
+}
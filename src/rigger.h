@@ -8,9 +8,11 @@
 #include "argparser.h"
 #include <omp.h>
 #include "glCanvas.h"
+#include "sketchstroke.h"
 
 
 class ArgParser;
+class Camera;
 class RayTracer;
 class Hit;
 class JointTree;
@@ -18,8 +20,9 @@ class JointTree;
 class Rigger {
 public:	
 	//constructor
-	Rigger () {}
-	Rigger(RayTracer *raytracer, JointTree *jointtree, ArgParser *arg) { 
+	Rigger () : joint_capacity(0), bone_capacity(0), num_joints(0), num_bones(0), joint_mesh_tris(0), bone_mesh_tris(0) {}
+	Rigger(RayTracer *raytracer, JointTree *jointtree, ArgParser *arg) :
+		joint_capacity(0), bone_capacity(0), num_joints(0), num_bones(0), joint_mesh_tris(0), bone_mesh_tris(0) {
 		rt = raytracer; 
 		jt = jointtree;
 		args = arg;
@@ -27,34 +30,79 @@ public:
 
 	// set access to the other modules for hybrid rendering options
 	void setRaytracer(RayTracer *raytracer) { rt = raytracer; }
-	void setJointTree(JointTree *jointtree) { jt = jointtree; }
+	void setJointTree(JointTree *jointtree) { jt = jointtree; resetVBOs(); }
 
 
 	JointTree* getJointTree() {return jt;}
 
 	void initializeVBOs();
+	// forget what was uploaded, the next setup rewrites everything
 	void resetVBOs();
+	// upload only the joints & bones that changed since the last call
 	void setupJoints();
 	void setupBones();
-	void setupsketch();
+	// the quads of the stroke being drawn, one per sample, on the plane
+	// 1/2 way to the point of interest (only new samples are added)
+	void setupsketch(Camera *camera, float pixel_size);
 	void drawVBOs_joints();
 	void drawVBOs_bones();
 	void drawVBOs_sketch();
 	void drawVBOs();
 	void cleanupVBOs();
-	void sketch(glm::vec3 center, glm::vec3 upRight, glm::vec3 upLeft, glm::vec3 lowRight, glm::vec3 lowLeft);
+	// record a point of the stroke being drawn (normalized image coordinates)
+	void addStrokeSample(double x, double y) { stroke.addSample(x, y); }
+	// convert the finished stroke to a chain of joints & start a new one
+	int finishStroke(Camera *camera, const Mesh *mesh, float pixel_size);
 
 private:
 	RayTracer* rt;
 	JointTree* jt;
 	ArgParser* args;
-	std::vector<glm::vec3> sketch_strokes; // packed stroke data in groups of 4 floats
-	std::vector<glm::vec3> sketch_strokes_coords; //stroke centers for  ray tracing and rig superemposing  
+	SketchStroke stroke; // the stroke in image space, for the joint chain
 
 	bool render_to_a;
 
-	std::vector<VBOPosNormalColor> joints_pixel;
-	std::vector<VBOPosNormalColor> bones_pixels;
+	// one shared cube & one shared bone box (unit length along x), drawn
+	// instanced: a joint's instance places the cube, & the bone to its
+	// parent places the box (hidden for a root).  the instance buffers
+	// grow by doubling.  the colours are in their own buffers, so a
+	// selection only rewrites those.
+	struct Instance {
+		glm::vec4 position_length; // length 0 hides it
+		glm::vec4 rotation; // quaternion, xyzw
+	};
+	struct InstanceColor {
+		unsigned char rgba[4];
+	};
+	// what was last uploaded for each joint
+	struct UploadedJoint {
+		glm::vec3 pos;
+		int selected; // -1 for nothing uploaded
+	};
+	struct UploadedBone {
+		glm::vec3 parent_pos;
+		glm::vec3 pos;
+		int parent;
+		int selected; // -1 for nothing uploaded
+	};
+	std::vector<UploadedJoint> uploaded_joints;
+	std::vector<UploadedBone> uploaded_bones;
+	int joint_capacity;
+	int bone_capacity;
+	int num_joints;
+	int num_bones;
+	std::vector<Instance> joints_instances;
+	std::vector<Instance> bones_instances;
+	std::vector<InstanceColor> joints_colors;
+	std::vector<InstanceColor> bones_colors;
+	GLuint joints_instances_VBO;
+	GLuint bones_instances_VBO;
+	GLuint joints_colors_VBO;
+	GLuint bones_colors_VBO;
+	// the triangles of the shared cube & box
+	int joint_mesh_tris;
+	int bone_mesh_tris;
+
 	std::vector<VBOPosNormalColor> sketch_pixel;
 	std::vector<VBOIndexedTri> joints_pixel_indices;
 	std::vector<VBOIndexedTri> bones_pixels_indices;
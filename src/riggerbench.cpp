@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include <glm/glm.hpp>
+
+#include "argparser.h"
+#include "glCanvas.h"
+#include "mesh.h"
+#include "material.h"
+#include "camera.h"
+#include "ray.h"
+#include "hit.h"
+#include "raytracer.h"
+#include "radiosity.h"
+#include "mappedfile.h"
+#include "objparser.h"
+#include "joint.h"
+#include "autorigger.h"
+
+// ====================================================================
+// A fixed suite of timings on the bundled models, to track
+// regressions:
+//
+//   rigger_bench
+//   rigger_bench ../models results.json 20
+//
+// Every case is repeated & reported as the median & 99th percentile
+// (in ms), with a rate where it has one, on the console & as JSON.
+// The cases, per model:
+//
+//   parse        the .obj scanned by ObjParser (all threads)
+//   load         Mesh::Parallel, without the mesh cache
+//   topology     the half-edges of the parsed quads (addOriginalQuads)
+//   cast_ray     a grid of camera rays through RayTracer::CastRay
+//   subdivision  each level of Mesh::Subdivision, from a fresh load
+//   nearest      random JointTree::getKClosest queries on the auto rig
+//   vbo          the radiosity vertex & index arrays (no GL upload)
+// ====================================================================
+
+#define RIGGER_BENCH_RAYS 256
+#define RIGGER_BENCH_QUERIES 10000
+#define RIGGER_BENCH_MAX_LEVELS 3
+// no level that would go past this many faces
+#define RIGGER_BENCH_MAX_FACES 500000
+
+static const char *bench_models[] = { "cube.obj", "new_hand.obj", "new_antonov_an_71.obj", "new_FinalBaseMesh.obj" };
+
+struct BenchCase {
+  std::string name;
+  double median;
+  double p99;
+  int samples;
+  // things per second at the median (0 if none)
+  double rate;
+  std::string rate_unit;
+};
+
+struct BenchModel {
+  std::string name;
+  int faces;
+  std::vector<BenchCase> cases;
+};
+
+// the loaders report on std::cout, which would drown the results
+static void Quiet(bool quiet) {
+  if (quiet) std::cout.setstate(std::ios::failbit);
+  else std::cout.clear();
+}
+
+static BenchCase Summarize(const std::string &name, std::vector<double> times,
+                           double count = 0, const std::string &rate_unit = "") {
+  std::sort(times.begin(),times.end());
+  BenchCase c;
+  c.name = name;
+  c.samples = times.size();
+  c.median = times[times.size()/2];
+  c.p99 = times[std::max(0,(int)std::ceil(0.99*times.size())-1)];
+  c.rate = (count > 0 && c.median > 0) ? count / (c.median/1000) : 0;
+  c.rate_unit = rate_unit;
+  printf ("  %-16s median %10.3f ms  p99 %10.3f ms",c.name.c_str(),c.median,c.p99);
+  if (c.rate > 0) printf ("  %12.0f %s",c.rate,c.rate_unit.c_str());
+  printf ("\n");
+  fflush(stdout);
+  return c;
+}
+
+static Mesh* LoadMesh(ArgParser *args) {
+  Quiet(true);
+  Mesh *mesh = new Mesh();
+  mesh->Parallel(args);
+  Quiet(false);
+  return mesh;
+}
+
+// ====================================================================
+
+static void BenchParse(const std::string &file, int repetitions, BenchModel &model) {
+  MappedFile objfile;
+  if (!objfile.Open(file)) return;
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    double start = omp_get_wtime();
+    ObjParser parser(objfile.getData(),objfile.getSize());
+    parser.Parse(omp_get_max_threads());
+    times.push_back(1000*(omp_get_wtime()-start));
+  }
+  model.cases.push_back(Summarize("parse",times,objfile.getSize()/(1024.0*1024.0),"MB/s"));
+}
+
+static void BenchLoad(ArgParser *args, int repetitions, BenchModel &model) {
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    double start = omp_get_wtime();
+    Mesh *mesh = LoadMesh(args);
+    times.push_back(1000*(omp_get_wtime()-start));
+    model.faces = mesh->numFaces();
+    delete mesh;
+  }
+  model.cases.push_back(Summarize("load",times,model.faces,"faces/s"));
+}
+
+static void BenchTopology(const std::string &file, int repetitions, BenchModel &model) {
+  MappedFile objfile;
+  if (!objfile.Open(file)) return;
+  ObjParser parser(objfile.getData(),objfile.getSize());
+  if (!parser.Parse(omp_get_max_threads())) return;
+  const std::vector<glm::vec3> &positions = parser.getPositions();
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    Mesh mesh;
+    Material *material = new Material("",glm::vec3(0.5,0.5,0.5),glm::vec3(1,1,1),glm::vec3(0,0,0),0.3);
+    mesh.materials.push_back(material);
+    for (unsigned int i = 0; i < positions.size(); i++) mesh.addVertex(positions[i]);
+    std::vector<Material*> face_materials(parser.numFaces(),material);
+    double start = omp_get_wtime();
+    mesh.addOriginalQuads(parser.getQuads(),face_materials);
+    times.push_back(1000*(omp_get_wtime()-start));
+  }
+  model.cases.push_back(Summarize("topology",times,parser.numFaces(),"faces/s"));
+}
+
+// camera rays through every pixel of a square image, on all threads
+static void BenchCastRay(Mesh *mesh, ArgParser *args, int repetitions, BenchModel &model) {
+  RayTracer raytracer(mesh,args);
+  Camera *camera = mesh->camera;
+  camera->width = RIGGER_BENCH_RAYS;
+  camera->height = RIGGER_BENCH_RAYS;
+  int n = RIGGER_BENCH_RAYS*RIGGER_BENCH_RAYS;
+  std::vector<double> times;
+  int hits = 0;
+  for (int r = 0; r < repetitions; r++) {
+    hits = 0;
+    double start = omp_get_wtime();
+#pragma omp parallel for schedule(dynamic,RIGGER_BENCH_RAYS) reduction(+:hits)
+    for (int i = 0; i < n; i++) {
+      Ray ray = camera->generateRay((i%RIGGER_BENCH_RAYS+0.5)/RIGGER_BENCH_RAYS,
+                                    (i/RIGGER_BENCH_RAYS+0.5)/RIGGER_BENCH_RAYS);
+      Hit h;
+      if (raytracer.CastRay(ray,h,false)) hits++;
+    }
+    times.push_back(1000*(omp_get_wtime()-start));
+  }
+  model.cases.push_back(Summarize("cast_ray",times,n,"rays/s"));
+}
+
+// each level is timed on its own, the mesh reloaded for every repetition
+static void BenchSubdivision(ArgParser *args, int repetitions, BenchModel &model) {
+  int levels = 0;
+  for (int faces = model.faces; levels < RIGGER_BENCH_MAX_LEVELS && 4*faces <= RIGGER_BENCH_MAX_FACES; faces *= 4) levels++;
+  std::vector<std::vector<double> > times(levels);
+  for (int r = 0; r < repetitions; r++) {
+    Mesh *mesh = LoadMesh(args);
+    for (int level = 0; level < levels; level++) {
+      Quiet(true);
+      double start = omp_get_wtime();
+      mesh->Subdivision();
+      times[level].push_back(1000*(omp_get_wtime()-start));
+      Quiet(false);
+    }
+    delete mesh;
+  }
+  for (int level = 0; level < levels; level++) {
+    char name[64];
+    sprintf (name,"subdivision_%d",level+1);
+    model.cases.push_back(Summarize(name,times[level],model.faces*std::pow(4.0,level+1),"faces/s"));
+  }
+}
+
+// points scattered through the bounding box, the same every repetition
+static void BenchNearest(Mesh *mesh, ArgParser *args, int repetitions, BenchModel &model) {
+  JointTree tree;
+  AutoRigger auto_rigger(mesh,args);
+  Quiet(true);
+  int joints = auto_rigger.Rig(&tree);
+  Quiet(false);
+  if (joints < 2) {
+    printf ("  %-16s skipped (%d joints)\n","nearest",joints);
+    return;
+  }
+  glm::vec3 min = mesh->getBoundingBox()->getMin();
+  glm::vec3 max = mesh->getBoundingBox()->getMax();
+  std::vector<glm::vec3> queries(RIGGER_BENCH_QUERIES);
+  srand(37);
+  for (int i = 0; i < RIGGER_BENCH_QUERIES; i++) {
+    glm::vec3 t(rand()/double(RAND_MAX),rand()/double(RAND_MAX),rand()/double(RAND_MAX));
+    queries[i] = min + t*(max-min);
+  }
+  std::vector<int> result;
+  std::vector<double> times;
+  for (int r = 0; r <= repetitions; r++) {
+    double start = omp_get_wtime();
+    for (int i = 0; i < RIGGER_BENCH_QUERIES; i++) tree.getKClosest(queries[i],1,result);
+    // the first repetition also builds the index
+    if (r > 0) times.push_back(1000*(omp_get_wtime()-start));
+  }
+  model.cases.push_back(Summarize("nearest",times,RIGGER_BENCH_QUERIES,"queries/s"));
+}
+
+static void BenchVBO(Mesh *mesh, ArgParser *args, int repetitions, BenchModel &model) {
+  Radiosity radiosity(mesh,args);
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    double start = omp_get_wtime();
+    radiosity.setupVBOArrays();
+    times.push_back(1000*(omp_get_wtime()-start));
+  }
+  model.cases.push_back(Summarize("vbo",times,mesh->numFaces(),"faces/s"));
+}
+
+// ====================================================================
+
+static bool WriteJSON(const std::string &filename, const std::vector<BenchModel> &models, int repetitions) {
+  FILE *file = fopen(filename.c_str(),"w");
+  if (file == NULL) return false;
+  fprintf (file,"{\n  \"repetitions\": %d,\n  \"threads\": %d,\n  \"models\": [\n",repetitions,omp_get_max_threads());
+  for (unsigned int m = 0; m < models.size(); m++) {
+    fprintf (file,"    {\n      \"model\": \"%s\",\n      \"faces\": %d,\n      \"cases\": [\n",
+             models[m].name.c_str(),models[m].faces);
+    const std::vector<BenchCase> &cases = models[m].cases;
+    for (unsigned int c = 0; c < cases.size(); c++) {
+      fprintf (file,"        { \"name\": \"%s\", \"samples\": %d, \"median_ms\": %.6f, \"p99_ms\": %.6f",
+               cases[c].name.c_str(),cases[c].samples,cases[c].median,cases[c].p99);
+      if (cases[c].rate > 0) fprintf (file,", \"rate\": %.3f, \"rate_unit\": \"%s\"",cases[c].rate,cases[c].rate_unit.c_str());
+      fprintf (file," }%s\n",c+1 < cases.size() ? "," : "");
+    }
+    fprintf (file,"      ]\n    }%s\n",m+1 < models.size() ? "," : "");
+  }
+  fprintf (file,"  ]\n}\n");
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    std::cerr << "usage: " << argv[0] << " [models directory] [results.json] [repetitions]" << std::endl;
+    return 1;
+  }
+  std::string directory = (argc > 1) ? argv[1] : "../models";
+  std::string output = (argc > 2) ? argv[2] : "rigger_bench.json";
+  int repetitions = (argc > 3) ? std::max(1,atoi(argv[3])) : 10;
+
+  std::vector<BenchModel> models;
+  for (unsigned int m = 0; m < sizeof(bench_models)/sizeof(bench_models[0]); m++) {
+    ArgParser args;
+    args.path = directory;
+    args.input_file = bench_models[m];
+    args.mesh_cache = false;
+    GLCanvas::args = &args;
+    std::string file = directory+'/'+bench_models[m];
+    MappedFile check;
+    if (!check.Open(file)) {
+      std::cerr << "WARNING: skipping " << file << std::endl;
+      continue;
+    }
+    printf ("%s\n",bench_models[m]);
+    BenchModel model;
+    model.name = bench_models[m];
+    BenchParse(file,repetitions,model);
+    BenchLoad(&args,repetitions,model);
+    BenchTopology(file,repetitions,model);
+    Mesh *mesh = LoadMesh(&args);
+    BenchCastRay(mesh,&args,repetitions,model);
+    BenchNearest(mesh,&args,repetitions,model);
+    BenchVBO(mesh,&args,repetitions,model);
+    delete mesh;
+    BenchSubdivision(&args,repetitions,model);
+    models.push_back(model);
+  }
+  if (!WriteJSON(output,models,repetitions)) {
+    std::cerr << "ERROR: could not write " << output << std::endl;
+    return 1;
+  }
+  printf ("results written to %s\n",output.c_str());
+  return 0;
+}
@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "argparser.h"
+#include "glCanvas.h"
+#include "joint.h"
+#include "mesh.h"
+#include "vertex.h"
+
+// ====================================================================
+// Regression tests on small models, run by ctest:
+//
+//   rigger_tests ../models
+//
+// Each test prints what failed & the program returns the number of
+// failed tests.
+// ====================================================================
+
+static int num_checks_failed = 0;
+
+#define CHECK(condition) do { if (!(condition)) { \
+  printf ("  FAILED %s:%d  %s\n",__FILE__,__LINE__,#condition); num_checks_failed++; } } while (0)
+
+// the loaders report on std::cout
+static void Quiet(bool quiet) {
+  if (quiet) std::cout.setstate(std::ios::failbit);
+  else std::cout.clear();
+}
+
+static Mesh* LoadMesh(ArgParser *args) {
+  Quiet(true);
+  Mesh *mesh = new Mesh();
+  mesh->Parallel(args);
+  Quiet(false);
+  return mesh;
+}
+
+// ====================================================================
+
+// an exporter's .obj (comments, vn, o, g, s, usemtl & a triangle)
+// loads with the lines we don't use skipped
+static void TestStandardObj(ArgParser *args) {
+  args->input_file = "cube_standard.obj";
+  Mesh *mesh = LoadMesh(args);
+  CHECK (mesh->numVertices() == 8);
+  CHECK (mesh->numOriginalQuads() == 6);
+  CHECK (mesh->numFaces() == 6);
+  CHECK (mesh->numEdges() == 24);
+  CHECK (mesh->camera != NULL);
+  delete mesh;
+}
+
+// subdivision discards each level it replaces, & the pools give its
+// storage back rather than keeping it on the free lists
+static void TestSubdivisionStorage(ArgParser *args) {
+  args->input_file = "new_hand.obj";
+  Mesh *mesh = LoadMesh(args);
+  int original = mesh->numOriginalQuads();
+  Quiet(true);
+  for (int level = 1; level <= 3; level++) mesh->Subdivision();
+  Quiet(false);
+  // the original quads are kept for ray tracing
+  int live_faces = original + 64*original;
+  CHECK (mesh->numFaces() == 64*original);
+  CHECK (mesh->getFacePool().numLive() == live_faces);
+  CHECK (mesh->getEdgePool().numLive() == 4*live_faces);
+  CHECK (mesh->getFacePool().numReserved() == live_faces);
+  CHECK (mesh->getEdgePool().numReserved() == 4*live_faces);
+  CHECK (mesh->getVertexPool().numLive() == mesh->numVertices());
+  delete mesh;
+}
+
+// each Catmull-Clark level of the closed cube has V+E+F vertices, 4F
+// faces & 2E+4F edges, & the points of the levels it replaced are gone
+static void TestCatmullClarkCounts(ArgParser *args) {
+  args->input_file = "cube.obj";
+  args->catmull_clark = true;
+  Mesh *mesh = LoadMesh(args);
+  int v = 8, e = 12, f = 6;
+  Quiet(true);
+  for (int level = 1; level <= 4; level++) {
+    mesh->Subdivision();
+    int next_v = v+e+f;
+    int next_e = 2*e+4*f;
+    v = next_v; e = next_e; f = 4*f;
+    // the corners of the original quads are kept for ray tracing
+    CHECK (mesh->numVertices() == 8+v);
+    CHECK (mesh->numFaces() == f);
+    CHECK (mesh->getVertexPool().numLive() == 8+v);
+    CHECK (mesh->getFacePool().numLive() == 6+f);
+    CHECK (mesh->getEdgePool().numLive() == 4*(6+f));
+    CHECK (mesh->getGeometryCache().numVertices() == 8+v);
+  }
+  Quiet(false);
+  // every vertex is where its index says
+  for (int i = 0; i < mesh->numVertices(); i++) {
+    CHECK (mesh->getVertex(i)->getIndex() == i);
+    CHECK (mesh->getGeometryCache().getPosition(i) == mesh->getVertex(i)->get());
+  }
+  delete mesh;
+}
+
+// a rig that isn't one tree is rejected & leaves the loaded rig alone
+static void TestRigHierarchy(ArgParser *args) {
+  JointTree tree;
+  std::cerr.setstate(std::ios::failbit);
+  CHECK (tree.Parallel_load(args->path+"/test.rig"));
+  CHECK (tree.size() == 3 && tree.getRoot() == 0);
+  CHECK (tree.getJoint(2).getParent() == 1);
+  const char *bad[] = {
+    "0\n1 2\n2 1\n",      // a cycle apart from the root
+    "0 1\n1\n",           // joint 2 has no parent
+    "0 1 2\n1 2\n",       // joint 2 has two parents
+  };
+  for (unsigned int i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+    std::string filename = "rigger_tests_bad.rig";
+    std::ofstream out(filename);
+    out << "3\n0 0 0 0\n1 0 0 1\n2 0 0 2\n\n" << bad[i];
+    out.close();
+    CHECK (!tree.Parallel_load(filename));
+    CHECK (tree.size() == 3 && tree.getRoot() == 0);
+    CHECK (tree.getJoint(1).getPos() == glm::vec3(0.227129,0.923159,0.582719));
+    remove(filename.c_str());
+  }
+  std::cerr.clear();
+}
+
+// moving joints keeps the kd-tree answering like a linear scan (the
+// positions are on a coarse grid, so there are plenty of ties)
+static void TestJointIndexMoves(ArgParser *args) {
+  JointTree tree;
+  srand(3);
+  for (int i = 0; i < 300; i++) {
+    Joint joint(i,glm::vec3(rand()%8,rand()%8,rand()%8));
+    tree.addJoint(joint);
+  }
+  for (int step = 0; step < 2000; step++) {
+    int moved = rand()%tree.size();
+    tree.setPos(moved,glm::vec3(rand()%8,rand()%8,rand()%8));
+    if (step % 20 != 0) continue;
+    int i = rand()%tree.size();
+    int best = -1;
+    float best_d2 = 0;
+    for (int j = 0; j < tree.size(); j++) {
+      if (j == i) continue;
+      glm::vec3 d = tree.getJoint(j).getPos()-tree.getJoint(i).getPos();
+      if (best == -1 || glm::dot(d,d) < best_d2) { best = j; best_d2 = glm::dot(d,d); }
+    }
+    CHECK (tree.getClosest(i) == best);
+  }
+}
+
+// ====================================================================
+
+typedef void (*TestFunction)(ArgParser *args);
+struct Test {
+  const char *name;
+  TestFunction function;
+};
+
+static Test tests[] = {
+  { "standard_obj", TestStandardObj },
+  { "subdivision_storage", TestSubdivisionStorage },
+  { "catmull_clark_counts", TestCatmullClarkCounts },
+  { "rig_hierarchy", TestRigHierarchy },
+  { "joint_index_moves", TestJointIndexMoves },
+};
+
+int main(int argc, char *argv[]) {
+  std::string directory = (argc > 1) ? argv[1] : "../models";
+  int num_failed = 0;
+  for (unsigned int t = 0; t < sizeof(tests)/sizeof(Test); t++) {
+    ArgParser args;
+    args.path = directory;
+    args.mesh_cache = false;
+    GLCanvas::args = &args;
+    int before = num_checks_failed;
+    tests[t].function(&args);
+    bool passed = (num_checks_failed == before);
+    printf ("%-24s %s\n",tests[t].name,passed ? "ok" : "FAILED");
+    if (!passed) num_failed++;
+  }
+  fflush(stdout);
+  return num_failed;
+}
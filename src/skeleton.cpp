@@ -0,0 +1,134 @@
+#include <cassert>
+#include <omp.h>
+#include "skeleton.h"
+#include "joint.h"
+
+// subtrees up to this many joints are posed by one thread
+#define SKELETON_SUBTREE_GRAIN 512
+
+// ==================================================================
+// MODIFIERS
+// ==================================================================
+
+void Skeleton::Build(JointTree *tree) {
+	int n = tree->size();
+	std::vector<int> parent(n);
+	for (int j = 0; j < n; j++) {
+		int p = tree->getJoint(j).getParent();
+		parent[j] = (p >= 0 && p < n && p != j) ? p : -1;
+	}
+
+	// the children of each joint, in index order
+	std::vector<int> child_start(n+1,0);
+	for (int j = 0; j < n; j++) {
+		if (parent[j] >= 0) child_start[parent[j]+1]++;
+	}
+	for (int j = 0; j < n; j++) child_start[j+1] += child_start[j];
+	std::vector<int> children(child_start[n]);
+	std::vector<int> fill(child_start.begin(),child_start.end()-1);
+	for (int j = 0; j < n; j++) {
+		if (parent[j] >= 0) children[fill[parent[j]]++] = j;
+	}
+
+	// depth first from each root.  joints caught in a parent loop are
+	// never reached from a root, and become roots themselves.
+	joint_ids.clear();
+	slots.assign(n,-1);
+	parents.clear();
+	std::vector<int> stack;
+	for (int pass = 0; pass < 2; pass++) {
+		for (int r = 0; r < n; r++) {
+			if (slots[r] != -1 || (pass == 0 && parent[r] != -1)) continue;
+			stack.push_back(r);
+			while (!stack.empty()) {
+				int j = stack.back();
+				stack.pop_back();
+				if (slots[j] != -1) continue;
+				slots[j] = joint_ids.size();
+				joint_ids.push_back(j);
+				parents.push_back((j == r) ? -1 : slots[parent[j]]);
+				// pushed in reverse, so they come off in index order
+				for (int c = child_start[j+1]-1; c >= child_start[j]; c--) {
+					if (slots[children[c]] == -1) stack.push_back(children[c]);
+				}
+			}
+		}
+	}
+
+	std::vector<int> subtree_size(n,1);
+	for (int s = n-1; s >= 0; s--) {
+		if (parents[s] >= 0) subtree_size[parents[s]] += subtree_size[s];
+	}
+	subtree_end.resize(n);
+	rest_position.resize(n);
+	for (int s = 0; s < n; s++) {
+		subtree_end[s] = s + subtree_size[s];
+		rest_position[s] = tree->getJoint(joint_ids[s]).getPos();
+	}
+	world.resize(n);
+	ResetPose();
+	Partition();
+	Solve();
+}
+
+void Skeleton::ResetPose() {
+	int n = size();
+	local_rotation.assign(n,glm::quat(1,0,0,0));
+	local_translation.resize(n);
+	for (int s = 0; s < n; s++) {
+		local_translation[s] = (parents[s] < 0) ? rest_position[s] : rest_position[s] - rest_position[parents[s]];
+	}
+}
+
+// ==================================================================
+// FORWARD KINEMATICS
+// ==================================================================
+
+// the big subtrees are split at their root (into the trunk) until
+// every piece is small enough for one thread
+void Skeleton::Partition() {
+	trunk.clear();
+	subtrees.clear();
+	int n = size();
+	if (n <= 2*SKELETON_SUBTREE_GRAIN || omp_get_max_threads() == 1) {
+		if (n > 0) subtrees.push_back(std::make_pair(0,n));
+		return;
+	}
+	int s = 0;
+	while (s < n) {
+		if (subtree_end[s]-s > SKELETON_SUBTREE_GRAIN) {
+			trunk.push_back(s);
+			s++;
+		} else {
+			subtrees.push_back(std::make_pair(s,subtree_end[s]));
+			s = subtree_end[s];
+		}
+	}
+}
+
+void Skeleton::SolveRange(int begin, int end) {
+	for (int s = begin; s < end; s++) SolveSlot(s);
+}
+
+void Skeleton::Solve() {
+	for (unsigned int i = 0; i < trunk.size(); i++) SolveSlot(trunk[i]);
+	int num_subtrees = subtrees.size();
+	if (num_subtrees == 1) {
+		SolveRange(subtrees[0].first,subtrees[0].second);
+		return;
+	}
+#pragma omp parallel for schedule(dynamic,4)
+	for (int i = 0; i < num_subtrees; i++) {
+		SolveRange(subtrees[i].first,subtrees[i].second);
+	}
+}
+
+void Skeleton::getSkinningTransforms(std::vector<glm::mat4> &transforms) const {
+	int n = size();
+	transforms.resize(n);
+	for (int s = 0; s < n; s++) {
+		glm::mat4 m = world[s];
+		m[3] = world[s] * glm::vec4(-rest_position[s],1);
+		transforms[joint_ids[s]] = m;
+	}
+}
@@ -0,0 +1,85 @@
+#ifndef _SKELETON_H
+#define _SKELETON_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+
+class JointTree;
+
+// ==================================================================
+// The joints of a JointTree flattened for posing.  The joints are
+// stored depth first from the roots (parents before their children,
+// each subtree in one contiguous range of slots), with the slot of the
+// parent in a flat array, and each joint has a local rotation &
+// translation relative to its parent.  The rest pose is the tree as
+// built: no rotation, & the offset from the parent as the translation.
+//
+// Forward kinematics is one pass over the slots, world = parent world
+// * translation * rotation.  On large rigs the joints near the roots
+// are done first, then the subtrees below them are independent and are
+// split across threads.  Posing allocates nothing.
+
+class Skeleton {
+public:
+	//Constructor
+	Skeleton() {}
+
+	//Accessors
+	int size() const { return parents.size(); }
+	// the joint id in a slot & the slot of a joint id
+	int getJoint(int slot) const { return joint_ids[slot]; }
+	int getSlot(int joint) const { return slots[joint]; }
+	// the slot of the parent (-1 for a root)
+	int getParent(int slot) const { return parents[slot]; }
+	// one past the last slot of the subtree of slot
+	int getSubtreeEnd(int slot) const { return subtree_end[slot]; }
+	const glm::quat& getLocalRotation(int slot) const { return local_rotation[slot]; }
+	const glm::vec3& getLocalTranslation(int slot) const { return local_translation[slot]; }
+	const glm::vec3& getRestPosition(int slot) const { return rest_position[slot]; }
+	// as of the last Solve
+	const glm::mat4& getWorld(int slot) const { return world[slot]; }
+	glm::vec3 getWorldPosition(int slot) const { return glm::vec3(world[slot][3]); }
+	// world * inverse rest per joint id (what Skin::Deform takes)
+	void getSkinningTransforms(std::vector<glm::mat4> &transforms) const;
+
+	//Modifiers
+	// flatten the tree, in its current pose as the rest pose
+	void Build(JointTree *tree);
+	void setLocalRotation(int slot, const glm::quat &rotation) { local_rotation[slot] = rotation; }
+	void setLocalTranslation(int slot, const glm::vec3 &translation) { local_translation[slot] = translation; }
+	// every slot at once (as an AnimationClip samples them)
+	void setLocalPose(const glm::quat *rotations, const glm::vec3 *translations) {
+		local_rotation.assign(rotations,rotations+size());
+		local_translation.assign(translations,translations+size());
+	}
+	void ResetPose();
+	// the world matrices from the local transforms
+	void Solve();
+
+private:
+
+	//helpers
+	void Partition();
+	void SolveRange(int begin, int end);
+	void SolveSlot(int slot) {
+		glm::mat4 local = glm::mat4_cast(local_rotation[slot]);
+		local[3] = glm::vec4(local_translation[slot],1);
+		world[slot] = (parents[slot] < 0) ? local : world[parents[slot]] * local;
+	}
+
+	//representation
+	std::vector<int> joint_ids;
+	std::vector<int> slots;
+	std::vector<int> parents;
+	std::vector<int> subtree_end;
+	std::vector<glm::quat> local_rotation;
+	std::vector<glm::vec3> local_translation;
+	std::vector<glm::vec3> rest_position;
+	std::vector<glm::mat4> world;
+	// the slots solved first (in order), then the independent subtrees
+	std::vector<int> trunk;
+	std::vector<std::pair<int,int> > subtrees;
+};
+
+#endif
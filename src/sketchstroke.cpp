@@ -0,0 +1,172 @@
+#include <cmath>
+#include <iostream>
+#include "sketchstroke.h"
+#include "camera.h"
+#include "ray.h"
+#include "mesh.h"
+#include "bvh.h"
+#include "boundingbox.h"
+#include "joint.h"
+
+// the stroke is resampled every few pixels
+#define STROKE_SAMPLE_PIXELS 3.0f
+// passes of laplacian smoothing over the resampled stroke
+#define STROKE_SMOOTH_PASSES 4
+// polyline points may stray this far (a fraction of the mesh size)
+#define STROKE_FIT_TOLERANCE 0.02f
+
+// ==================================================================
+// CONVERSION
+// ==================================================================
+
+int SketchStroke::ToJoints(Camera *camera, const Mesh *mesh, JointTree *tree, float pixel_size) {
+	if (samples.empty() || mesh->getOriginalQuadsBVH() == NULL) return 0;
+	Resample(STROKE_SAMPLE_PIXELS*pixel_size);
+	Smooth(STROKE_SMOOTH_PASSES);
+	CastRays(camera,mesh);
+	if (points.empty()) {
+		std::cout << "stroke does not cross the mesh. ignoring it." << std::endl;
+		return 0;
+	}
+	FitPolyline(STROKE_FIT_TOLERANCE*mesh->getBoundingBox()->maxDim());
+
+	// the first joint hangs off the selected joint, or else the closest
+	int selected = -1;
+	for (int i = 0; i < tree->size(); i++) {
+		if (tree->getJoint(i).isSelected()) {
+			selected = i;
+			break;
+		}
+	}
+	int previous = -1;
+	for (unsigned int i = 0; i < polyline.size(); i++) {
+		Joint temp(tree->size(),points[polyline[i]]);
+		int loc = tree->addJoint(temp);
+		if (previous != -1) {
+			tree->parent(loc,previous);
+		} else if (selected != -1) {
+			tree->parent(loc,selected);
+		} else if (loc != 0) {
+			tree->parent(loc,tree->getClosest(loc));
+		}
+		previous = loc;
+	}
+	tree->DeselectAll();
+	tree->select(previous);
+	std::cout << "stroke: " << samples.size() << " samples, " << points.size()
+		  << " on the mesh, " << polyline.size() << " joints" << std::endl;
+	return polyline.size();
+}
+
+// ==================================================================
+// HELPERS
+// ==================================================================
+
+// replace the samples with ones evenly spaced along the stroke
+void SketchStroke::Resample(float spacing) {
+	std::vector<float> length(samples.size(),0);
+	for (unsigned int i = 1; i < samples.size(); i++) {
+		length[i] = length[i-1] + glm::length(samples[i]-samples[i-1]);
+	}
+	float total = length.back();
+	if (total <= 0 || spacing <= 0) {
+		samples.resize(1);
+		return;
+	}
+	int count = std::max(2,(int)std::ceil(total/spacing)+1);
+	std::vector<glm::vec2> resampled(count);
+	unsigned int segment = 1;
+	for (int i = 0; i < count; i++) {
+		float s = total*i/float(count-1);
+		while (segment < samples.size()-1 && length[segment] < s) segment++;
+		float span = length[segment]-length[segment-1];
+		float a = span > 0 ? (s-length[segment-1])/span : 0;
+		a = std::min(1.0f,std::max(0.0f,a));
+		resampled[i] = samples[segment-1] + a*(samples[segment]-samples[segment-1]);
+	}
+	samples.swap(resampled);
+}
+
+// laplacian smoothing, the ends stay where they were drawn
+void SketchStroke::Smooth(int passes) {
+	if (samples.size() < 3) return;
+	std::vector<glm::vec2> smoothed(samples);
+	for (int p = 0; p < passes; p++) {
+		for (unsigned int i = 1; i+1 < samples.size(); i++) {
+			smoothed[i] = 0.5f*samples[i] + 0.25f*(samples[i-1]+samples[i+1]);
+		}
+		samples.swap(smoothed);
+	}
+}
+
+// one ray per sample, cast as a batch.  the depth is the middle of the
+// segment between where the ray enters the mesh & where it next leaves.
+void SketchStroke::CastRays(Camera *camera, const Mesh *mesh) {
+	std::vector<Ray> rays;
+	rays.reserve(samples.size());
+	for (unsigned int i = 0; i < samples.size(); i++) {
+		rays.push_back(camera->generateRay(samples[i].x,samples[i].y));
+	}
+	const BVH *bvh = mesh->getOriginalQuadsBVH();
+	float epsilon = 0.0001f*mesh->getBoundingBox()->maxDim();
+	std::vector<glm::vec3> midpoints(rays.size());
+	std::vector<char> hit(rays.size(),0);
+
+#pragma omp parallel for schedule(dynamic,16)
+	for (int i = 0; i < (int)rays.size(); i++) {
+		const Ray &r = rays[i];
+		float t_in;
+		if (bvh->IntersectClosest(r,t_in,true) == -1) continue;
+		// step just past the entry point & look for the exit
+		float nudge = epsilon/glm::length(r.getDirection());
+		Ray inside(r.pointAtParameter(t_in+nudge),r.getDirection());
+		float t_out;
+		float t_mid = t_in;
+		if (bvh->IntersectClosest(inside,t_out,true) != -1) {
+			t_mid = t_in + 0.5f*(nudge+t_out);
+		}
+		midpoints[i] = r.pointAtParameter(t_mid);
+		hit[i] = 1;
+	}
+
+	points.clear();
+	for (unsigned int i = 0; i < rays.size(); i++) {
+		if (hit[i]) points.push_back(midpoints[i]);
+	}
+}
+
+void SketchStroke::FitPolyline(float tolerance) {
+	polyline.clear();
+	std::vector<char> keep(points.size(),0);
+	keep[0] = 1;
+	keep[points.size()-1] = 1;
+	if (points.size() > 2) Simplify(0,points.size()-1,tolerance,keep);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (keep[i]) polyline.push_back(i);
+	}
+}
+
+// douglas-peucker: keep the point farthest from the segment first-last
+// if it is out of tolerance, and recurse on both halves
+void SketchStroke::Simplify(int first, int last, float tolerance, std::vector<char> &keep) const {
+	if (last-first < 2) return;
+	const glm::vec3 &a = points[first];
+	glm::vec3 ab = points[last]-a;
+	float ab2 = glm::dot(ab,ab);
+	int farthest = -1;
+	float farthest_d2 = tolerance*tolerance;
+	for (int i = first+1; i < last; i++) {
+		glm::vec3 ap = points[i]-a;
+		float s = ab2 > 0 ? std::min(1.0f,std::max(0.0f,glm::dot(ap,ab)/ab2)) : 0;
+		glm::vec3 d = ap - s*ab;
+		float d2 = glm::dot(d,d);
+		if (d2 > farthest_d2) {
+			farthest = i;
+			farthest_d2 = d2;
+		}
+	}
+	if (farthest == -1) return;
+	keep[farthest] = 1;
+	Simplify(first,farthest,tolerance,keep);
+	Simplify(farthest,last,tolerance,keep);
+}
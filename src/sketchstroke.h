@@ -0,0 +1,57 @@
+#ifndef _SKETCH_STROKE_H
+#define _SKETCH_STROKE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Camera;
+class Mesh;
+class JointTree;
+
+// ==================================================================
+// Turns one finished pencil stroke into a chain of joints:
+//   1. the stroke (in the normalized image coordinates given to
+//      Camera::generateRay) is resampled evenly by arc length & smoothed
+//   2. a ray is cast through every sample, all of them in one parallel
+//      batch, finding where it enters & leaves the mesh
+//   3. the midpoint of that inside segment gives the sample its depth
+//      (the same midpoint TraceRay uses for a placed joint)
+//   4. the 3d points are simplified to a polyline (Douglas-Peucker)
+//   5. a joint is placed at each polyline vertex, chained together and
+//      hung off the selected joint (or the closest one)
+
+class SketchStroke {
+public:
+	//Constructor
+	SketchStroke() {}
+
+	//Accessors
+	int numSamples() const { return samples.size(); }
+	const glm::vec2& getSample(int i) const { return samples[i]; }
+
+	//Modifiers
+	void addSample(double x, double y) { samples.push_back(glm::vec2(x,y)); }
+	void clear() { samples.clear(); }
+	// pixel_size is the width of one pixel in image coordinates.
+	// returns the number of joints added to the tree.
+	int ToJoints(Camera *camera, const Mesh *mesh, JointTree *tree, float pixel_size);
+
+private:
+
+	//helpers
+	void Resample(float spacing);
+	void Smooth(int passes);
+	void CastRays(Camera *camera, const Mesh *mesh);
+	void FitPolyline(float tolerance);
+	void Simplify(int first, int last, float tolerance, std::vector<char> &keep) const;
+
+	//representation
+	// the raw stroke, then the resampled & smoothed one
+	std::vector<glm::vec2> samples;
+	// the depth-corrected points of the samples that hit the mesh
+	std::vector<glm::vec3> points;
+	// the indices of points kept for the polyline
+	std::vector<int> polyline;
+};
+
+#endif
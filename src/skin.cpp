@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <omp.h>
+
+#include "skin.h"
+#include "mesh.h"
+#include "joint.h"
+#include "radixsort.h"
+
+// how far a joint's weight reaches over the surface, in multiples of
+// the thickness of the body around it
+#define SKIN_FALLOFF 1.5f
+
+// =======================================================================
+
+void Skin::Bind(const Mesh *mesh, JointTree *tree) {
+  double start = omp_get_wtime();
+  const GeometryCache &geometry = mesh->getGeometryCache();
+  int num_vertices = geometry.numVertices();
+  rest_x.assign(geometry.getX(),geometry.getX()+num_vertices);
+  rest_y.assign(geometry.getY(),geometry.getY()+num_vertices);
+  rest_z.assign(geometry.getZ(),geometry.getZ()+num_vertices);
+  posed_x = rest_x;
+  posed_y = rest_y;
+  posed_z = rest_z;
+  num_joints = tree->size();
+  for (int k = 0; k < SKIN_INFLUENCES; k++) {
+    joint_ids[k].assign(num_vertices,0);
+    weights[k].assign(num_vertices,0);
+  }
+  if (num_joints == 0 || num_vertices == 0) return;
+
+  BuildAdjacency(mesh);
+  AssignBones(tree);
+  std::vector<int> entry_vertex;
+  std::vector<int> entry_joint;
+  std::vector<float> entry_weight;
+  SpreadWeights(entry_vertex,entry_joint,entry_weight);
+  KeepStrongest(entry_vertex,entry_joint,entry_weight);
+
+  std::cout << " skin bound: " << num_vertices << " vertices to " << num_joints << " joints ("
+            << entry_vertex.size() << " candidate weights) in "
+            << 1000*(omp_get_wtime()-start) << " ms." << std::endl;
+}
+
+// =======================================================================
+// BINDING
+
+void Skin::BuildAdjacency(const Mesh *mesh) {
+  // both directions of every quad edge (shared edges appear twice,
+  // which only costs Dijkstra a redundant relaxation)
+  const GeometryCache &geometry = mesh->getGeometryCache();
+  int num_vertices = geometry.numVertices();
+  std::vector<int> degree(num_vertices+1,0);
+  for (int q = 0; q < geometry.numQuadSlots(); q++) {
+    if (!geometry.isActiveQuad(q)) continue;
+    const int *verts = geometry.getQuadVertices(q);
+    for (int j = 0; j < 4; j++) {
+      degree[verts[j]]++;
+      degree[verts[(j+1)%4]]++;
+    }
+  }
+  neighbor_start.assign(num_vertices+1,0);
+  for (int v = 0; v < num_vertices; v++) {
+    neighbor_start[v+1] = neighbor_start[v] + degree[v];
+  }
+  neighbors.resize(neighbor_start[num_vertices]);
+  std::vector<int> fill(neighbor_start.begin(),neighbor_start.end()-1);
+  for (int q = 0; q < geometry.numQuadSlots(); q++) {
+    if (!geometry.isActiveQuad(q)) continue;
+    const int *verts = geometry.getQuadVertices(q);
+    for (int j = 0; j < 4; j++) {
+      int a = verts[j];
+      int b = verts[(j+1)%4];
+      neighbors[fill[a]++] = b;
+      neighbors[fill[b]++] = a;
+    }
+  }
+  neighbor_length.resize(neighbors.size());
+#pragma omp parallel for
+  for (int v = 0; v < num_vertices; v++) {
+    glm::vec3 p(rest_x[v],rest_y[v],rest_z[v]);
+    for (int n = neighbor_start[v]; n < neighbor_start[v+1]; n++) {
+      int u = neighbors[n];
+      neighbor_length[n] = glm::distance(p,glm::vec3(rest_x[u],rest_y[u],rest_z[u]));
+    }
+  }
+}
+
+void Skin::AssignBones(JointTree *tree) {
+  // the bone from a joint to each child is moved by that joint.  a
+  // joint with no parent & no children is a bone of its own.
+  std::vector<glm::vec3> bone_start;
+  std::vector<glm::vec3> bone_end;
+  std::vector<int> bone_joint;
+  std::vector<char> has_child(num_joints,0);
+  for (int j = 0; j < num_joints; j++) {
+    int parent = tree->getJoint(j).getParent();
+    if (parent < 0 || parent >= num_joints) continue;
+    bone_start.push_back(tree->getJoint(parent).getPos());
+    bone_end.push_back(tree->getJoint(j).getPos());
+    bone_joint.push_back(parent);
+    has_child[parent] = 1;
+  }
+  for (int j = 0; j < num_joints; j++) {
+    const Joint &joint = tree->getJoint(j);
+    if (has_child[j] || (joint.getParent() >= 0 && joint.getParent() < num_joints)) continue;
+    bone_start.push_back(joint.getPos());
+    bone_end.push_back(joint.getPos());
+    bone_joint.push_back(j);
+  }
+  int num_bones = bone_joint.size();
+
+  int num_vertices = rest_x.size();
+  nearest_joint.assign(num_vertices,-1);
+  nearest_distance.assign(num_vertices,0);
+#pragma omp parallel for
+  for (int v = 0; v < num_vertices; v++) {
+    glm::vec3 p(rest_x[v],rest_y[v],rest_z[v]);
+    float best_d2 = std::numeric_limits<float>::max();
+    int best = -1;
+    for (int b = 0; b < num_bones; b++) {
+      glm::vec3 ab = bone_end[b] - bone_start[b];
+      glm::vec3 ap = p - bone_start[b];
+      float ab2 = glm::dot(ab,ab);
+      float s = ab2 > 0 ? std::min(1.0f,std::max(0.0f,glm::dot(ap,ab)/ab2)) : 0;
+      glm::vec3 d = ap - s*ab;
+      float d2 = glm::dot(d,d);
+      if (d2 < best_d2) {
+        best_d2 = d2;
+        best = bone_joint[b];
+      }
+    }
+    nearest_joint[v] = best;
+    nearest_distance[v] = std::sqrt(best_d2);
+  }
+
+  // the reach of a joint follows the average thickness of its vertices
+  std::vector<double> thickness(num_joints,0);
+  std::vector<int> count(num_joints,0);
+  for (int v = 0; v < num_vertices; v++) {
+    thickness[nearest_joint[v]] += nearest_distance[v];
+    count[nearest_joint[v]]++;
+  }
+  joint_radius.assign(num_joints,0);
+  for (int j = 0; j < num_joints; j++) {
+    if (count[j] > 0) joint_radius[j] = SKIN_FALLOFF * thickness[j] / count[j];
+  }
+}
+
+void Skin::SpreadWeights(std::vector<int> &entry_vertex, std::vector<int> &entry_joint,
+                         std::vector<float> &entry_weight) const {
+  // the vertices of each joint, by joint
+  int num_vertices = rest_x.size();
+  std::vector<int> joint_start(num_joints+1,0);
+  for (int v = 0; v < num_vertices; v++) joint_start[nearest_joint[v]+1]++;
+  for (int j = 0; j < num_joints; j++) joint_start[j+1] += joint_start[j];
+  std::vector<int> owned(num_vertices);
+  std::vector<int> fill(joint_start.begin(),joint_start.end()-1);
+  for (int v = 0; v < num_vertices; v++) owned[fill[nearest_joint[v]]++] = v;
+
+  // Dijkstra out of each joint's own vertices, one joint per thread,
+  // stopping at the edge of its reach
+#pragma omp parallel
+  {
+    std::vector<float> distance(num_vertices,std::numeric_limits<float>::max());
+    std::vector<int> touched;
+    std::vector<int> local_vertex;
+    std::vector<int> local_joint;
+    std::vector<float> local_weight;
+    typedef std::pair<float,int> Item;
+#pragma omp for schedule(dynamic,1)
+    for (int j = 0; j < num_joints; j++) {
+      float radius = joint_radius[j];
+      std::priority_queue<Item,std::vector<Item>,std::greater<Item> > queue;
+      for (int i = joint_start[j]; i < joint_start[j+1]; i++) {
+        int v = owned[i];
+        distance[v] = 0;
+        touched.push_back(v);
+        queue.push(Item(0,v));
+      }
+      while (!queue.empty()) {
+        Item top = queue.top();
+        queue.pop();
+        int v = top.second;
+        if (top.first > distance[v]) continue;
+        float x = (radius > 0) ? top.first / radius : 0;
+        local_vertex.push_back(v);
+        local_joint.push_back(j);
+        local_weight.push_back((1-x*x)*(1-x*x));
+        for (int n = neighbor_start[v]; n < neighbor_start[v+1]; n++) {
+          int u = neighbors[n];
+          float d = top.first + neighbor_length[n];
+          if (d >= radius || d >= distance[u]) continue;
+          if (distance[u] == std::numeric_limits<float>::max()) touched.push_back(u);
+          distance[u] = d;
+          queue.push(Item(d,u));
+        }
+      }
+      for (unsigned int i = 0; i < touched.size(); i++) {
+        distance[touched[i]] = std::numeric_limits<float>::max();
+      }
+      touched.clear();
+    }
+#pragma omp critical
+    {
+      entry_vertex.insert(entry_vertex.end(),local_vertex.begin(),local_vertex.end());
+      entry_joint.insert(entry_joint.end(),local_joint.begin(),local_joint.end());
+      entry_weight.insert(entry_weight.end(),local_weight.begin(),local_weight.end());
+    }
+  }
+}
+
+void Skin::KeepStrongest(const std::vector<int> &entry_vertex, const std::vector<int> &entry_joint,
+                         const std::vector<float> &entry_weight) {
+  // group the candidate weights by vertex
+  int num_vertices = rest_x.size();
+  int num_entries = entry_vertex.size();
+  int vertex_bits = 1;
+  while (vertex_bits < 31 && (1 << vertex_bits) < num_vertices) vertex_bits++;
+  std::vector<unsigned long long> keys(num_entries);
+  std::vector<int> order(num_entries);
+#pragma omp parallel for
+  for (int i = 0; i < num_entries; i++) {
+    keys[i] = entry_vertex[i];
+    order[i] = i;
+  }
+  RadixSort(keys,order,vertex_bits);
+  std::vector<int> vertex_start(num_vertices+1,0);
+  for (int i = 0; i < num_entries; i++) vertex_start[keys[i]+1]++;
+  for (int v = 0; v < num_vertices; v++) vertex_start[v+1] += vertex_start[v];
+
+#pragma omp parallel for
+  for (int v = 0; v < num_vertices; v++) {
+    // every vertex has its own joint at weight 1, so there is at least one
+    int best_joint[SKIN_INFLUENCES];
+    float best_weight[SKIN_INFLUENCES];
+    int count = 0;
+    for (int i = vertex_start[v]; i < vertex_start[v+1]; i++) {
+      int joint = entry_joint[order[i]];
+      float weight = entry_weight[order[i]];
+      // insertion into the sorted top list, heaviest first (then lowest joint)
+      int slot = count;
+      while (slot > 0 && (weight > best_weight[slot-1] ||
+                          (weight == best_weight[slot-1] && joint < best_joint[slot-1]))) slot--;
+      if (slot >= SKIN_INFLUENCES) continue;
+      if (count < SKIN_INFLUENCES) count++;
+      for (int k = count-1; k > slot; k--) {
+        best_joint[k] = best_joint[k-1];
+        best_weight[k] = best_weight[k-1];
+      }
+      best_joint[slot] = joint;
+      best_weight[slot] = weight;
+    }
+    assert (count > 0);
+    float total = 0;
+    for (int k = 0; k < count; k++) total += best_weight[k];
+    for (int k = 0; k < SKIN_INFLUENCES; k++) {
+      // the unused influences point at a real joint with no weight, so
+      // the posing loop needs no branches
+      joint_ids[k][v] = (k < count) ? best_joint[k] : best_joint[0];
+      weights[k][v] = (k < count) ? best_weight[k] / total : 0;
+    }
+  }
+}
+
+// =======================================================================
+// POSING
+
+double Skin::Deform(const std::vector<glm::mat4> &transforms, enum SKINNING_MODE mode) {
+  assert ((int)transforms.size() == num_joints);
+  double start = omp_get_wtime();
+  if (!rest_x.empty()) {
+    if (mode == SKINNING_DUAL_QUATERNION) DeformDualQuaternion(transforms);
+    else DeformLinear(transforms);
+  }
+  return 1000*(omp_get_wtime()-start);
+}
+
+void Skin::DeformLinear(const std::vector<glm::mat4> &transforms) {
+  palette.resize(12*num_joints);
+  for (int j = 0; j < num_joints; j++) {
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 4; c++) {
+        palette[12*j+4*r+c] = transforms[j][c][r];
+      }
+    }
+  }
+
+  int num_vertices = rest_x.size();
+  const float *rx = &rest_x[0];
+  const float *ry = &rest_y[0];
+  const float *rz = &rest_z[0];
+  float *px = &posed_x[0];
+  float *py = &posed_y[0];
+  float *pz = &posed_z[0];
+  const float *m = &palette[0];
+  const int *ids[SKIN_INFLUENCES];
+  const float *ws[SKIN_INFLUENCES];
+  for (int k = 0; k < SKIN_INFLUENCES; k++) {
+    ids[k] = &joint_ids[k][0];
+    ws[k] = &weights[k][0];
+  }
+
+#pragma omp parallel for simd schedule(static)
+  for (int v = 0; v < num_vertices; v++) {
+    // blend the transforms, then apply the blend once
+    float b[12] = { 0,0,0,0, 0,0,0,0, 0,0,0,0 };
+    for (int k = 0; k < SKIN_INFLUENCES; k++) {
+      const float *t = m + 12*ids[k][v];
+      float w = ws[k][v];
+      for (int e = 0; e < 12; e++) b[e] += w*t[e];
+    }
+    float x = rx[v], y = ry[v], z = rz[v];
+    px[v] = b[0]*x + b[1]*y + b[2]*z  + b[3];
+    py[v] = b[4]*x + b[5]*y + b[6]*z  + b[7];
+    pz[v] = b[8]*x + b[9]*y + b[10]*z + b[11];
+  }
+}
+
+// the rotation of a rigid transform as a unit quaternion (x,y,z,w)
+static void RotationQuaternion(const glm::mat4 &m, float *q) {
+  float trace = m[0][0] + m[1][1] + m[2][2];
+  if (trace > 0) {
+    float s = 0.5f / std::sqrt(trace + 1);
+    q[3] = 0.25f / s;
+    q[0] = (m[1][2] - m[2][1]) * s;
+    q[1] = (m[2][0] - m[0][2]) * s;
+    q[2] = (m[0][1] - m[1][0]) * s;
+  } else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+    float s = 2 * std::sqrt(1 + m[0][0] - m[1][1] - m[2][2]);
+    q[3] = (m[1][2] - m[2][1]) / s;
+    q[0] = 0.25f * s;
+    q[1] = (m[1][0] + m[0][1]) / s;
+    q[2] = (m[2][0] + m[0][2]) / s;
+  } else if (m[1][1] > m[2][2]) {
+    float s = 2 * std::sqrt(1 + m[1][1] - m[0][0] - m[2][2]);
+    q[3] = (m[2][0] - m[0][2]) / s;
+    q[0] = (m[1][0] + m[0][1]) / s;
+    q[1] = 0.25f * s;
+    q[2] = (m[2][1] + m[1][2]) / s;
+  } else {
+    float s = 2 * std::sqrt(1 + m[2][2] - m[0][0] - m[1][1]);
+    q[3] = (m[0][1] - m[1][0]) / s;
+    q[0] = (m[2][0] + m[0][2]) / s;
+    q[1] = (m[2][1] + m[1][2]) / s;
+    q[2] = 0.25f * s;
+  }
+  float length = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+  for (int i = 0; i < 4; i++) q[i] /= length;
+}
+
+void Skin::DeformDualQuaternion(const std::vector<glm::mat4> &transforms) {
+  // each transform as real part r & dual part d = 0.5 * (t,0) * r
+  palette.resize(8*num_joints);
+  for (int j = 0; j < num_joints; j++) {
+    float *r = &palette[8*j];
+    float *d = r+4;
+    RotationQuaternion(transforms[j],r);
+    glm::vec3 t(transforms[j][3]);
+    d[0] = 0.5f * ( t.x*r[3] + t.y*r[2] - t.z*r[1]);
+    d[1] = 0.5f * (-t.x*r[2] + t.y*r[3] + t.z*r[0]);
+    d[2] = 0.5f * ( t.x*r[1] - t.y*r[0] + t.z*r[3]);
+    d[3] = 0.5f * (-t.x*r[0] - t.y*r[1] - t.z*r[2]);
+  }
+
+  int num_vertices = rest_x.size();
+  const float *rx = &rest_x[0];
+  const float *ry = &rest_y[0];
+  const float *rz = &rest_z[0];
+  float *px = &posed_x[0];
+  float *py = &posed_y[0];
+  float *pz = &posed_z[0];
+  const float *m = &palette[0];
+  const int *ids[SKIN_INFLUENCES];
+  const float *ws[SKIN_INFLUENCES];
+  for (int k = 0; k < SKIN_INFLUENCES; k++) {
+    ids[k] = &joint_ids[k][0];
+    ws[k] = &weights[k][0];
+  }
+
+#pragma omp parallel for simd schedule(static)
+  for (int v = 0; v < num_vertices; v++) {
+    // blend the dual quaternions, each flipped into the same hemisphere
+    // as the first so the blend takes the short way around
+    const float *first = m + 8*ids[0][v];
+    float b[8] = { 0,0,0,0, 0,0,0,0 };
+    for (int k = 0; k < SKIN_INFLUENCES; k++) {
+      const float *q = m + 8*ids[k][v];
+      float hemisphere = first[0]*q[0] + first[1]*q[1] + first[2]*q[2] + first[3]*q[3];
+      float w = (hemisphere < 0) ? -ws[k][v] : ws[k][v];
+      for (int e = 0; e < 8; e++) b[e] += w*q[e];
+    }
+    float inverse = 1.0f / std::sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2] + b[3]*b[3]);
+    float x0 = b[0]*inverse, y0 = b[1]*inverse, z0 = b[2]*inverse, w0 = b[3]*inverse;
+    float xe = b[4]*inverse, ye = b[5]*inverse, ze = b[6]*inverse, we = b[7]*inverse;
+
+    // rotate: p + 2 r.xyz x (r.xyz x p + w p)
+    float x = rx[v], y = ry[v], z = rz[v];
+    float cx = y0*z - z0*y + w0*x;
+    float cy = z0*x - x0*z + w0*y;
+    float cz = x0*y - y0*x + w0*z;
+    x += 2 * (y0*cz - z0*cy);
+    y += 2 * (z0*cx - x0*cz);
+    z += 2 * (x0*cy - y0*cx);
+    // translate: 2 (w d.xyz - d.w r.xyz + r.xyz x d.xyz)
+    px[v] = x + 2 * (w0*xe - we*x0 + y0*ze - z0*ye);
+    py[v] = y + 2 * (w0*ye - we*y0 + z0*xe - x0*ze);
+    pz[v] = z + 2 * (w0*ze - we*z0 + x0*ye - y0*xe);
+  }
+}
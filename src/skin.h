@@ -0,0 +1,104 @@
+#ifndef _SKIN_H_
+#define _SKIN_H_
+
+#include <vector>
+#include <glm/glm.hpp>
+
+class Mesh;
+class JointTree;
+
+// the most joints that move one vertex
+#define SKIN_INFLUENCES 4
+
+enum SKINNING_MODE { SKINNING_LINEAR, SKINNING_DUAL_QUATERNION };
+
+// ==================================================================
+// Binds the mesh vertices to the joints of a rig & poses them with
+// linear or dual quaternion blend skinning.
+//
+// Binding: each joint owns the bones to its children (a tip joint just
+// its own position), and every vertex starts out belonging to the
+// closest bone.  The weight of a joint then falls off with the
+// distance walked over the mesh edges out of its own vertices, so a
+// joint reaches around the surface to its neighbours but never jumps
+// a gap (between two fingers, say) the way straight line distance
+// would.  The falloff radius is the thickness of the body around the
+// joint.  The top SKIN_INFLUENCES weights of each vertex are kept, in
+// structure of arrays form, normalized to sum to 1.
+//
+// Posing: transforms[j] carries the rest pose of joint j to its posed
+// position, and the posed vertex is the weighted blend of its joints'
+// transforms applied to the rest position.  Linear blending averages
+// the matrices, which shrinks the mesh where the joints twist (the
+// "candy wrapper" at a wrist).  Dual quaternion blending averages the
+// rigid motions instead & keeps the volume, but ignores any scale in
+// the transforms.  Both modes share the weights.  The vertices are
+// split across threads & each thread runs a SIMD loop over its share.
+
+class Skin {
+
+ public:
+
+  // ========================
+  // CONSTRUCTOR & DESTRUCTOR
+  Skin() : num_joints(0) {}
+
+  // =========
+  // ACCESSORS
+  int numVertices() const { return rest_x.size(); }
+  int numJoints() const { return num_joints; }
+  // influence k of vertex v (the unused ones have weight 0)
+  int getJoint(int v, int k) const { return joint_ids[k][v]; }
+  float getWeight(int v, int k) const { return weights[k][v]; }
+  // the positions written by the last Deform
+  const float* getPosedX() const { return posed_x.empty() ? NULL : &posed_x[0]; }
+  const float* getPosedY() const { return posed_y.empty() ? NULL : &posed_y[0]; }
+  const float* getPosedZ() const { return posed_z.empty() ? NULL : &posed_z[0]; }
+
+  // =========
+  // MODIFIERS
+  // compute the weights for the current vertex positions & joints
+  void Bind(const Mesh *mesh, JointTree *tree);
+  // one transform per joint, returns the time taken in ms
+  double Deform(const std::vector<glm::mat4> &transforms,
+                enum SKINNING_MODE mode = SKINNING_LINEAR);
+
+ private:
+
+  // HELPER FUNCTIONS
+  void BuildAdjacency(const Mesh *mesh);
+  void AssignBones(JointTree *tree);
+  void SpreadWeights(std::vector<int> &entry_vertex, std::vector<int> &entry_joint,
+                     std::vector<float> &entry_weight) const;
+  void KeepStrongest(const std::vector<int> &entry_vertex, const std::vector<int> &entry_joint,
+                     const std::vector<float> &entry_weight);
+  void DeformLinear(const std::vector<glm::mat4> &transforms);
+  void DeformDualQuaternion(const std::vector<glm::mat4> &transforms);
+
+  // REPRESENTATION
+  int num_joints;
+  // the rest pose, as in the GeometryCache
+  std::vector<float> rest_x;
+  std::vector<float> rest_y;
+  std::vector<float> rest_z;
+  // the mesh edges around each vertex (compressed rows)
+  std::vector<int> neighbor_start;
+  std::vector<int> neighbors;
+  std::vector<float> neighbor_length;
+  // the joint owning the closest bone to each vertex & its distance
+  std::vector<int> nearest_joint;
+  std::vector<float> nearest_distance;
+  // how far each joint's weight reaches over the surface
+  std::vector<float> joint_radius;
+  // the sparse weights
+  std::vector<int> joint_ids[SKIN_INFLUENCES];
+  std::vector<float> weights[SKIN_INFLUENCES];
+  // the joint transforms, as the top 3 rows of each (12 floats) for
+  // linear blending or as a unit dual quaternion (8 floats)
+  std::vector<float> palette;
+  std::vector<float> posed_x;
+  std::vector<float> posed_y;
+  std::vector<float> posed_z;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "argparser.h"
+#include "glCanvas.h"
+#include "mesh.h"
+#include "joint.h"
+#include "autorigger.h"
+#include "skin.h"
+
+// ====================================================================
+// Times linear blend & dual quaternion skinning on a model, rigged
+// automatically & subdivided to the requested density:
+//
+//   skin_bench ../models/new_hand.obj 2
+//   skin_bench ../models/new_FinalBaseMesh.obj 1 200
+//
+// Every joint twists about its bone (more towards the tips), the case
+// where linear blending loses volume.  Besides the times, the posed
+// distance from each vertex to its main joint is compared with the
+// rest distance: about 1 means the volume was kept.
+// ====================================================================
+
+static double Median(std::vector<double> times) {
+  std::sort(times.begin(),times.end());
+  return times[times.size()/2];
+}
+
+static double Thickness(const Skin &skin, const Mesh *mesh, JointTree &tree,
+                        const std::vector<glm::mat4> &transforms) {
+  const GeometryCache &geometry = mesh->getGeometryCache();
+  double total = 0;
+  int count = 0;
+  for (int v = 0; v < skin.numVertices(); v++) {
+    int j = skin.getJoint(v,0);
+    glm::vec3 joint = tree.getJoint(j).getPos();
+    float rest = glm::distance(geometry.getPosition(v),joint);
+    if (rest <= 0) continue;
+    glm::vec3 posed_joint = glm::vec3(transforms[j] * glm::vec4(joint,1));
+    glm::vec3 posed(skin.getPosedX()[v],skin.getPosedY()[v],skin.getPosedZ()[v]);
+    total += glm::distance(posed,posed_joint) / rest;
+    count++;
+  }
+  return count ? total / count : 1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 4) {
+    std::cerr << "usage: " << argv[0] << " <model.obj> [subdivisions] [repetitions]" << std::endl;
+    return 1;
+  }
+  ArgParser args;
+  separatePathAndFile(argv[1],args.path,args.input_file);
+  args.mesh_cache = false;
+  GLCanvas::args = &args;
+  int subdivisions = (argc > 2) ? atoi(argv[2]) : 0;
+  int repetitions = (argc > 3) ? std::max(1,atoi(argv[3])) : 100;
+
+  Mesh *mesh = new Mesh();
+  mesh->Parallel(&args);
+  JointTree tree;
+  AutoRigger auto_rigger(mesh,&args);
+  if (auto_rigger.Rig(&tree) == 0) {
+    std::cerr << "ERROR: could not rig " << argv[1] << std::endl;
+    return 1;
+  }
+  for (int i = 0; i < subdivisions; i++) mesh->Subdivision();
+  Skin skin;
+  skin.Bind(mesh,&tree);
+
+  // twist each joint about its bone, by its depth in the tree
+  std::vector<glm::mat4> transforms(tree.size());
+  for (int j = 0; j < tree.size(); j++) {
+    int depth = 0;
+    for (int p = tree.getJoint(j).getParent(); p >= 0; p = tree.getJoint(p).getParent()) depth++;
+    glm::vec3 pos = tree.getJoint(j).getPos();
+    int parent = tree.getJoint(j).getParent();
+    glm::vec3 axis = (parent >= 0) ? pos - tree.getJoint(parent).getPos() : glm::vec3(0,1,0);
+    if (glm::length(axis) <= 0) axis = glm::vec3(0,1,0);
+    transforms[j] = glm::translate(glm::mat4(1.0f),pos) *
+      glm::rotate(glm::mat4(1.0f),0.25f*std::min(depth,6),glm::normalize(axis)) *
+      glm::translate(glm::mat4(1.0f),-pos);
+  }
+
+  const char *names[2] = { "linear", "dual quaternion" };
+  enum SKINNING_MODE modes[2] = { SKINNING_LINEAR, SKINNING_DUAL_QUATERNION };
+  for (int m = 0; m < 2; m++) {
+    std::vector<double> times;
+    skin.Deform(transforms,modes[m]);
+    for (int i = 0; i < repetitions; i++) times.push_back(skin.Deform(transforms,modes[m]));
+    double median = Median(times);
+    std::cout << names[m] << ": " << skin.numVertices() << " vertices in " << median << " ms (median of "
+              << repetitions << "), " << skin.numVertices() / (1000*median) << " M vertices/s, thickness kept "
+              << Thickness(skin,mesh,tree,transforms) << std::endl;
+  }
+  delete mesh;
+  return 0;
+}
@@ -23,6 +23,8 @@ public:
   // =========
   // MODIFIERS
   void setTextureCoordinates(float _s, float _t) { s = _s; t = _t; }
+  // when the subdivided vertices are compacted
+  void setIndex(int i) { index = i; }
 
 private:
 